@@ -0,0 +1,171 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Small timing harness for the component benchmarks.
+//
+// Each benchmark body runs `iters` operations and returns the elapsed
+// nanoseconds. The harness calibrates `iters` so one sample lasts at least
+// `min_time`, takes `reps` samples after a warm-up sample, and reports
+// robust statistics (median and median absolute deviation) alongside the
+// mean so outliers from scheduling noise are visible instead of hidden.
+
+struct BenchOptions {
+  int reps = 15;
+  double min_time_ms = 20;
+  std::string filter;
+};
+
+struct BenchResult {
+  std::string name;
+  int threads = 1;
+  uint64_t iters = 0;           // operations per sample (all threads)
+  std::vector<double> samples;  // ns per operation, one per repetition
+
+  double median() const { return percentile(50); }
+
+  double percentile(double p) const {
+    if (samples.empty()) return 0;
+    std::vector<double> s = samples;
+    std::sort(s.begin(), s.end());
+    double idx = p / 100.0 * (s.size() - 1);
+    size_t lo = static_cast<size_t>(idx);
+    size_t hi = std::min(lo + 1, s.size() - 1);
+    return s[lo] + (s[hi] - s[lo]) * (idx - lo);
+  }
+
+  double mean() const {
+    double sum = 0;
+    for (double v : samples) sum += v;
+    return samples.empty() ? 0 : sum / samples.size();
+  }
+
+  double stddev() const {
+    if (samples.size() < 2) return 0;
+    double m = mean(), acc = 0;
+    for (double v : samples) acc += (v - m) * (v - m);
+    return std::sqrt(acc / (samples.size() - 1));
+  }
+
+  // Median absolute deviation.
+  double mad() const {
+    double m = median();
+    BenchResult d;
+    for (double v : samples) d.samples.push_back(std::fabs(v - m));
+    return d.median();
+  }
+
+  double min() const {
+    return samples.empty() ? 0
+                           : *std::min_element(samples.begin(), samples.end());
+  }
+  double max() const {
+    return samples.empty() ? 0
+                           : *std::max_element(samples.begin(), samples.end());
+  }
+};
+
+using BenchBody = std::function<double(uint64_t iters)>;
+
+inline BenchResult run_bench(const std::string& name, int threads,
+                             const BenchOptions& opt, const BenchBody& body) {
+  BenchResult r;
+  r.name = name;
+  r.threads = threads;
+
+  // Calibrate: grow until one sample takes at least min_time.
+  uint64_t iters = 64;
+  double ns = body(iters);
+  while (ns < opt.min_time_ms * 1e6 && iters < (1ULL << 40)) {
+    double scale = ns > 0 ? (opt.min_time_ms * 1e6 * 1.2) / ns : 10;
+    scale = std::min(std::max(scale, 2.0), 100.0);
+    iters = static_cast<uint64_t>(iters * scale);
+    ns = body(iters);
+  }
+  r.iters = iters;
+
+  body(iters);  // warm-up
+  for (int i = 0; i < opt.reps; i++) r.samples.push_back(body(iters) / iters);
+  return r;
+}
+
+// Runs body(thread_id, iters_per_thread) on `threads` threads released
+// together; returns wall nanoseconds from release until the last finishes.
+inline double run_threads(
+    int threads, uint64_t iters,
+    const std::function<void(int, uint64_t)>& body) {
+  std::atomic<int> arrived{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> ts;
+  uint64_t per = std::max<uint64_t>(1, iters / threads);
+  for (int t = 0; t < threads; t++) {
+    ts.emplace_back([&, t]() {
+      arrived.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+      body(t, per);
+    });
+  }
+  while (arrived.load() < threads) std::this_thread::yield();
+  auto t0 = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& t : ts) t.join();
+  auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+template <typename T>
+inline void do_not_optimize(T const& v) {
+  asm volatile("" : : "r,m"(v) : "memory");
+}
+
+inline void print_result_header(std::ostream& out) {
+  char buf[160];
+  std::snprintf(buf, sizeof(buf), "%-40s %7s %12s %10s %10s %10s %12s\n",
+                "benchmark", "threads", "median ns/op", "mad", "min", "max",
+                "Mops/s");
+  out << buf;
+}
+
+inline void print_result(std::ostream& out, const BenchResult& r) {
+  char buf[160];
+  double med = r.median();
+  std::snprintf(buf, sizeof(buf),
+                "%-40s %7d %12.2f %10.2f %10.2f %10.2f %12.3f\n",
+                r.name.c_str(), r.threads, med, r.mad(), r.min(), r.max(),
+                med > 0 ? 1e3 / med : 0.0);
+  out << buf;
+}
+
+inline void write_results_json(std::ostream& out,
+                               const std::vector<BenchResult>& results) {
+  out << "{\n  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    char buf[512];
+    std::snprintf(buf, sizeof(buf),
+                  "    {\"name\": \"%s\", \"threads\": %d, \"iters\": %llu, "
+                  "\"reps\": %zu, \"median_ns\": %.3f, \"mean_ns\": %.3f, "
+                  "\"stddev_ns\": %.3f, \"mad_ns\": %.3f, \"min_ns\": %.3f, "
+                  "\"max_ns\": %.3f, \"p5_ns\": %.3f, \"p95_ns\": %.3f, "
+                  "\"samples_ns\": [",
+                  r.name.c_str(), r.threads, (unsigned long long)r.iters,
+                  r.samples.size(), r.median(), r.mean(), r.stddev(), r.mad(),
+                  r.min(), r.max(), r.percentile(5), r.percentile(95));
+    out << buf;
+    for (size_t j = 0; j < r.samples.size(); j++) {
+      std::snprintf(buf, sizeof(buf), "%s%.3f", j ? ", " : "", r.samples[j]);
+      out << buf;
+    }
+    out << "]}" << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n}\n";
+}
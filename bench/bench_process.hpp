@@ -0,0 +1,85 @@
+#pragma once
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Process helpers for the benchmark orchestration tools: start the server,
+// wait for it to accept connections, run a client to completion.
+
+// Starts argv[0] with the given arguments; returns the pid or -1.
+inline pid_t spawn(const std::vector<std::string>& argv, bool quiet = true) {
+  pid_t pid = ::fork();
+  if (pid != 0) return pid;
+
+  if (quiet) {
+    int devnull = ::open("/dev/null", O_WRONLY);
+    if (devnull >= 0) {
+      ::dup2(devnull, STDOUT_FILENO);
+      ::dup2(devnull, STDERR_FILENO);
+      ::close(devnull);
+    }
+  }
+  std::vector<char*> args;
+  for (auto& a : argv) args.push_back(const_cast<char*>(a.c_str()));
+  args.push_back(nullptr);
+  ::execv(args[0], args.data());
+  std::_Exit(127);
+}
+
+// Returns the exit status, or -1 if the process did not exit normally.
+inline int wait_exit(pid_t pid) {
+  int status = 0;
+  while (::waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) return -1;
+  }
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+inline int run_process(const std::vector<std::string>& argv,
+                       bool quiet = true) {
+  pid_t pid = spawn(argv, quiet);
+  return pid < 0 ? -1 : wait_exit(pid);
+}
+
+// Sends SIGINT (graceful shutdown) and waits; SIGKILL after `grace`.
+inline void stop_process(pid_t pid, std::chrono::milliseconds grace =
+                                        std::chrono::milliseconds(3000)) {
+  ::kill(pid, SIGINT);
+  auto deadline = std::chrono::steady_clock::now() + grace;
+  int status = 0;
+  while (std::chrono::steady_clock::now() < deadline) {
+    if (::waitpid(pid, &status, WNOHANG) == pid) return;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  ::kill(pid, SIGKILL);
+  ::waitpid(pid, &status, 0);
+}
+
+// Polls until a TCP connect to 127.0.0.1:port succeeds.
+inline bool wait_for_port(int port, std::chrono::milliseconds timeout =
+                                        std::chrono::milliseconds(5000)) {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (std::chrono::steady_clock::now() < deadline) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool ok = ::connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+    ::close(fd);
+    if (ok) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return false;
+}
@@ -0,0 +1,339 @@
+// Benchmark regression harness.
+//
+// Starts a local server, runs a fixed set of bench_client and microbench
+// scenarios several times, and saves every metric's samples as JSON. The
+// samples are compared against a stored baseline with a Mann-Whitney U
+// test; a metric regresses when its median is worse than the baseline by
+// more than the threshold and the difference is significant.
+//
+//   bench_regress --bin-dir DIR [--baseline PATH] [--out PATH]
+//                 [--update-baseline] [--runs N] [--threshold PCT]
+//                 [--alpha A] [--port N]
+//
+// Exit status: 0 = no regression, 1 = regression, 2 = harness error.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bench_process.hpp"
+#include "mini_json.hpp"
+
+namespace {
+
+struct Metric {
+  bool higher_is_better = false;
+  std::vector<double> samples;
+};
+
+using Metrics = std::map<std::string, Metric>;
+
+double median(std::vector<double> v) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Two-sided Mann-Whitney U test, normal approximation with tie correction.
+double mann_whitney_p(const std::vector<double>& a,
+                      const std::vector<double>& b) {
+  const size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+  if (n1 == 0 || n2 == 0) return 1.0;
+
+  std::vector<std::pair<double, int>> all;
+  for (double v : a) all.push_back({v, 0});
+  for (double v : b) all.push_back({v, 1});
+  std::sort(all.begin(), all.end());
+
+  double rank_sum_a = 0, tie_term = 0;
+  for (size_t i = 0; i < n;) {
+    size_t j = i;
+    while (j < n && all[j].first == all[i].first) j++;
+    double avg_rank = (i + 1 + j) / 2.0;
+    double t = static_cast<double>(j - i);
+    tie_term += t * t * t - t;
+    for (size_t k = i; k < j; k++)
+      if (all[k].second == 0) rank_sum_a += avg_rank;
+    i = j;
+  }
+
+  double u = rank_sum_a - n1 * (n1 + 1) / 2.0;
+  double mu = n1 * n2 / 2.0;
+  double var = n1 * n2 / 12.0 * ((n + 1) - tie_term / (double(n) * (n - 1)));
+  if (var <= 0) return 1.0;
+  double z = (std::fabs(u - mu) - 0.5) / std::sqrt(var);
+  if (z < 0) z = 0;
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+void add_sample(Metrics& m, const std::string& name, bool higher,
+                double v) {
+  auto& metric = m[name];
+  metric.higher_is_better = higher;
+  metric.samples.push_back(v);
+}
+
+// ---- Scenarios ----
+
+struct ClientScenario {
+  std::string name;
+  std::vector<std::string> args;
+};
+
+const std::vector<ClientScenario>& client_scenarios() {
+  static const std::vector<ClientScenario> s = {
+      {"client/closed_80get",
+       {"--clients", "4", "--seconds", "3", "--mix", "80:20:0", "--keyspace",
+        "100000", "--value-size", "64"}},
+      {"client/closed_write_heavy",
+       {"--clients", "4", "--seconds", "3", "--mix", "10:80:10",
+        "--keyspace", "100000", "--key-dist", "zipfian", "--value-size",
+        "16-512"}},
+      {"client/open_10k",
+       {"--clients", "4", "--seconds", "3", "--rate", "10000", "--mix",
+        "90:10:0", "--keyspace", "100000", "--value-size", "64"}},
+      {"client/churn",
+       {"--clients", "4", "--seconds", "3", "--churn", "--mix", "100:0:0",
+        "--keyspace", "1000"}},
+  };
+  return s;
+}
+
+bool run_client_scenario(const std::string& bin_dir, int port,
+                         const ClientScenario& sc, const std::string& tmp,
+                         Metrics& out) {
+  std::vector<std::string> argv = {bin_dir + "/bench_client", "--port",
+                                   std::to_string(port), "--json", tmp};
+  argv.insert(argv.end(), sc.args.begin(), sc.args.end());
+  if (run_process(argv) != 0) return false;
+
+  JsonValue j;
+  if (!read_json_file(tmp, j)) return false;
+  const JsonValue* lat = j.get("latency_us");
+  const JsonValue* all = lat ? lat->get("all") : nullptr;
+  if (!all) return false;
+
+  bool open_loop = j.number_or("target_ops_per_sec", 0) > 0;
+  if (!open_loop)
+    add_sample(out, sc.name + "/ops_per_sec", true,
+               j.number_or("ops_per_sec", 0));
+  add_sample(out, sc.name + "/p50_us", false, all->number_or("p50", 0));
+  add_sample(out, sc.name + "/p99_us", false, all->number_or("p99", 0));
+  if (open_loop)
+    add_sample(out, sc.name + "/p999_us", false, all->number_or("p999", 0));
+  return true;
+}
+
+bool run_microbench(const std::string& bin_dir, int reps,
+                    const std::string& tmp, Metrics& out) {
+  std::vector<std::string> argv = {bin_dir + "/microbench", "--max-threads",
+                                   "2", "--reps", std::to_string(reps),
+                                   "--min-time-ms", "10", "--json", tmp};
+  if (run_process(argv) != 0) return false;
+
+  JsonValue j;
+  if (!read_json_file(tmp, j)) return false;
+  const JsonValue* list = j.get("benchmarks");
+  if (!list || !list->is_array()) return false;
+  for (auto& b : list->arr) {
+    const JsonValue* name = b.get("name");
+    const JsonValue* samples = b.get("samples_ns");
+    if (!name || !samples) continue;
+    std::string key = "micro/" + name->str + "/t" +
+                      std::to_string(int(b.number_or("threads", 1))) +
+                      "/ns_per_op";
+    for (auto& s : samples->arr) add_sample(out, key, false, s.num);
+  }
+  return true;
+}
+
+// ---- Result files ----
+
+JsonValue to_json(const Metrics& m) {
+  JsonValue root = JsonValue::object();
+  JsonValue& metrics = root.set("metrics", JsonValue::object());
+  for (auto& kv : m) {
+    JsonValue e = JsonValue::object();
+    e.set("better",
+          JsonValue::string(kv.second.higher_is_better ? "higher" : "lower"));
+    e.set("median", JsonValue::number(median(kv.second.samples)));
+    JsonValue arr = JsonValue::array();
+    for (double v : kv.second.samples) arr.arr.push_back(JsonValue::number(v));
+    e.set("samples", std::move(arr));
+    metrics.set(kv.first, std::move(e));
+  }
+  return root;
+}
+
+bool from_json(const JsonValue& root, Metrics& m) {
+  const JsonValue* metrics = root.get("metrics");
+  if (!metrics || !metrics->is_object()) return false;
+  for (auto& kv : metrics->obj) {
+    Metric metric;
+    const JsonValue* better = kv.second.get("better");
+    metric.higher_is_better = better && better->str == "higher";
+    const JsonValue* samples = kv.second.get("samples");
+    if (samples)
+      for (auto& s : samples->arr) metric.samples.push_back(s.num);
+    m[kv.first] = std::move(metric);
+  }
+  return true;
+}
+
+bool write_json(const std::string& path, const Metrics& m) {
+  std::ofstream out(path);
+  if (!out) return false;
+  to_json(m).write(out);
+  out << "\n";
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string bin_dir = ".";
+  std::string baseline_path = "bench_baseline.json";
+  std::string out_path = "bench_results.json";
+  bool update_baseline = false;
+  int runs = 5;
+  double threshold = 10.0;
+  double alpha = 0.05;
+  int port = 18080;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto need = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << a << "\n";
+        std::exit(2);
+      }
+      return std::string(argv[++i]);
+    };
+    if (a == "--bin-dir")
+      bin_dir = need();
+    else if (a == "--baseline")
+      baseline_path = need();
+    else if (a == "--out")
+      out_path = need();
+    else if (a == "--update-baseline")
+      update_baseline = true;
+    else if (a == "--runs")
+      runs = std::max(1, std::stoi(need()));
+    else if (a == "--threshold")
+      threshold = std::stod(need());
+    else if (a == "--alpha")
+      alpha = std::stod(need());
+    else if (a == "--port")
+      port = std::stoi(need());
+    else if (a == "--help") {
+      std::cout << "Usage: bench_regress --bin-dir DIR [--baseline PATH] "
+                   "[--out PATH] [--update-baseline]\n"
+                   "                     [--runs N] [--threshold PCT] "
+                   "[--alpha A] [--port N]\n";
+      return 0;
+    }
+  }
+
+  const std::string tmp = out_path + ".tmp";
+  Metrics current;
+
+  // Client scenarios against one long-lived server. Each connection holds
+  // a worker thread, so the server needs more threads than any scenario
+  // has clients.
+  pid_t server = spawn({bin_dir + "/server", "--port", std::to_string(port),
+                        "--threads", "8"});
+  if (server < 0 || !wait_for_port(port)) {
+    std::cerr << "server did not start on port " << port << "\n";
+    if (server > 0) stop_process(server);
+    return 2;
+  }
+  for (auto& sc : client_scenarios()) {
+    for (int r = 0; r < runs; r++) {
+      std::cerr << "running " << sc.name << " (" << r + 1 << "/" << runs
+                << ")\n";
+      if (!run_client_scenario(bin_dir, port, sc, tmp, current)) {
+        std::cerr << "scenario " << sc.name << " failed\n";
+        stop_process(server);
+        return 2;
+      }
+    }
+  }
+  stop_process(server);
+
+  std::cerr << "running microbench\n";
+  if (!run_microbench(bin_dir, std::max(runs, 5), tmp, current)) {
+    std::cerr << "microbench failed\n";
+    return 2;
+  }
+  std::remove(tmp.c_str());
+
+  if (!write_json(out_path, current)) {
+    std::cerr << "cannot write " << out_path << "\n";
+    return 2;
+  }
+  std::cerr << "results written to " << out_path << "\n";
+
+  JsonValue base_json;
+  Metrics baseline;
+  bool have_baseline = read_json_file(baseline_path, base_json) &&
+                       from_json(base_json, baseline);
+  if (update_baseline || !have_baseline) {
+    if (!write_json(baseline_path, current)) {
+      std::cerr << "cannot write " << baseline_path << "\n";
+      return 2;
+    }
+    std::cerr << (have_baseline ? "baseline updated: " : "no baseline; saved ")
+              << baseline_path << "\n";
+    return 0;
+  }
+
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "%-52s %12s %12s %8s %7s  %s\n", "metric",
+                "baseline", "current", "change", "p", "verdict");
+  std::cout << buf;
+
+  int regressions = 0;
+  for (auto& kv : current) {
+    auto it = baseline.find(kv.first);
+    if (it == baseline.end()) {
+      std::snprintf(buf, sizeof(buf), "%-52s %12s %12.2f %8s %7s  new\n",
+                    kv.first.c_str(), "-", median(kv.second.samples), "-",
+                    "-");
+      std::cout << buf;
+      continue;
+    }
+    const auto& b = it->second.samples;
+    const auto& c = kv.second.samples;
+    double mb = median(b), mc = median(c);
+    double change = mb != 0 ? 100.0 * (mc - mb) / mb : 0;
+    double worse = kv.second.higher_is_better ? -change : change;
+    double p = mann_whitney_p(b, c);
+    // With too few samples the test has no power; fall back to threshold.
+    bool significant = (b.size() < 3 || c.size() < 3) || p < alpha;
+
+    const char* verdict = "ok";
+    if (worse > threshold && significant) {
+      verdict = "REGRESSION";
+      regressions++;
+    } else if (-worse > threshold && significant) {
+      verdict = "improved";
+    }
+    std::snprintf(buf, sizeof(buf), "%-52s %12.2f %12.2f %+7.1f%% %7.3f  %s\n",
+                  kv.first.c_str(), mb, mc, change, p, verdict);
+    std::cout << buf;
+  }
+
+  if (regressions > 0) {
+    std::cout << regressions << " metric(s) regressed by more than "
+              << threshold << "% (alpha " << alpha << ")\n";
+    return 1;
+  }
+  std::cout << "no regressions\n";
+  return 0;
+}
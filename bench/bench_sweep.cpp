@@ -0,0 +1,344 @@
+// Throughput-latency sweep for capacity planning.
+//
+// For every server thread count and client count, starts a server and runs
+// open-loop bench_client at increasing offered rates, recording achieved
+// throughput and latency percentiles at each point. A series stops once the
+// server saturates (achieved rate well below offered). Results are written
+// as CSV plus a self-contained HTML page with an SVG latency-throughput
+// plot; the capacity at the latency SLO (the knee) is marked per series.
+//
+//   bench_sweep --bin-dir DIR [--threads 4,8] [--clients 4] [--seconds S]
+//               [--rate-start R] [--rate-factor F] [--rate-max R]
+//               [--slo-us US] [--out PREFIX] [--port N] [-- CLIENT_ARGS...]
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench_process.hpp"
+#include "mini_json.hpp"
+
+namespace {
+
+struct Point {
+  int threads = 0;
+  int clients = 0;
+  double offered = 0;
+  double achieved = 0;
+  double p50 = 0, p90 = 0, p99 = 0, p999 = 0, max = 0;
+  double missed = 0;
+};
+
+struct Series {
+  int threads = 0;
+  int clients = 0;
+  std::vector<Point> points;
+
+  // Highest achieved throughput whose p99 is within the SLO.
+  const Point* knee(double slo_us) const {
+    const Point* best = nullptr;
+    for (auto& p : points)
+      if (p.p99 <= slo_us && (!best || p.achieved > best->achieved))
+        best = &p;
+    return best;
+  }
+};
+
+std::vector<int> parse_list(const std::string& s) {
+  std::vector<int> out;
+  size_t start = 0;
+  while (start <= s.size()) {
+    size_t comma = s.find(',', start);
+    if (comma == std::string::npos) comma = s.size();
+    out.push_back(std::stoi(s.substr(start, comma - start)));
+    start = comma + 1;
+  }
+  return out;
+}
+
+bool run_point(const std::string& bin_dir, int port, int clients,
+               double seconds, double rate,
+               const std::vector<std::string>& extra, const std::string& tmp,
+               Point& pt) {
+  std::vector<std::string> argv = {
+      bin_dir + "/bench_client", "--port",    std::to_string(port),
+      "--clients",               std::to_string(clients),
+      "--seconds",               std::to_string(int(std::ceil(seconds))),
+      "--rate",                  std::to_string(rate),
+      "--json",                  tmp};
+  argv.insert(argv.end(), extra.begin(), extra.end());
+  if (run_process(argv) != 0) return false;
+
+  JsonValue j;
+  if (!read_json_file(tmp, j)) return false;
+  const JsonValue* lat = j.get("latency_us");
+  const JsonValue* all = lat ? lat->get("all") : nullptr;
+  if (!all) return false;
+  pt.offered = rate;
+  pt.achieved = j.number_or("ops_per_sec", 0);
+  pt.missed = j.number_or("missed", 0);
+  pt.p50 = all->number_or("p50", 0);
+  pt.p90 = all->number_or("p90", 0);
+  pt.p99 = all->number_or("p99", 0);
+  pt.p999 = all->number_or("p999", 0);
+  pt.max = all->number_or("max", 0);
+  return true;
+}
+
+void write_csv(const std::string& path, const std::vector<Series>& all) {
+  std::ofstream out(path);
+  out << "threads,clients,offered_ops,achieved_ops,p50_us,p90_us,p99_us,"
+         "p999_us,max_us,missed\n";
+  for (auto& s : all)
+    for (auto& p : s.points)
+      out << p.threads << "," << p.clients << "," << p.offered << ","
+          << p.achieved << "," << p.p50 << "," << p.p90 << "," << p.p99
+          << "," << p.p999 << "," << p.max << "," << p.missed << "\n";
+}
+
+// p99 latency (log scale) against achieved throughput, one line per series.
+void write_html(const std::string& path, const std::vector<Series>& all,
+                double slo_us) {
+  const double W = 900, H = 520, L = 80, R = 220, T = 30, B = 60;
+  double xmax = 1, ymin = 1e18, ymax = 1;
+  for (auto& s : all)
+    for (auto& p : s.points) {
+      xmax = std::max(xmax, p.achieved);
+      ymin = std::min(ymin, std::max(p.p99, 1.0));
+      ymax = std::max(ymax, p.p99);
+    }
+  ymin = std::min(ymin, slo_us);
+  ymax = std::max(ymax, slo_us);
+  double ly0 = std::floor(std::log10(ymin)), ly1 = std::ceil(std::log10(ymax));
+  if (ly1 <= ly0) ly1 = ly0 + 1;
+  auto X = [&](double v) { return L + (W - L - R) * v / (xmax * 1.05); };
+  auto Y = [&](double v) {
+    double t = (std::log10(std::max(v, 1.0)) - ly0) / (ly1 - ly0);
+    return H - B - (H - T - B) * t;
+  };
+  static const char* colors[] = {"#1f77b4", "#d62728", "#2ca02c", "#ff7f0e",
+                                 "#9467bd", "#8c564b", "#e377c2", "#17becf"};
+
+  std::ofstream out(path);
+  char buf[256];
+  out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\">"
+         "<title>tcp-kv latency vs throughput</title></head>\n<body "
+         "style=\"font-family:sans-serif\">\n<h2>p99 latency vs achieved "
+         "throughput</h2>\n";
+  std::snprintf(buf, sizeof(buf),
+                "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%.0f\" "
+                "height=\"%.0f\" font-size=\"12\">\n",
+                W, H);
+  out << buf;
+
+  // Axes, grid and labels.
+  for (double e = ly0; e <= ly1; e++) {
+    double y = Y(std::pow(10, e));
+    std::snprintf(buf, sizeof(buf),
+                  "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" "
+                  "stroke=\"#ddd\"/><text x=\"%.1f\" y=\"%.1f\" "
+                  "text-anchor=\"end\">%g us</text>\n",
+                  L, y, W - R, y, L - 6, y + 4, std::pow(10, e));
+    out << buf;
+  }
+  for (int i = 0; i <= 5; i++) {
+    double v = xmax * 1.05 * i / 5, x = X(v);
+    std::snprintf(buf, sizeof(buf),
+                  "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" "
+                  "stroke=\"#ddd\"/><text x=\"%.1f\" y=\"%.1f\" "
+                  "text-anchor=\"middle\">%.0f</text>\n",
+                  x, T, x, H - B, x, H - B + 18, v);
+    out << buf;
+  }
+  std::snprintf(buf, sizeof(buf),
+                "<text x=\"%.1f\" y=\"%.1f\" text-anchor=\"middle\">achieved "
+                "ops/sec</text>\n<text x=\"16\" y=\"%.1f\" transform=\"rotate("
+                "-90 16 %.1f)\" text-anchor=\"middle\">p99 latency</text>\n",
+                (L + W - R) / 2, H - 16, (T + H - B) / 2, (T + H - B) / 2);
+  out << buf;
+  std::snprintf(buf, sizeof(buf),
+                "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" "
+                "stroke=\"#888\" stroke-dasharray=\"6 4\"/><text x=\"%.1f\" "
+                "y=\"%.1f\" fill=\"#888\">SLO %g us</text>\n",
+                L, Y(slo_us), W - R, Y(slo_us), L + 4, Y(slo_us) - 4, slo_us);
+  out << buf;
+
+  // Series with knee markers and legend.
+  for (size_t i = 0; i < all.size(); i++) {
+    const Series& s = all[i];
+    const char* c = colors[i % 8];
+    out << "<polyline fill=\"none\" stroke-width=\"2\" stroke=\"" << c
+        << "\" points=\"";
+    for (auto& p : s.points) {
+      std::snprintf(buf, sizeof(buf), "%.1f,%.1f ", X(p.achieved), Y(p.p99));
+      out << buf;
+    }
+    out << "\"/>\n";
+    for (auto& p : s.points) {
+      std::snprintf(buf, sizeof(buf),
+                    "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"3\" fill=\"%s\">"
+                    "<title>offered %.0f, achieved %.0f, p99 %.1f us</title>"
+                    "</circle>\n",
+                    X(p.achieved), Y(p.p99), c, p.offered, p.achieved, p.p99);
+      out << buf;
+    }
+    if (const Point* k = s.knee(slo_us)) {
+      std::snprintf(buf, sizeof(buf),
+                    "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"7\" fill=\"none\" "
+                    "stroke=\"%s\" stroke-width=\"2\"/>\n",
+                    X(k->achieved), Y(k->p99), c);
+      out << buf;
+    }
+    double ly = T + 18 * i;
+    std::snprintf(buf, sizeof(buf),
+                  "<rect x=\"%.1f\" y=\"%.1f\" width=\"12\" height=\"12\" "
+                  "fill=\"%s\"/><text x=\"%.1f\" y=\"%.1f\">threads=%d "
+                  "clients=%d</text>\n",
+                  W - R + 16, ly, c, W - R + 34, ly + 10, s.threads,
+                  s.clients);
+    out << buf;
+  }
+  out << "</svg>\n";
+
+  out << "<h3>Capacity at p99 &le; " << slo_us << " us</h3>\n<table "
+         "border=\"1\" cellpadding=\"4\" cellspacing=\"0\">\n<tr><th>threads"
+         "</th><th>clients</th><th>ops/sec</th><th>p99 us</th></tr>\n";
+  for (auto& s : all) {
+    const Point* k = s.knee(slo_us);
+    out << "<tr><td>" << s.threads << "</td><td>" << s.clients << "</td><td>"
+        << (k ? std::to_string(long(k->achieved)) : "-") << "</td><td>"
+        << (k ? std::to_string(k->p99) : "-") << "</td></tr>\n";
+  }
+  out << "</table>\n</body></html>\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string bin_dir = ".";
+  std::vector<int> thread_counts = {4, 8};
+  std::vector<int> client_counts = {4};
+  double seconds = 3;
+  double rate_start = 5000, rate_factor = 1.5, rate_max = 1e6;
+  double slo_us = 1000;
+  std::string out_prefix = "sweep";
+  int port = 18081;
+  std::vector<std::string> client_args;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto need = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << a << "\n";
+        std::exit(2);
+      }
+      return std::string(argv[++i]);
+    };
+    if (a == "--") {
+      client_args.assign(argv + i + 1, argv + argc);
+      break;
+    } else if (a == "--bin-dir")
+      bin_dir = need();
+    else if (a == "--threads")
+      thread_counts = parse_list(need());
+    else if (a == "--clients")
+      client_counts = parse_list(need());
+    else if (a == "--seconds")
+      seconds = std::stod(need());
+    else if (a == "--rate-start")
+      rate_start = std::stod(need());
+    else if (a == "--rate-factor")
+      rate_factor = std::max(1.05, std::stod(need()));
+    else if (a == "--rate-max")
+      rate_max = std::stod(need());
+    else if (a == "--slo-us")
+      slo_us = std::stod(need());
+    else if (a == "--out")
+      out_prefix = need();
+    else if (a == "--port")
+      port = std::stoi(need());
+    else if (a == "--help") {
+      std::cout
+          << "Usage: bench_sweep --bin-dir DIR [--threads 4,8] [--clients 4] "
+             "[--seconds S]\n"
+             "                   [--rate-start R] [--rate-factor F] "
+             "[--rate-max R] [--slo-us US]\n"
+             "                   [--out PREFIX] [--port N] [-- "
+             "BENCH_CLIENT_ARGS...]\n"
+             "Writes PREFIX.csv and PREFIX.html.\n";
+      return 0;
+    }
+  }
+
+  const std::string tmp = out_prefix + ".tmp.json";
+  std::vector<Series> all;
+  for (int threads : thread_counts) {
+    // Each connection holds a server worker thread for its lifetime.
+    std::vector<int> clients_ok;
+    for (int c : client_counts) {
+      if (c > threads)
+        std::cerr << "skipping clients=" << c << " with threads=" << threads
+                  << " (connections beyond the thread count are not served)\n";
+      else
+        clients_ok.push_back(c);
+    }
+    if (clients_ok.empty()) continue;
+
+    pid_t server = spawn({bin_dir + "/server", "--port", std::to_string(port),
+                          "--threads", std::to_string(threads)});
+    if (server < 0 || !wait_for_port(port)) {
+      std::cerr << "server did not start on port " << port << "\n";
+      if (server > 0) stop_process(server);
+      return 2;
+    }
+
+    for (int clients : clients_ok) {
+      Series s;
+      s.threads = threads;
+      s.clients = clients;
+      for (double rate = rate_start; rate <= rate_max; rate *= rate_factor) {
+        Point pt;
+        pt.threads = threads;
+        pt.clients = clients;
+        if (!run_point(bin_dir, port, clients, seconds, std::round(rate),
+                       client_args, tmp, pt)) {
+          std::cerr << "bench_client failed at rate " << rate << "\n";
+          stop_process(server);
+          return 2;
+        }
+        std::fprintf(stderr,
+                     "threads=%d clients=%d offered=%.0f achieved=%.0f "
+                     "p50=%.1f p99=%.1f p99.9=%.1f us\n",
+                     threads, clients, pt.offered, pt.achieved, pt.p50,
+                     pt.p99, pt.p999);
+        s.points.push_back(pt);
+        // Saturated: the server no longer keeps up with the offered load.
+        if (pt.achieved < 0.9 * pt.offered) break;
+      }
+      all.push_back(std::move(s));
+    }
+    stop_process(server);
+  }
+  std::remove(tmp.c_str());
+
+  write_csv(out_prefix + ".csv", all);
+  write_html(out_prefix + ".html", all, slo_us);
+
+  std::printf("%-8s %-8s %14s %10s\n", "threads", "clients", "knee ops/sec",
+              "p99 us");
+  for (auto& s : all) {
+    const Point* k = s.knee(slo_us);
+    if (k)
+      std::printf("%-8d %-8d %14.0f %10.1f\n", s.threads, s.clients,
+                  k->achieved, k->p99);
+    else
+      std::printf("%-8d %-8d %14s %10s\n", s.threads, s.clients, "-", "-");
+  }
+  std::cerr << "wrote " << out_prefix << ".csv and " << out_prefix
+            << ".html\n";
+  return 0;
+}
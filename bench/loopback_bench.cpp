@@ -0,0 +1,314 @@
+// In-process loopback benchmark: drives serve_connection() over a
+// socketpair() from inside this binary, so server-side user-space cost can
+// be measured without the TCP stack. The same command stream is then run
+// through each stage on its own to attribute time to framing (read_line),
+// parsing, execution, response formatting and the reply send.
+//
+//   loopback_bench [--ops N] [--pipeline D] [--keyspace K] [--mix G:S]
+//                  [--value-size B] [--reps R] [--json PATH|-]
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bench_harness.hpp"
+#include "command.hpp"
+#include "connection.hpp"
+#include "kvstore.hpp"
+#include "protocol.hpp"
+#include "stats.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double since(Clock::time_point t0) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+}
+
+struct Workload {
+  std::string stream;                   // all request lines, '\n'-terminated
+  std::vector<std::string_view> lines;  // views into stream, without '\n'
+};
+
+Workload make_workload(uint64_t ops, uint64_t keyspace, double get_weight,
+                       double set_weight, size_t value_size) {
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> pick(0.0, get_weight + set_weight);
+  const std::string value(value_size, 'v');
+  Workload w;
+  std::vector<size_t> offsets;
+  for (uint64_t i = 0; i < ops; i++) {
+    offsets.push_back(w.stream.size());
+    std::string key = "key:" + std::to_string(rng() % keyspace);
+    if (pick(rng) < get_weight)
+      w.stream += "GET " + key + "\n";
+    else
+      w.stream += "SET " + key + " " + value + "\n";
+  }
+  std::string_view all(w.stream);
+  for (size_t i = 0; i < offsets.size(); i++) {
+    size_t end = (i + 1 < offsets.size() ? offsets[i + 1] : all.size()) - 1;
+    w.lines.push_back(all.substr(offsets[i], end - offsets[i]));
+  }
+  return w;
+}
+
+// Reads and discards everything from fd until it is closed.
+std::thread drain(int fd) {
+  return std::thread([fd]() {
+    char buf[65536];
+    while (::recv(fd, buf, sizeof(buf), 0) > 0) {
+    }
+  });
+}
+
+// Whole path: client sends batches of `depth` pipelined requests and waits
+// for `depth` replies; serve_connection runs on its own thread.
+double end_to_end(const Workload& w, CommandEngine& engine, Stats& stats,
+                  size_t depth) {
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 0;
+  std::atomic<bool> running{true};
+  std::thread server(
+      [&]() { serve_connection(sv[0], engine, stats, running); });
+
+  char buf[65536];
+  auto read_replies = [&](size_t n) {
+    while (n > 0) {
+      ssize_t got = ::recv(sv[1], buf, sizeof(buf), 0);
+      if (got <= 0) return false;
+      for (ssize_t i = 0; i < got; i++)
+        if (buf[i] == '\n') n--;
+    }
+    return true;
+  };
+  read_replies(1);  // banner
+
+  auto t0 = Clock::now();
+  for (size_t i = 0; i < w.lines.size(); i += depth) {
+    size_t n = std::min(depth, w.lines.size() - i);
+    const char* from = w.lines[i].data();
+    const char* to = w.lines[i + n - 1].data() + w.lines[i + n - 1].size() + 1;
+    if (!send_all(sv[1], from, static_cast<size_t>(to - from))) break;
+    if (!read_replies(n)) break;
+  }
+  double ns = since(t0);
+
+  running.store(false);
+  ::shutdown(sv[1], SHUT_RDWR);
+  server.join();
+  ::close(sv[0]);
+  ::close(sv[1]);
+  return ns;
+}
+
+double stage_read(const Workload& w) {
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 0;
+  std::thread writer(
+      [&]() { send_all(sv[1], w.stream.data(), w.stream.size()); });
+  LineReader lr(8192);
+  auto t0 = Clock::now();
+  for (size_t i = 0; i < w.lines.size(); i++) {
+    auto l = lr.read_line(sv[0]);
+    if (!l) break;
+    do_not_optimize(*l);
+  }
+  double ns = since(t0);
+  writer.join();
+  ::close(sv[0]);
+  ::close(sv[1]);
+  return ns;
+}
+
+double stage_parse(const Workload& w) {
+  Command cmd;
+  auto t0 = Clock::now();
+  for (auto line : w.lines) {
+    parse_command(line, cmd);
+    do_not_optimize(cmd);
+  }
+  return since(t0);
+}
+
+double stage_execute(const Workload& w, CommandEngine& engine,
+                     std::vector<Reply>& replies) {
+  std::vector<Command> cmds(w.lines.size());
+  for (size_t i = 0; i < w.lines.size(); i++)
+    parse_command(w.lines[i], cmds[i]);
+  replies.clear();
+  replies.reserve(cmds.size());
+  auto t0 = Clock::now();
+  for (auto& c : cmds) replies.push_back(engine.execute(c));
+  return since(t0);
+}
+
+double stage_format(const std::vector<Reply>& replies) {
+  std::string out;
+  auto t0 = Clock::now();
+  for (auto& r : replies) {
+    out.clear();
+    format_reply(r, out);
+    do_not_optimize(out);
+  }
+  return since(t0);
+}
+
+double stage_send(const std::vector<Reply>& replies) {
+  std::vector<std::string> wire(replies.size());
+  for (size_t i = 0; i < replies.size(); i++)
+    format_reply(replies[i], wire[i]);
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 0;
+  std::thread reader = drain(sv[1]);
+  auto t0 = Clock::now();
+  for (auto& s : wire) send_str(sv[0], s);
+  double ns = since(t0);
+  ::shutdown(sv[0], SHUT_RDWR);
+  reader.join();
+  ::close(sv[0]);
+  ::close(sv[1]);
+  return ns;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint64_t ops = 200000;
+  size_t depth = 1;
+  uint64_t keyspace = 100000;
+  double mix_get = 80, mix_set = 20;
+  size_t value_size = 16;
+  int reps = 7;
+  std::string json_path;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto need = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << a << "\n";
+        std::exit(1);
+      }
+      return std::string(argv[++i]);
+    };
+    if (a == "--ops")
+      ops = std::max<uint64_t>(1, std::stoull(need()));
+    else if (a == "--pipeline")
+      depth = std::max<size_t>(1, std::stoull(need()));
+    else if (a == "--keyspace")
+      keyspace = std::max<uint64_t>(1, std::stoull(need()));
+    else if (a == "--mix") {
+      std::string m = need();
+      if (std::sscanf(m.c_str(), "%lf:%lf", &mix_get, &mix_set) != 2 ||
+          mix_get < 0 || mix_set < 0 || mix_get + mix_set <= 0) {
+        std::cerr << "--mix expects GET:SET weights, e.g. 80:20\n";
+        return 1;
+      }
+    } else if (a == "--value-size")
+      value_size = std::stoull(need());
+    else if (a == "--reps")
+      reps = std::max(1, std::stoi(need()));
+    else if (a == "--json")
+      json_path = need();
+    else if (a == "--help") {
+      std::cout << "Usage: loopback_bench [--ops N] [--pipeline D] "
+                   "[--keyspace K] [--mix G:S]\n"
+                   "                      [--value-size B] [--reps R] "
+                   "[--json PATH|-]\n";
+      return 0;
+    }
+  }
+  if (value_size > 8000) {
+    std::cerr << "--value-size must fit the 8192-byte line limit\n";
+    return 1;
+  }
+
+  KVStore kv;
+  Stats stats;
+  stats.on_start();
+  CommandEngine engine(kv, stats);
+  const std::string value(value_size, 'v');
+  for (uint64_t k = 0; k < keyspace; k++)
+    kv.set("key:" + std::to_string(k), value);
+
+  Workload w = make_workload(ops, keyspace, mix_get, mix_set, value_size);
+
+  enum { kRead, kParse, kExecute, kFormat, kSend, kEndToEnd, kStages };
+  const char* names[kStages] = {"read_line", "parse",  "execute",
+                                "format",    "send",   "end_to_end"};
+  std::vector<BenchResult> results(kStages);
+  for (int s = 0; s < kStages; s++) {
+    results[s].name = std::string("loopback/") + names[s];
+    results[s].iters = ops;
+  }
+
+  // Exclusive shard locks taken per SET on the end-to-end path; pipelined
+  // writes share one lock per shard per batch.
+  uint64_t sets = 0, e2e_locks = 0;
+  for (auto line : w.lines) sets += line.rfind("SET ", 0) == 0;
+
+  std::vector<Reply> replies;
+  end_to_end(w, engine, stats, depth);  // warm-up
+  for (int r = 0; r < reps; r++) {
+    results[kRead].samples.push_back(stage_read(w) / ops);
+    results[kParse].samples.push_back(stage_parse(w) / ops);
+    results[kExecute].samples.push_back(stage_execute(w, engine, replies) /
+                                        ops);
+    results[kFormat].samples.push_back(stage_format(replies) / ops);
+    results[kSend].samples.push_back(stage_send(replies) / ops);
+    uint64_t locks = kv.write_locks();
+    results[kEndToEnd].samples.push_back(
+        end_to_end(w, engine, stats, depth) / ops);
+    e2e_locks += kv.write_locks() - locks;
+  }
+
+  std::ostream& human = json_path == "-" ? std::cerr : std::cout;
+  double e2e = results[kEndToEnd].median();
+  double sum = 0;
+  char buf[128];
+  std::snprintf(buf, sizeof(buf), "ops=%llu pipeline=%zu reps=%d\n",
+                (unsigned long long)ops, depth, reps);
+  human << buf;
+  std::snprintf(buf, sizeof(buf), "%-24s %12s %10s %8s\n", "stage",
+                "median ns/op", "mad", "share");
+  human << buf;
+  for (int s = 0; s < kStages; s++) {
+    const auto& r = results[s];
+    if (s != kEndToEnd) sum += r.median();
+    std::snprintf(buf, sizeof(buf), "%-24s %12.1f %10.1f %7.1f%%\n", names[s],
+                  r.median(), r.mad(), e2e > 0 ? 100.0 * r.median() / e2e : 0);
+    human << buf;
+  }
+  std::snprintf(buf, sizeof(buf), "%-24s %12.1f\n", "sum of stages", sum);
+  human << buf;
+  std::snprintf(buf, sizeof(buf), "%-24s %12.1f\n", "unattributed",
+                e2e - sum);
+  human << buf;
+  if (sets > 0) {
+    std::snprintf(buf, sizeof(buf), "%-24s %12.3f\n", "write locks per set",
+                  double(e2e_locks) / double(sets * reps));
+    human << buf;
+  }
+
+  if (json_path == "-") {
+    write_results_json(std::cout, results);
+  } else if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    if (!out) {
+      std::cerr << "cannot write " << json_path << "\n";
+      return 1;
+    }
+    write_results_json(out, results);
+  }
+  return 0;
+}
@@ -0,0 +1,865 @@
+// Component microbenchmarks: KVStore, key hashing, the LZ4 block codec,
+// LineReader, handle_command, the embedded TcpKv API and the BlockingQueue /
+// ThreadPool handoff.
+//
+//   microbench [--filter SUBSTR] [--reps N] [--min-time-ms MS]
+//              [--max-threads N] [--json PATH|-]
+
+#include <malloc.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_harness.hpp"
+#include "blocking_queue.hpp"
+#include "command.hpp"
+#include "hash_object.hpp"
+#include "hash_table.hpp"
+#include "key_hash.hpp"
+#include "kvstore.hpp"
+#include "list_object.hpp"
+#include "lz_block.hpp"
+#include "protocol.hpp"
+#include "tcpkv.hpp"
+#include "thread_pool.hpp"
+#include "zset_object.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double since(Clock::time_point t0) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+}
+
+std::vector<std::string> make_keys(size_t n) {
+  std::vector<std::string> keys;
+  keys.reserve(n);
+  for (size_t i = 0; i < n; i++) keys.push_back("key:" + std::to_string(i));
+  return keys;
+}
+
+// Random key indices precomputed so the timed loop only touches the store.
+std::vector<uint32_t> make_picks(size_t n, size_t keyspace, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<uint32_t> v(n);
+  for (auto& x : v) x = static_cast<uint32_t>(rng() % keyspace);
+  return v;
+}
+
+// Heap bytes in use after f() minus before: what f left allocated.
+template <class F>
+size_t heap_delta(F&& f) {
+  const size_t before = mallinfo2().uordblks;
+  f();
+  return mallinfo2().uordblks - before;
+}
+
+class Suite {
+ public:
+  explicit Suite(const BenchOptions& opt, std::ostream& out)
+      : opt_(opt), out_(out) {}
+
+  bool wants(const std::string& name) const {
+    return opt_.filter.empty() || name.find(opt_.filter) != std::string::npos;
+  }
+
+  void add(const std::string& name, int threads, const BenchBody& body) {
+    if (!wants(name)) return;
+    results_.push_back(run_bench(name, threads, opt_, body));
+    print_result(out_, results_.back());
+  }
+
+  const std::vector<BenchResult>& results() const { return results_; }
+
+ private:
+  BenchOptions opt_;
+  std::ostream& out_;
+  std::vector<BenchResult> results_;
+};
+
+void bench_kvstore(Suite& s, const std::vector<int>& thread_counts) {
+  const size_t keyspace = 100000;
+  const std::vector<std::string> keys = make_keys(keyspace);
+  const std::string value(16, 'v');
+
+  KVStore kv;
+  for (auto& k : keys) kv.set(k, value);
+
+  for (int t : thread_counts) {
+    std::vector<std::vector<uint32_t>> picks;
+    for (int i = 0; i < t; i++)
+      picks.push_back(make_picks(1 << 16, keyspace, i));
+
+    s.add("kvstore/get", t, [&](uint64_t iters) {
+      return run_threads(t, iters, [&](int id, uint64_t n) {
+        const auto& p = picks[id];
+        for (uint64_t i = 0; i < n; i++)
+          do_not_optimize(kv.get(keys[p[i & 0xffff]]));
+      });
+    });
+
+    // Hash computed once up front, as the command layer does per request.
+    std::vector<HashedKey> hashed(keys.begin(), keys.end());
+    s.add("kvstore/get_prehashed", t, [&](uint64_t iters) {
+      return run_threads(t, iters, [&](int id, uint64_t n) {
+        const auto& p = picks[id];
+        for (uint64_t i = 0; i < n; i++)
+          do_not_optimize(kv.get_shared(hashed[p[i & 0xffff]]));
+      });
+    });
+
+    s.add("kvstore/set", t, [&](uint64_t iters) {
+      return run_threads(t, iters, [&](int id, uint64_t n) {
+        const auto& p = picks[id];
+        for (uint64_t i = 0; i < n; i++) kv.set(keys[p[i & 0xffff]], value);
+      });
+    });
+
+    // Pipelined writes as execute_batch applies them: 64 per apply() call,
+    // one lock per shard touched. Time is per write.
+    s.add("kvstore/set_batch64", t, [&](uint64_t iters) {
+      return run_threads(t, iters, [&](int id, uint64_t n) {
+        const auto& p = picks[id];
+        std::vector<KVWrite> batch;
+        std::vector<char> found;
+        for (uint64_t i = 0; i < n;) {
+          batch.clear();
+          for (int j = 0; j < 64 && i < n; j++, i++)
+            batch.push_back(
+                {hashed[p[i & 0xffff]], StoredValue::of_inline(value)});
+          kv.apply(batch, found);
+        }
+      });
+    });
+
+    // Each sample deletes keys inserted (untimed) just before it.
+    s.add("kvstore/del", t, [&](uint64_t iters) {
+      KVStore fresh;
+      uint64_t per = std::max<uint64_t>(1, iters / t);
+      std::vector<std::string> dkeys = make_keys(per * t);
+      for (auto& k : dkeys) fresh.set(k, value);
+      return run_threads(t, iters, [&](int id, uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+          do_not_optimize(fresh.del(dkeys[id * per + i]));
+      });
+    });
+  }
+}
+
+// A table far larger than the caches, so each lookup misses to DRAM:
+// one get_shared per key against get_many's staged, prefetched batches.
+void bench_kvstore_dram(Suite& s) {
+  // Filling the table takes a while; skip it when nothing here runs.
+  if (!s.wants("kvstore_dram/get_prehashed") &&
+      !s.wants("kvstore_dram/get_many16") &&
+      !s.wants("kvstore_dram/get_many64"))
+    return;
+  const size_t keyspace = size_t(1) << 21;
+  const std::vector<std::string> keys = make_keys(keyspace);
+  KVStore kv;
+  for (auto& k : keys) kv.set(k, std::string(16, 'v'));
+  std::vector<HashedKey> hashed(keys.begin(), keys.end());
+  const std::vector<uint32_t> picks = make_picks(1 << 16, keyspace, 0);
+
+  s.add("kvstore_dram/get_prehashed", 1, [&](uint64_t iters) {
+    return run_threads(1, iters, [&](int, uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+        do_not_optimize(kv.get_shared(hashed[picks[i & 0xffff]]));
+    });
+  });
+
+  for (size_t batch : {16, 64}) {
+    s.add("kvstore_dram/get_many" + std::to_string(batch), 1,
+          [&](uint64_t iters) {
+            return run_threads(1, iters, [&](int, uint64_t n) {
+              std::vector<HashedKey> ks;
+              std::vector<std::shared_ptr<const std::string>> out(batch);
+              for (uint64_t i = 0; i < n;) {
+                ks.clear();
+                for (size_t j = 0; j < batch && i < n; j++, i++)
+                  ks.push_back(hashed[picks[i & 0xffff]]);
+                kv.get_many(ks.data(), ks.size(), out.data());
+                do_not_optimize(out);
+              }
+            });
+          });
+  }
+}
+
+// Cost of keeping the ordered index: inserting and deleting a new key with
+// and without it, and RANGE-sized ordered scans merged across the shards.
+void bench_ordered_index(Suite& s) {
+  const size_t keyspace = 100000;
+  const std::vector<std::string> keys = make_keys(keyspace);
+  const std::string value(16, 'v');
+  const std::vector<uint32_t> picks = make_picks(1 << 16, keyspace, 0);
+  std::vector<std::string> fresh;
+  for (size_t i = 0; i < 4096; i++) fresh.push_back("new:" + std::to_string(i));
+
+  KVStore plain, kv;
+  for (auto& k : keys) {
+    plain.set(k, value);
+    kv.set(k, value);
+  }
+  kv.enable_ordered_index();
+
+  for (KVStore* store : {&plain, &kv}) {
+    s.add(store == &kv ? "index/insert_erase" : "index/insert_erase_noindex",
+          1, [&, store](uint64_t iters) {
+            return run_threads(1, iters, [&](int, uint64_t n) {
+              for (uint64_t i = 0; i < n; i++) {
+                const std::string& k = fresh[i & 4095];
+                store->set(k, value);
+                store->del(k);
+              }
+            });
+          });
+  }
+
+  for (size_t limit : {10, 100}) {
+    s.add("index/range" + std::to_string(limit), 1, [&](uint64_t iters) {
+      return run_threads(1, iters, [&](int, uint64_t n) {
+        std::vector<std::string> out;
+        for (uint64_t i = 0; i < n; i++) {
+          out.clear();
+          kv.range_keys(keys[picks[i & 0xffff]], {}, limit, out);
+          do_not_optimize(out);
+        }
+      });
+    });
+  }
+}
+
+// HashTable::scan, one bucket per step. kv_tests scan_growth checks that
+// a walk across table growth visits every key exactly once.
+void bench_scan(Suite& s) {
+  if (!s.wants("scan/hash_table")) return;
+  auto t = std::make_shared<HashTable<uint32_t>>();
+  for (auto& k : make_keys(100000)) t->try_emplace(k, key_hash(k));
+  s.add("scan/hash_table", 1, [t](uint64_t iters) {
+    uint64_t cursor = 0, acc = 0;
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < iters; i++)
+      cursor = t->scan(cursor, [&](const std::string&, uint32_t v) {
+        acc += v;
+      });
+    do_not_optimize(acc);
+    return since(t0);
+  });
+}
+
+// Multi-tenant keys ("tenant:T:user:N") that share long prefixes, in both
+// engines: point lookups, sets, and heap bytes per key (values included,
+// the same for both).
+void bench_engines(Suite& s, std::ostream& out) {
+  const char* names[] = {"engine/hash/", "engine/art/"};
+  bool any = false;
+  for (const char* n : names)
+    for (const char* op : {"get", "set", "memory"})
+      any = any || s.wants(std::string(n) + op);
+  if (!any) return;
+
+  const size_t keyspace = 200000;
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < keyspace; i++)
+    keys.push_back("tenant:" + std::to_string(1000 + i % 50) + ":user:" +
+                   std::to_string(1000000 + i));
+  const std::vector<uint32_t> picks = make_picks(1 << 16, keyspace, 0);
+  const std::string value(16, 'v');
+
+  for (KVEngine e : {KVEngine::kHash, KVEngine::kArt}) {
+    const std::string prefix = names[e == KVEngine::kArt];
+    std::unique_ptr<KVStore> kv;
+    const size_t bytes = heap_delta([&] {
+      kv = std::make_unique<KVStore>();
+      kv->set_engine(e);
+      for (auto& k : keys) kv->set(k, value);
+    });
+    if (s.wants(prefix + "memory"))
+      out << prefix << "memory: " << bytes / keyspace << " bytes/key ("
+          << keyspace << " keys, " << keys[0].size() << "-byte keys)\n";
+
+    std::vector<HashedKey> hashed(keys.begin(), keys.end());
+    s.add(prefix + "get", 1, [&](uint64_t iters) {
+      return run_threads(1, iters, [&](int, uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+          do_not_optimize(kv->get_shared(hashed[picks[i & 0xffff]]));
+      });
+    });
+    s.add(prefix + "set", 1, [&](uint64_t iters) {
+      return run_threads(1, iters, [&](int, uint64_t n) {
+        for (uint64_t i = 0; i < n; i++)
+          kv->set(keys[picks[i & 0xffff]], value);
+      });
+    });
+  }
+}
+
+// A counter-heavy keyspace: heap bytes per key with small decimal values,
+// and the cost of INCR on them.
+void bench_counters(Suite& s, std::ostream& out) {
+  if (!s.wants("counters/memory") && !s.wants("counters/incr")) return;
+  const size_t keyspace = 200000;
+  std::vector<std::string> keys;
+  for (size_t i = 0; i < keyspace; i++)
+    keys.push_back("counter:" + std::to_string(i));
+
+  std::unique_ptr<KVStore> kv;
+  const size_t bytes = heap_delta([&] {
+    kv = std::make_unique<KVStore>();
+    for (size_t i = 0; i < keyspace; i++)
+      kv->set(keys[i], std::to_string(i * 37 % 100000));
+  });
+  if (s.wants("counters/memory"))
+    out << "counters/memory: " << bytes / keyspace << " bytes/key ("
+        << keyspace << " keys, values 0-99999)\n";
+
+  const std::vector<uint32_t> picks = make_picks(1 << 16, keyspace, 0);
+  std::vector<HashedKey> hashed(keys.begin(), keys.end());
+  s.add("counters/incr", 1, [&](uint64_t iters) {
+    auto t0 = Clock::now();
+    int64_t r;
+    for (uint64_t i = 0; i < iters; i++)
+      do_not_optimize(kv->incr(hashed[picks[i & 0xffff]], 1, r));
+    return since(t0);
+  });
+}
+
+// User profiles of 30 short fields, stored as 30 keys or as one hash:
+// heap bytes per field, and HGET against GET.
+void bench_hashes(Suite& s, std::ostream& out) {
+  if (!s.wants("profile/memory") && !s.wants("profile/hget") &&
+      !s.wants("profile/get_key"))
+    return;
+  const size_t profiles = 10000, fields = 30;
+  std::vector<std::string> names;
+  for (size_t f = 0; f < fields; f++)
+    names.push_back("attr" + std::to_string(f));
+  auto value = [](size_t p, size_t f) {
+    return "val-" + std::to_string(p * 31 + f) + "-abcdefghijklm";
+  };
+
+  std::unique_ptr<KVStore> flat, hashed;
+  const size_t flat_bytes = heap_delta([&] {
+    flat = std::make_unique<KVStore>();
+    for (size_t p = 0; p < profiles; p++)
+      for (size_t f = 0; f < fields; f++)
+        flat->set("user:" + std::to_string(p) + ":" + names[f], value(p, f));
+  });
+  const size_t hash_bytes = heap_delta([&] {
+    hashed = std::make_unique<KVStore>();
+    for (size_t p = 0; p < profiles; p++)
+      hashed->modify(HashedKey("user:" + std::to_string(p)),
+                     [&](StoredValue& v) {
+                       auto h = std::make_shared<HashObject>();
+                       for (size_t f = 0; f < fields; f++)
+                         h->set(names[f], value(p, f));
+                       v = StoredValue::of_object(h, StoredValue::Enc::kHash);
+                       return 0;
+                     });
+  });
+  if (s.wants("profile/memory"))
+    out << "profile/memory: " << flat_bytes / (profiles * fields)
+        << " bytes/field as keys, " << hash_bytes / (profiles * fields)
+        << " as hashes (" << profiles << " profiles of " << fields
+        << " fields, " << value(0, 0).size() << "-byte values)\n";
+
+  const std::vector<uint32_t> picks =
+      make_picks(1 << 16, profiles * fields, 0);
+  std::vector<std::string> profile_keys, field_keys;
+  for (size_t p = 0; p < profiles; p++)
+    profile_keys.push_back("user:" + std::to_string(p));
+  for (size_t i = 0; i < profiles * fields; i++)
+    field_keys.push_back(profile_keys[i / fields] + ":" + names[i % fields]);
+  s.add("profile/hget", 1, [&](uint64_t iters) {
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < iters; i++) {
+      const uint32_t k = picks[i & 0xffff];
+      hashed->view(HashedKey(profile_keys[k / fields]),
+                   [&](const StoredValue* v) {
+                     std::string_view val;
+                     v->object<HashObject>()->get(names[k % fields], val);
+                     do_not_optimize(val.size());
+                     return 0;
+                   });
+    }
+    return since(t0);
+  });
+  s.add("profile/get_key", 1, [&](uint64_t iters) {
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < iters; i++)
+      do_not_optimize(flat->get(field_keys[picks[i & 0xffff]]));
+    return since(t0);
+  });
+}
+
+// Leaderboard-style sorted sets of 1k and 100k members: score updates
+// (which move the member), rank lookups and top-10 reads.
+void bench_zset(Suite& s) {
+  for (size_t n : {size_t(1000), size_t(100000)}) {
+    const std::string suffix = "/" + std::to_string(n);
+    if (!s.wants("zset/zadd" + suffix) && !s.wants("zset/zrank" + suffix) &&
+        !s.wants("zset/top10" + suffix))
+      continue;
+    std::vector<std::string> members;
+    for (size_t i = 0; i < n; i++)
+      members.push_back("player:" + std::to_string(i));
+    auto z = std::make_unique<ZSetObject>();
+    std::mt19937_64 rng(9);
+    for (auto& m : members) z->add(m, static_cast<double>(rng() % 1000000));
+    const std::vector<uint32_t> picks = make_picks(1 << 16, n, 0);
+
+    s.add("zset/zadd" + suffix, 1, [&](uint64_t iters) {
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < iters; i++)
+        z->add(members[picks[i & 0xffff]],
+               static_cast<double>(rng() % 1000000));
+      return since(t0);
+    });
+    s.add("zset/zrank" + suffix, 1, [&](uint64_t iters) {
+      auto t0 = Clock::now();
+      size_t r = 0;
+      for (uint64_t i = 0; i < iters; i++) {
+        z->rank(members[picks[i & 0xffff]], r);
+        do_not_optimize(r);
+      }
+      return since(t0);
+    });
+    s.add("zset/top10" + suffix, 1, [&](uint64_t iters) {
+      auto t0 = Clock::now();
+      std::vector<ZSetObject::Entry> out;
+      for (uint64_t i = 0; i < iters; i++) {
+        out.clear();
+        z->range(n - 10, n - 1, out);
+        do_not_optimize(out.data());
+      }
+      return since(t0);
+    });
+  }
+}
+
+// Lists used as queues: heap bytes per element against a node per element,
+// a push and pop at opposite ends, and reading the first 10 elements.
+void bench_list(Suite& s, std::ostream& out) {
+  const size_t n = 100000;
+  if (s.wants("list/memory")) {
+    const std::string v = "job-0123456789";  // 14 bytes, heap-allocated
+    std::list<std::string> nodes;
+    ListObject l;
+    const size_t node_bytes = heap_delta([&] {
+      for (size_t i = 0; i < n; i++) nodes.push_back(v + "-long-enough");
+    });
+    const size_t list_bytes = heap_delta([&] {
+      for (size_t i = 0; i < n; i++) l.push_back(v + "-long-enough");
+    });
+    out << "list/memory: " << list_bytes / n << " bytes/element chunked, "
+        << node_bytes / n << " as std::list<std::string> (" << n << " "
+        << v.size() + 12 << "-byte elements)\n";
+  }
+
+  ListObject q;
+  for (size_t i = 0; i < 1000; i++) q.push_back("job:" + std::to_string(i));
+  const std::string job = "job:payload-0001";
+  s.add("list/rpush_lpop", 1, [&](uint64_t iters) {
+    auto t0 = Clock::now();
+    std::string v;
+    for (uint64_t i = 0; i < iters; i++) {
+      q.push_back(job);
+      q.pop_front(v);
+      do_not_optimize(v.data());
+    }
+    return since(t0);
+  });
+  s.add("list/lpush_rpop", 1, [&](uint64_t iters) {
+    auto t0 = Clock::now();
+    std::string v;
+    for (uint64_t i = 0; i < iters; i++) {
+      q.push_front(job);
+      q.pop_back(v);
+      do_not_optimize(v.data());
+    }
+    return since(t0);
+  });
+  s.add("list/lrange10", 1, [&](uint64_t iters) {
+    auto t0 = Clock::now();
+    std::vector<std::string> r;
+    for (uint64_t i = 0; i < iters; i++) {
+      r.clear();
+      q.range(0, 9, r);
+      do_not_optimize(r.data());
+    }
+    return since(t0);
+  });
+}
+
+// JSON-like records of the kind the value compression targets: ~170 bytes
+// each, similar in shape, different in content.
+std::string json_record(std::mt19937_64& rng, int id) {
+  return "{\"id\":" + std::to_string(id) + ",\"name\":\"user" +
+         std::to_string(rng() % 100000) + "\",\"email\":\"u" +
+         std::to_string(rng() % 1000) +
+         "@example.com\",\"roles\":[\"reader\",\"writer\"],"
+         "\"settings\":{\"theme\":\"dark\",\"lang\":\"en-US\","
+         "\"notifications\":true},\"score\":" +
+         std::to_string(rng() % 1000) + "}";
+}
+
+// Compress and decompress times per value, and the ratio, for single small
+// records with and without a trained dictionary and for 4 KB documents.
+void bench_codec(Suite& s, std::ostream& out) {
+  std::mt19937_64 rng(5);
+  std::vector<std::string> samples;
+  for (int i = 0; i < 256; i++) samples.push_back(json_record(rng, i));
+  auto dict = std::make_shared<LzDict>(lz_train_dict(samples, 16 << 10));
+
+  struct Case {
+    std::string name;
+    std::vector<std::string> values;
+    const LzDict* dict;
+  };
+  std::vector<Case> cases(3);
+  cases[0] = {"small", {}, nullptr};
+  cases[1] = {"small_dict", {}, dict.get()};
+  cases[2] = {"doc4k", {}, nullptr};
+  for (int i = 0; i < 64; i++) {
+    std::string r = json_record(rng, 1000 + i);
+    cases[0].values.push_back(r);
+    cases[1].values.push_back(r);
+    std::string doc = "[";
+    while (doc.size() < 4096) doc += json_record(rng, i) + ",";
+    doc.back() = ']';
+    cases[2].values.push_back(doc);
+  }
+
+  for (auto& c : cases) {
+    const std::string prefix = "codec/" + c.name;
+    if (!s.wants(prefix + "/compress") && !s.wants(prefix + "/decompress"))
+      continue;
+    std::vector<std::string> blocks;
+    size_t raw = 0, packed = 0;
+    for (auto& v : c.values) {
+      std::string b(lz_bound(v.size()), '\0');
+      b.resize(lz_compress(v.data(), v.size(), b.data(), c.dict));
+      raw += v.size();
+      packed += b.size();
+      blocks.push_back(std::move(b));
+    }
+    out << prefix << ": ratio " << double(raw) / packed << " ("
+        << raw / c.values.size() << "-byte values)\n";
+
+    std::string buf(lz_bound(raw), '\0');
+    s.add(prefix + "/compress", 1, [&](uint64_t iters) {
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < iters; i++) {
+        const std::string& v = c.values[i & 63];
+        do_not_optimize(lz_compress(v.data(), v.size(), buf.data(), c.dict));
+      }
+      return since(t0);
+    });
+    s.add(prefix + "/decompress", 1, [&](uint64_t iters) {
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < iters; i++) {
+        const std::string& b = blocks[i & 63];
+        do_not_optimize(lz_decompress(b.data(), b.size(), buf.data(),
+                                      c.values[i & 63].size(), c.dict));
+      }
+      return since(t0);
+    });
+  }
+}
+
+// Key shapes seen in practice: bench_client/loopback ("key:N"), YCSB
+// ("user" + 19 digits), a 64-byte key and a 1 KB key for the long path.
+// On the 1 KB set the AVX2 loop is checked against its scalar version and
+// compared with plain wyhash, which is what CPUs without AVX2 use.
+std::vector<std::pair<std::string, std::vector<std::string>>> key_sets() {
+  std::mt19937_64 rng(11);
+  std::vector<std::pair<std::string, std::vector<std::string>>> sets(4);
+  sets[0].first = "short9";
+  sets[1].first = "ycsb23";
+  sets[2].first = "mid64";
+  sets[3].first = "long1k";
+  for (int i = 0; i < 4096; i++) {
+    sets[0].second.push_back("key:" + std::to_string(rng() % 100000));
+    sets[1].second.push_back("user" + std::to_string(rng() | (1ULL << 63)));
+    sets[2].second.push_back(std::string(56, 'p') + std::to_string(rng()));
+    sets[2].second.back().resize(64, 'x');
+    sets[3].second.push_back(std::string(1000, 'q') + std::to_string(rng()));
+    sets[3].second.back().resize(1024, 'x');
+  }
+  return sets;
+}
+
+void bench_hash(Suite& s) {
+  for (auto& set : key_sets()) {
+    auto keys = std::make_shared<std::vector<std::string>>(set.second);
+    auto run = [&](const std::string& name, uint64_t (*fn)(std::string_view)) {
+      s.add("hash/" + name + "/" + set.first, 1, [keys, fn](uint64_t iters) {
+        uint64_t acc = 0;
+        auto t0 = Clock::now();
+        for (uint64_t i = 0; i < iters; i++) acc += fn((*keys)[i & 4095]);
+        do_not_optimize(acc);
+        return since(t0);
+      });
+    };
+    run("std_hash",
+        [](std::string_view k) -> uint64_t {
+          return std::hash<std::string_view>{}(k);
+        });
+    run("key_hash", [](std::string_view k) { return key_hash(k); });
+    if (set.first == "long1k" && key_hash_uses_avx2()) {
+      for (auto& k : *keys) {
+        if (key_hash_long(k.data(), k.size()) !=
+            key_hash_long_scalar(k.data(), k.size())) {
+          std::cerr << "key_hash: AVX2 and scalar results differ\n";
+          std::exit(1);
+        }
+      }
+      run("key_hash_scalar", [](std::string_view k) {
+        return key_hash_long_scalar(k.data(), k.size());
+      });
+      run("wyhash", [](std::string_view k) {
+        return wyhash(k.data(), k.size(), key_hash_seed());
+      });
+    }
+  }
+}
+
+// Hash flooding: keys chosen offline so std::hash puts them all in one
+// bucket of a 4096-bucket table. Each sample inserts and then finds every
+// key; with the unseeded hash that is quadratic, with the seeded one it is
+// not, because the attacker can't know the process's seed.
+void bench_hash_flood(Suite& s) {
+  auto keys = std::make_shared<std::vector<std::string>>();
+  std::hash<std::string_view> h;
+  for (uint64_t i = 0; keys->size() < 4000; i++) {
+    std::string k = "atk:" + std::to_string(i);
+    if ((h(k) & 4095) == 0) keys->push_back(std::move(k));
+  }
+  auto run = [&](const std::string& name, uint64_t (*fn)(std::string_view)) {
+    s.add("hash_flood/" + name, 1, [keys, fn](uint64_t iters) {
+      double ns = 0;
+      for (uint64_t done = 0; done < iters; done += keys->size()) {
+        HashTable<int> t;
+        auto t0 = Clock::now();
+        for (auto& k : *keys) *t.try_emplace(k, fn(k)).first = 1;
+        for (auto& k : *keys) do_not_optimize(t.find(k, fn(k)));
+        ns += since(t0);
+      }
+      return ns * iters / (((iters + keys->size() - 1) / keys->size()) *
+                           keys->size());
+    });
+  };
+  run("std_hash", [](std::string_view k) -> uint64_t {
+    return std::hash<std::string_view>{}(k);
+  });
+  run("key_hash", [](std::string_view k) { return key_hash(k); });
+}
+
+// Feeds `iters` pipelined lines through a socketpair; the writer runs on its
+// own thread so the reader measures read_line() including recv().
+double pipelined_read(const std::string& line, uint64_t iters) {
+  int sv[2];
+  if (::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 0;
+
+  std::string chunk;
+  for (int i = 0; i < 64; i++) chunk += line;
+  std::thread writer([&]() {
+    uint64_t left = iters;
+    while (left > 0) {
+      uint64_t n = std::min<uint64_t>(64, left);
+      if (!send_all(sv[1], chunk.data(), n * line.size())) break;
+      left -= n;
+    }
+  });
+
+  LineReader lr(8192);
+  auto t0 = Clock::now();
+  for (uint64_t i = 0; i < iters; i++) {
+    auto l = lr.read_line(sv[0]);
+    if (!l) break;
+    do_not_optimize(*l);
+  }
+  double ns = since(t0);
+  writer.join();
+  ::close(sv[0]);
+  ::close(sv[1]);
+  return ns;
+}
+
+void bench_line_reader(Suite& s) {
+  s.add("linereader/pipelined_get", 1, [](uint64_t iters) {
+    return pipelined_read("GET key:12345\n", iters);
+  });
+  s.add("linereader/pipelined_set_512b", 1, [](uint64_t iters) {
+    return pipelined_read("SET key:12345 " + std::string(512, 'v') + "\r\n",
+                          iters);
+  });
+}
+
+void bench_handle_command(Suite& s) {
+  handle_command("SET key:42 " + std::string(16, 'v'));
+
+  auto cmd = [&](const std::string& name, const std::string& line) {
+    s.add("handle_command/" + name, 1, [line](uint64_t iters) {
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < iters; i++)
+        do_not_optimize(handle_command(line));
+      return since(t0);
+    });
+  };
+  cmd("ping", "PING");
+  cmd("get_hit", "GET key:42");
+  cmd("get_miss", "GET missing:42");
+  cmd("set", "SET key:42 " + std::string(16, 'v'));
+  cmd("unknown", "FROB x");
+}
+
+// The in-process API: what a service embedding libtcpkv pays per call.
+void bench_embedded(Suite& s) {
+  const size_t keyspace = 100000;
+  const std::vector<std::string> keys = make_keys(keyspace);
+  const std::vector<uint32_t> picks = make_picks(1 << 16, keyspace, 7);
+  auto kv = std::make_shared<TcpKv>();
+  for (auto& k : keys) kv->set(k, std::string(16, 'v'));
+
+  s.add("embedded/get_handle", 1, [=](uint64_t iters) {
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < iters; i++)
+      do_not_optimize(kv->get(keys[picks[i & 0xffff]]));
+    return since(t0);
+  });
+  s.add("embedded/set", 1, [=](uint64_t iters) {
+    const std::string_view value("0123456789abcdef");
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < iters; i++)
+      kv->set(keys[picks[i & 0xffff]], value);
+    return since(t0);
+  });
+  // The same picks as get_handle, so the two differ only by the protocol.
+  std::vector<std::string> gets;
+  for (uint32_t p : picks) gets.push_back("GET " + keys[p]);
+  s.add("embedded/execute_get", 1, [=](uint64_t iters) {
+    std::string out;
+    auto t0 = Clock::now();
+    for (uint64_t i = 0; i < iters; i++) {
+      out.clear();
+      kv->execute(gets[i & 0xffff], out);
+      do_not_optimize(out);
+    }
+    return since(t0);
+  });
+}
+
+void bench_handoff(Suite& s, const std::vector<int>& thread_counts) {
+  // One producer, one consumer, items pass through the bounded queue.
+  s.add("blocking_queue/spsc_handoff", 2, [](uint64_t iters) {
+    BlockingQueue<uint64_t> q(1024);
+    auto t0 = Clock::now();
+    std::thread consumer([&]() {
+      for (uint64_t i = 0; i < iters; i++) do_not_optimize(q.pop());
+    });
+    for (uint64_t i = 0; i < iters; i++) q.push(i);
+    consumer.join();
+    return since(t0);
+  });
+
+  // Submit-to-completion throughput of empty jobs.
+  for (int t : thread_counts) {
+    s.add("thread_pool/submit_run", t, [t](uint64_t iters) {
+      ThreadPool pool(t, 4096);
+      pool.start();
+      std::atomic<uint64_t> done{0};
+      auto t0 = Clock::now();
+      for (uint64_t i = 0; i < iters; i++)
+        pool.submit(
+            [&done]() { done.fetch_add(1, std::memory_order_relaxed); });
+      while (done.load() < iters) std::this_thread::yield();
+      double ns = since(t0);
+      pool.stop();
+      return ns;
+    });
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  BenchOptions opt;
+  std::string json_path;
+  int max_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto need = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << a << "\n";
+        std::exit(1);
+      }
+      return std::string(argv[++i]);
+    };
+    if (a == "--filter")
+      opt.filter = need();
+    else if (a == "--reps")
+      opt.reps = std::max(1, std::stoi(need()));
+    else if (a == "--min-time-ms")
+      opt.min_time_ms = std::stod(need());
+    else if (a == "--max-threads")
+      max_threads = std::max(1, std::stoi(need()));
+    else if (a == "--json")
+      json_path = need();
+    else if (a == "--help") {
+      std::cout << "Usage: microbench [--filter SUBSTR] [--reps N] "
+                   "[--min-time-ms MS] [--max-threads N] [--json PATH|-]\n";
+      return 0;
+    }
+  }
+
+  std::vector<int> thread_counts;
+  for (int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  std::ostream& human = json_path == "-" ? std::cerr : std::cout;
+  print_result_header(human);
+
+  Suite s(opt, human);
+  bench_kvstore(s, thread_counts);
+  bench_kvstore_dram(s);
+  bench_ordered_index(s);
+  bench_scan(s);
+  bench_engines(s, human);
+  bench_counters(s, human);
+  bench_hashes(s, human);
+  bench_zset(s);
+  bench_list(s, human);
+  bench_codec(s, human);
+  bench_hash(s);
+  bench_hash_flood(s);
+  bench_line_reader(s);
+  bench_handle_command(s);
+  bench_embedded(s);
+  bench_handoff(s, thread_counts);
+
+  if (json_path == "-") {
+    write_results_json(std::cout, s.results());
+  } else if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    if (!out) {
+      std::cerr << "cannot write " << json_path << "\n";
+      return 1;
+    }
+    write_results_json(out, s.results());
+  }
+  return 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Minimal JSON reader/writer for the benchmark tools' own result files.
+// Supports objects, arrays, strings (with simple escapes), numbers, true,
+// false and null. Not a general-purpose parser.
+
+class JsonValue {
+ public:
+  enum class Type { kNull, kBool, kNumber, kString, kArray, kObject };
+
+  Type type = Type::kNull;
+  bool b = false;
+  double num = 0;
+  std::string str;
+  std::vector<JsonValue> arr;
+  std::vector<std::pair<std::string, JsonValue>> obj;
+
+  bool is_object() const { return type == Type::kObject; }
+  bool is_array() const { return type == Type::kArray; }
+  bool is_number() const { return type == Type::kNumber; }
+
+  // Returns nullptr when missing or not an object.
+  const JsonValue* get(const std::string& key) const {
+    if (type != Type::kObject) return nullptr;
+    for (auto& kv : obj)
+      if (kv.first == key) return &kv.second;
+    return nullptr;
+  }
+
+  double number_or(const std::string& key, double def) const {
+    const JsonValue* v = get(key);
+    return v && v->is_number() ? v->num : def;
+  }
+
+  static JsonValue number(double v) {
+    JsonValue j;
+    j.type = Type::kNumber;
+    j.num = v;
+    return j;
+  }
+  static JsonValue string(std::string s) {
+    JsonValue j;
+    j.type = Type::kString;
+    j.str = std::move(s);
+    return j;
+  }
+  static JsonValue array() {
+    JsonValue j;
+    j.type = Type::kArray;
+    return j;
+  }
+  static JsonValue object() {
+    JsonValue j;
+    j.type = Type::kObject;
+    return j;
+  }
+
+  JsonValue& set(const std::string& key, JsonValue v) {
+    for (auto& kv : obj) {
+      if (kv.first == key) {
+        kv.second = std::move(v);
+        return kv.second;
+      }
+    }
+    obj.emplace_back(key, std::move(v));
+    return obj.back().second;
+  }
+
+  void write(std::ostream& out, int indent = 0) const {
+    std::string pad(indent + 2, ' ');
+    switch (type) {
+      case Type::kNull:
+        out << "null";
+        break;
+      case Type::kBool:
+        out << (b ? "true" : "false");
+        break;
+      case Type::kNumber: {
+        std::ostringstream s;
+        s.precision(10);
+        s << num;
+        out << s.str();
+        break;
+      }
+      case Type::kString:
+        write_string(out, str);
+        break;
+      case Type::kArray:
+        out << "[";
+        for (size_t i = 0; i < arr.size(); i++) {
+          if (i) out << ", ";
+          arr[i].write(out, indent + 2);
+        }
+        out << "]";
+        break;
+      case Type::kObject:
+        out << "{";
+        for (size_t i = 0; i < obj.size(); i++) {
+          out << (i ? ",\n" : "\n") << pad;
+          write_string(out, obj[i].first);
+          out << ": ";
+          obj[i].second.write(out, indent + 2);
+        }
+        if (!obj.empty()) out << "\n" << std::string(indent, ' ');
+        out << "}";
+        break;
+    }
+  }
+
+ private:
+  static void write_string(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+      if (c == '"' || c == '\\')
+        out << '\\' << c;
+      else if (c == '\n')
+        out << "\\n";
+      else
+        out << c;
+    }
+    out << '"';
+  }
+};
+
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string& text) : s_(text) {}
+
+  bool parse(JsonValue& out) {
+    bool ok = value(out);
+    ws();
+    return ok && i_ == s_.size();
+  }
+
+ private:
+  void ws() {
+    while (i_ < s_.size() && (s_[i_] == ' ' || s_[i_] == '\n' ||
+                              s_[i_] == '\t' || s_[i_] == '\r'))
+      i_++;
+  }
+
+  bool lit(const char* w) {
+    size_t n = std::char_traits<char>::length(w);
+    if (s_.compare(i_, n, w) != 0) return false;
+    i_ += n;
+    return true;
+  }
+
+  bool string(std::string& out) {
+    if (s_[i_] != '"') return false;
+    i_++;
+    while (i_ < s_.size() && s_[i_] != '"') {
+      char c = s_[i_++];
+      if (c == '\\' && i_ < s_.size()) {
+        char e = s_[i_++];
+        out += e == 'n' ? '\n' : e == 't' ? '\t' : e;
+      } else {
+        out += c;
+      }
+    }
+    if (i_ >= s_.size()) return false;
+    i_++;
+    return true;
+  }
+
+  bool value(JsonValue& v) {
+    ws();
+    if (i_ >= s_.size()) return false;
+    char c = s_[i_];
+    if (c == '{') {
+      v.type = JsonValue::Type::kObject;
+      i_++;
+      ws();
+      if (i_ < s_.size() && s_[i_] == '}') return ++i_, true;
+      while (true) {
+        ws();
+        std::string key;
+        if (i_ >= s_.size() || !string(key)) return false;
+        ws();
+        if (i_ >= s_.size() || s_[i_++] != ':') return false;
+        JsonValue child;
+        if (!value(child)) return false;
+        v.obj.emplace_back(std::move(key), std::move(child));
+        ws();
+        if (i_ >= s_.size()) return false;
+        if (s_[i_] == ',') {
+          i_++;
+          continue;
+        }
+        if (s_[i_] == '}') return ++i_, true;
+        return false;
+      }
+    }
+    if (c == '[') {
+      v.type = JsonValue::Type::kArray;
+      i_++;
+      ws();
+      if (i_ < s_.size() && s_[i_] == ']') return ++i_, true;
+      while (true) {
+        JsonValue child;
+        if (!value(child)) return false;
+        v.arr.push_back(std::move(child));
+        ws();
+        if (i_ >= s_.size()) return false;
+        if (s_[i_] == ',') {
+          i_++;
+          continue;
+        }
+        if (s_[i_] == ']') return ++i_, true;
+        return false;
+      }
+    }
+    if (c == '"') {
+      v.type = JsonValue::Type::kString;
+      return string(v.str);
+    }
+    if (lit("true")) {
+      v.type = JsonValue::Type::kBool;
+      v.b = true;
+      return true;
+    }
+    if (lit("false")) {
+      v.type = JsonValue::Type::kBool;
+      return true;
+    }
+    if (lit("null")) return true;
+
+    const char* begin = s_.c_str() + i_;
+    char* end = nullptr;
+    v.num = std::strtod(begin, &end);
+    if (end == begin) return false;
+    v.type = JsonValue::Type::kNumber;
+    i_ += static_cast<size_t>(end - begin);
+    return true;
+  }
+
+  const std::string& s_;
+  size_t i_ = 0;
+};
+
+inline bool read_json_file(const std::string& path, JsonValue& out) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::stringstream ss;
+  ss << in.rdbuf();
+  std::string text = ss.str();
+  return JsonParser(text).parse(out);
+}
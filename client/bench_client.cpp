@@ -1,59 +1,41 @@
-#include <arpa/inet.h>
-#include <netinet/in.h>
-#include <sys/socket.h>
 #include <unistd.h>
 
 #include <atomic>
 #include <chrono>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
-static bool send_all(int fd, const char* data, size_t len) {
-  size_t sent = 0;
-  while (sent < len) {
-    ssize_t n = send(fd, data + sent, len - sent, 0);
-    if (n < 0) {
-      if (errno == EINTR) continue;
-      return false;
-    }
-    if (n == 0) return false;
-    sent += (size_t)n;
-  }
-  return true;
-}
-
-static bool recv_line(int fd, std::string& out) {
-  out.clear();
-  char c;
-  while (true) {
-    ssize_t n = recv(fd, &c, 1, 0);
-    if (n <= 0) return false;
-    if (c == '\n') return true;
-    out.push_back(c);
-    if (out.size() > 8192) return false;
-  }
-}
+#include "client_conn.hpp"
+#include "hdr_histogram.hpp"
+#include "workload.hpp"
 
-static int connect_to(const std::string& host, int port) {
-  int fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (fd < 0) return -1;
+using Clock = std::chrono::steady_clock;
 
-  sockaddr_in addr{};
-  addr.sin_family = AF_INET;
-  addr.sin_port = htons((uint16_t)port);
-  if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
-    close(fd);
-    return -1;
-  }
-
-  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
-    close(fd);
-    return -1;
+// Host-wide TcpExt ListenOverflows + ListenDrops from /proc/net/netstat:
+// connections the kernel dropped because an accept queue was full.
+static bool read_listen_drops(uint64_t& overflows, uint64_t& drops) {
+  std::ifstream in("/proc/net/netstat");
+  std::string header, values;
+  while (std::getline(in, header) && std::getline(in, values)) {
+    if (header.rfind("TcpExt:", 0) != 0) continue;
+    std::istringstream h(header), v(values);
+    std::string name, val;
+    bool found = false;
+    while (h >> name && v >> val) {
+      if (name == "ListenOverflows") overflows = std::stoull(val), found = true;
+      if (name == "ListenDrops") drops = std::stoull(val), found = true;
+    }
+    return found;
   }
-  return fd;
+  return false;
 }
 
 int main(int argc, char** argv) {
@@ -61,6 +43,16 @@ int main(int argc, char** argv) {
   int port = 8080;
   int clients = 50;
   int seconds = 5;
+  double rate = 0;  // total ops/sec; 0 = closed loop
+
+  // Workload shape
+  double mix[3] = {50, 50, 0};  // GET:SET:DEL weights
+  KeySpec keys;
+  std::string value_size = "3";
+  bool preload = false;
+  bool churn = false;
+  uint64_t seed = 1;
+  std::string json_path;
 
   for (int i = 1; i < argc; i++) {
     std::string a = argv[i];
@@ -73,59 +65,378 @@ int main(int argc, char** argv) {
       clients = std::stoi(need());
     else if (a == "--seconds")
       seconds = std::stoi(need());
+    else if (a == "--rate")
+      rate = std::stod(need());
+    else if (a == "--mix") {
+      std::string m = need();
+      if (std::sscanf(m.c_str(), "%lf:%lf:%lf", &mix[0], &mix[1], &mix[2]) !=
+              3 ||
+          mix[0] < 0 || mix[1] < 0 || mix[2] < 0 ||
+          mix[0] + mix[1] + mix[2] <= 0) {
+        std::cerr << "--mix expects GET:SET:DEL weights, e.g. 90:9:1\n";
+        return 1;
+      }
+    } else if (a == "--keyspace")
+      keys.keyspace = std::stoull(need());
+    else if (a == "--key-dist") {
+      auto dist = parse_key_dist(need());
+      if (!dist) {
+        std::cerr << "--key-dist expects uniform, zipfian, hotspot or "
+                     "sequential\n";
+        return 1;
+      }
+      keys.dist = *dist;
+    } else if (a == "--zipf-theta")
+      keys.zipf_theta = std::stod(need());
+    else if (a == "--hot-keys")
+      keys.hot_keys = std::stod(need());
+    else if (a == "--hot-ops")
+      keys.hot_ops = std::stod(need());
+    else if (a == "--value-size")
+      value_size = need();
+    else if (a == "--preload")
+      preload = true;
+    else if (a == "--churn")
+      churn = true;
+    else if (a == "--seed")
+      seed = std::stoull(need());
+    else if (a == "--json")
+      json_path = need();
     else if (a == "--help") {
-      std::cout << "bench_client --host 127.0.0.1 --port 8080 --clients 100 "
-                   "--seconds 10\n";
+      std::cout
+          << "bench_client --host 127.0.0.1 --port 8080 --clients 100 "
+             "--seconds 10 [--rate OPS_PER_SEC]\n"
+          << "  --rate R          open-loop mode: issue R ops/sec in total on "
+             "a fixed\n"
+          << "                    schedule and measure latency from the "
+             "intended send time\n"
+          << "  --churn           every op opens a new connection, reads the "
+             "banner,\n"
+          << "                    sends one command and closes; reports "
+             "connections/sec\n"
+          << "  --mix G:S:D       GET:SET:DEL weights (default 50:50:0)\n"
+          << "  --keyspace N      number of distinct keys (default 100000)\n"
+          << "  --key-dist D      uniform | zipfian | hotspot | sequential\n"
+          << "  --zipf-theta T    zipfian skew, 0 < T < 1 (default 0.99)\n"
+          << "  --hot-keys F      hotspot: fraction of hot keys (default "
+             "0.2)\n"
+          << "  --hot-ops F       hotspot: fraction of ops on hot keys "
+             "(default 0.8)\n"
+          << "  --value-size S    N | MIN-MAX | exp:MEAN bytes (default 3)\n"
+          << "  --preload         SET every key in the keyspace before the "
+             "run\n"
+          << "  --seed N          random seed (default 1)\n"
+          << "  --json PATH       also write results as JSON\n";
       return 0;
     }
   }
 
+  if (keys.dist == KeyDist::kZipfian &&
+      (keys.zipf_theta <= 0 || keys.zipf_theta >= 1)) {
+    std::cerr << "--zipf-theta must be in (0, 1)\n";
+    return 1;
+  }
+
+  // Leave room for "SET <key> " within the server's 8192-byte line limit.
+  const ValueSizer sizer(value_size, 8000);
+  const std::string value_pool =
+      make_value_pool(sizer.max_size() + 4096, seed);
+  const KeyChooser key_proto(keys);
+  const double mix_total = mix[0] + mix[1] + mix[2];
+
   std::atomic<bool> start{false};
   std::atomic<bool> stop{false};
   std::atomic<uint64_t> ops{0};
+  std::atomic<uint64_t> missed{0};
+  std::atomic<int> ready{0};
+  std::atomic<int> connect_failures{0};
+  std::atomic<uint64_t> churn_errors{0};
+  std::atomic<uint64_t> churn_rejected{0};
+  Clock::time_point t0;
+
+  const bool open_loop = rate > 0;
+  // Each connection gets an equal share of the offered load.
+  const auto interval = std::chrono::nanoseconds(
+      open_loop ? static_cast<int64_t>(1e9 * clients / rate) : 0);
+
+  // CONNECT (connect to banner) and CYCLE (connect to command reply) are
+  // recorded instead of per-command latency in churn mode.
+  enum Op { kGet, kSet, kDel, kConnect, kCycle, kOps };
+  const char* op_names[kOps] = {"GET", "SET", "DEL", "CONNECT", "CYCLE"};
+  bool enabled[kOps] = {!churn && mix[0] > 0, !churn && mix[1] > 0,
+                        !churn && mix[2] > 0, churn, churn};
+
+  std::mutex hist_mu;
+  HdrHistogram hist[kOps];
 
   auto worker = [&](int id) {
     int fd = connect_to(host, port);
-    if (fd < 0) return;
+    if (fd < 0) {
+      connect_failures.fetch_add(1);
+      ready.fetch_add(1);
+      return;
+    }
 
     // read banner
+    ReplyReader rr(fd);
     std::string line;
-    recv_line(fd, line);
+    rr.read_line(line);
+
+    std::mt19937_64 rng(seed * 1000003 + id);
+    ValueSizer vs = sizer;
+    auto value = [&]() {
+      size_t len = vs.next(rng);
+      size_t off = std::uniform_int_distribution<size_t>(0, 4095)(rng);
+      return value_pool.substr(off, len);
+    };
 
+    // Pre-load: each thread SETs its slice of the keyspace, pipelined.
+    if (preload) {
+      uint64_t lo = keys.keyspace * id / clients;
+      uint64_t hi = keys.keyspace * (id + 1) / clients;
+      const uint64_t batch = 64;
+      for (uint64_t k = lo; k < hi; k += batch) {
+        std::string buf;
+        uint64_t n = std::min(batch, hi - k);
+        for (uint64_t j = 0; j < n; j++)
+          buf += "SET " + key_name(k + j) + " " + value() + "\n";
+        if (!send_all(fd, buf.data(), buf.size())) break;
+        for (uint64_t j = 0; j < n; j++) rr.read_line(line);
+      }
+    }
+
+    KeyChooser chooser = key_proto;
+    chooser.set_sequential_offset(keys.keyspace * id / clients);
+    std::uniform_real_distribution<double> pick(0.0, mix_total);
+
+    ready.fetch_add(1);
     while (!start.load()) std::this_thread::yield();
 
-    // simple workload: alternating SET/GET on per-thread key
-    std::string key = "k" + std::to_string(id);
-    std::string set_cmd = "SET " + key + " 123\n";
-    std::string get_cmd = "GET " + key + "\n";
+    std::vector<HdrHistogram> local(kOps, HdrHistogram(0));
+    for (int o = 0; o < kOps; o++)
+      if (enabled[o]) local[o] = HdrHistogram();
+    if (churn) {
+      close(fd);
+      fd = -1;
+    }
+    const auto end = t0 + std::chrono::seconds(seconds);
+    // Stagger connections across one interval so arrivals are evenly spread.
+    auto intended = t0 + interval * id / clients;
+    std::string cmd;
 
     while (!stop.load()) {
-      if (!send_all(fd, set_cmd.c_str(), set_cmd.size())) break;
-      if (!recv_line(fd, line)) break;
+      double r = pick(rng);
+      Op op = r < mix[0] ? kGet : (r < mix[0] + mix[1] ? kSet : kDel);
+      std::string key = key_name(chooser.next(rng));
+      if (op == kGet)
+        cmd = "GET " + key + "\n";
+      else if (op == kSet)
+        cmd = "SET " + key + " " + value() + "\n";
+      else
+        cmd = "DEL " + key + "\n";
+
+      Clock::time_point sent_at;
+      if (open_loop) {
+        if (intended >= end) break;
+        // Never skip a scheduled request: if we are behind, send now and let
+        // the wait count against latency (coordinated-omission correction).
+        auto now = Clock::now();
+        if (now < intended) std::this_thread::sleep_until(intended);
+        sent_at = intended;
+        intended += interval;
+      } else {
+        sent_at = Clock::now();
+      }
 
-      if (!send_all(fd, get_cmd.c_str(), get_cmd.size())) break;
-      if (!recv_line(fd, line)) break;
+      auto ns_since = [](Clock::time_point from) {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                 from)
+                .count());
+      };
 
-      ops.fetch_add(2);
+      if (churn) {
+        int cfd = connect_to(host, port);
+        if (cfd < 0) {
+          churn_errors.fetch_add(1);
+          continue;
+        }
+        ReplyReader crr(cfd);
+        bool ok = crr.read_line(line);
+        if (ok && line.rfind("ERR", 0) == 0) {
+          churn_rejected.fetch_add(1);  // over the server's connection cap
+          close(cfd);
+          continue;
+        }
+        if (ok) {
+          local[kConnect].record(ns_since(sent_at));
+          ok = send_all(cfd, cmd.c_str(), cmd.size()) && crr.read_line(line);
+        }
+        close(cfd);
+        if (!ok) {
+          churn_errors.fetch_add(1);
+          continue;
+        }
+        local[kCycle].record(ns_since(sent_at));
+        ops.fetch_add(1);
+        continue;
+      }
+
+      if (!send_all(fd, cmd.c_str(), cmd.size())) break;
+      if (!rr.read_line(line)) break;
+
+      local[op].record(ns_since(sent_at));
+      ops.fetch_add(1);
+    }
+
+    // Scheduled sends that never happened (server fell behind, or error).
+    if (open_loop) {
+      while (intended < end) {
+        missed.fetch_add(1);
+        intended += interval;
+      }
     }
 
-    close(fd);
+    if (fd >= 0) close(fd);
+
+    std::lock_guard<std::mutex> lk(hist_mu);
+    for (int o = 0; o < kOps; o++)
+      if (enabled[o]) hist[o].merge(local[o]);
   };
 
   std::vector<std::thread> ts;
   ts.reserve(clients);
   for (int i = 0; i < clients; i++) ts.emplace_back(worker, i);
 
-  auto t0 = std::chrono::steady_clock::now();
+  // Wait for connections (and pre-load), then start the schedule slightly in
+  // the future so every connection begins together.
+  while (ready.load() < clients)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  uint64_t overflows0 = 0, drops0 = 0, overflows1 = 0, drops1 = 0;
+  bool have_drops = read_listen_drops(overflows0, drops0);
+  t0 = Clock::now() + std::chrono::milliseconds(10);
+  std::this_thread::sleep_until(t0);
   start.store(true);
-  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  std::this_thread::sleep_until(t0 + std::chrono::seconds(seconds));
   stop.store(true);
 
   for (auto& t : ts) t.join();
-  auto t1 = std::chrono::steady_clock::now();
+  auto t1 = Clock::now();
+  have_drops = have_drops && read_listen_drops(overflows1, drops1);
+
+  if (connect_failures.load() == clients) {
+    std::cerr << "could not connect to " << host << ":" << port << "\n";
+    return 1;
+  }
+  if (connect_failures.load() > 0)
+    std::cerr << connect_failures.load() << " connection(s) failed\n";
 
   double sec = std::chrono::duration<double>(t1 - t0).count();
   uint64_t total = ops.load();
   std::cout << "clients=" << clients << " seconds=" << sec << " ops=" << total
             << " ops/sec=" << (total / sec) << "\n";
+
+  if (churn) {
+    std::cout << "churn: connections/sec=" << total / sec
+              << " errors=" << churn_errors.load()
+              << " rejected=" << churn_rejected.load() << "\n";
+    if (have_drops)
+      std::cout << "accept queue (host-wide): ListenOverflows +"
+                << overflows1 - overflows0 << " ListenDrops +"
+                << drops1 - drops0 << "\n";
+  }
+
+  if (open_loop) {
+    std::cout << "mode=open-loop target_ops/sec=" << rate
+              << " missed=" << missed.load() << "\n";
+    std::cout << "latency (us, measured from intended send time):\n";
+  } else {
+    std::cout << "mode=closed-loop\n";
+    std::cout << "latency (us, measured from actual send time):\n";
+  }
+
+  // "all" is every command; in churn mode it is connect-to-first-response.
+  HdrHistogram all;
+  for (int o = 0; o < kConnect; o++)
+    if (enabled[o]) all.merge(hist[o]);
+  if (churn) all.merge(hist[kConnect]);
+
+  const double pcts[] = {50, 75, 90, 99, 99.9, 99.99, 100};
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "  %-8s %12s", "", "all");
+  std::cout << buf;
+  for (int o = 0; o < kOps; o++) {
+    if (!enabled[o]) continue;
+    std::snprintf(buf, sizeof(buf), " %12s", op_names[o]);
+    std::cout << buf;
+  }
+  std::cout << "\n";
+
+  auto row = [&](const char* label, auto value_of, int prec = 1) {
+    std::snprintf(buf, sizeof(buf), "  %-8s %12.*f", label, prec,
+                  value_of(all));
+    std::cout << buf;
+    for (int o = 0; o < kOps; o++) {
+      if (!enabled[o]) continue;
+      std::snprintf(buf, sizeof(buf), " %12.*f", prec, value_of(hist[o]));
+      std::cout << buf;
+    }
+    std::cout << "\n";
+  };
+
+  for (double p : pcts) {
+    char label[16];
+    std::snprintf(label, sizeof(label), "p%g", p);
+    row(label, [p](const HdrHistogram& h) {
+      return h.value_at_percentile(p) / 1000.0;
+    });
+  }
+  row("mean", [](const HdrHistogram& h) { return h.mean() / 1000.0; });
+  row("ops", [](const HdrHistogram& h) { return double(h.count()); }, 0);
+
+  if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    if (!out) {
+      std::cerr << "cannot write " << json_path << "\n";
+      return 1;
+    }
+    auto latency = [&](const char* name, const HdrHistogram& h, bool last) {
+      std::snprintf(buf, sizeof(buf),
+                    "    \"%s\": {\"count\": %llu, \"mean\": %.1f, "
+                    "\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, "
+                    "\"p999\": %.1f, \"max\": %.1f}%s\n",
+                    name, (unsigned long long)h.count(), h.mean() / 1000.0,
+                    h.value_at_percentile(50) / 1000.0,
+                    h.value_at_percentile(90) / 1000.0,
+                    h.value_at_percentile(99) / 1000.0,
+                    h.value_at_percentile(99.9) / 1000.0, h.max() / 1000.0,
+                    last ? "" : ",");
+      out << buf;
+    };
+    out << "{\n";
+    out << "  \"mode\": \"" << (open_loop ? "open-loop" : "closed-loop")
+        << "\",\n";
+    out << "  \"clients\": " << clients << ",\n";
+    out << "  \"seconds\": " << sec << ",\n";
+    out << "  \"target_ops_per_sec\": " << rate << ",\n";
+    out << "  \"ops\": " << total << ",\n";
+    out << "  \"ops_per_sec\": " << total / sec << ",\n";
+    out << "  \"missed\": " << missed.load() << ",\n";
+    if (churn) {
+      out << "  \"churn\": {\"connections_per_sec\": " << total / sec
+          << ", \"errors\": " << churn_errors.load()
+          << ", \"rejected\": " << churn_rejected.load();
+      if (have_drops)
+        out << ", \"listen_overflows\": " << overflows1 - overflows0
+            << ", \"listen_drops\": " << drops1 - drops0;
+      out << "},\n";
+    }
+    out << "  \"latency_us\": {\n";
+    latency("all", all, false);
+    int last = kOps - 1;
+    while (last > 0 && !enabled[last]) last--;
+    for (int o = 0; o < kOps; o++)
+      if (enabled[o]) latency(op_names[o], hist[o], o == last);
+    out << "  }\n}\n";
+  }
 }
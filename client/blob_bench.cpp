@@ -0,0 +1,241 @@
+// Large-value throughput benchmark. For each value size, clients write with
+// SETB and then read back with GETB for a fixed time, and the transfer rate
+// (GB/s of value bytes) and per-operation latency are reported.
+//
+//   blob_bench [--host H] [--port N] [--clients C] [--seconds S]
+//              [--sizes 1K,64K,1M,64M] [--json PATH]
+
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client_conn.hpp"
+#include "hdr_histogram.hpp"
+#include "workload.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// "4096", "4K", "64M", "1G" -> bytes; 0 when malformed.
+static size_t parse_size(const std::string& s) {
+  size_t pos = 0;
+  unsigned long long v = 0;
+  try {
+    v = std::stoull(s, &pos);
+  } catch (...) {
+    return 0;
+  }
+  std::string suffix = s.substr(pos);
+  if (suffix == "K" || suffix == "k") return v << 10;
+  if (suffix == "M" || suffix == "m") return v << 20;
+  if (suffix == "G" || suffix == "g") return v << 30;
+  return suffix.empty() ? v : 0;
+}
+
+static std::string size_name(size_t n) {
+  if (n >= (1u << 20) && n % (1u << 20) == 0)
+    return std::to_string(n >> 20) + "M";
+  if (n >= (1u << 10) && n % (1u << 10) == 0)
+    return std::to_string(n >> 10) + "K";
+  return std::to_string(n);
+}
+
+struct PhaseResult {
+  uint64_t ops = 0;
+  double seconds = 0;
+  HdrHistogram hist;
+  bool failed = false;
+
+  double gbps(size_t size) const {
+    return seconds > 0 ? ops * double(size) / seconds / 1e9 : 0;
+  }
+};
+
+// Runs `clients` connections doing SETB (write) or GETB (read) of `size`
+// byte values for `seconds`.
+static PhaseResult run_phase(const std::string& host, int port, int clients,
+                             double seconds, size_t size, bool write,
+                             const std::string& value) {
+  PhaseResult res;
+  std::mutex mu;
+  std::atomic<bool> stop{false};
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::vector<std::thread> ts;
+
+  for (int c = 0; c < clients; c++) {
+    ts.emplace_back([&, c]() {
+      int fd = connect_to(host, port);
+      // Header and body go out as two writes; don't let Nagle hold the body.
+      int one = 1;
+      if (fd >= 0)
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      ReplyReader rr(fd);
+      std::string line, body;
+      bool ok = fd >= 0 && rr.read_line(line);  // banner
+      ready.fetch_add(1);
+      while (!go.load()) std::this_thread::yield();
+
+      HdrHistogram local;
+      uint64_t ops = 0;
+      const std::string key = "blob:" + std::to_string(c);
+      const std::string head = (write ? "SETB " : "GETB ") + key +
+                               (write ? " " + std::to_string(size) : "") +
+                               "\n";
+      while (ok && !stop.load()) {
+        auto t0 = Clock::now();
+        ok = send_all(fd, head.data(), head.size());
+        if (ok && write) ok = send_all(fd, value.data(), size);
+        ok = ok && rr.read_line(line);
+        if (ok && !write) {
+          ok = line == "VALUEB " + std::to_string(size) &&
+               rr.read_exact(size, body);
+        } else if (ok) {
+          ok = line == "OK";
+        }
+        if (!ok) break;
+        local.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                Clock::now() - t0)
+                .count()));
+        ops++;
+      }
+      if (fd >= 0) close(fd);
+
+      std::lock_guard<std::mutex> lk(mu);
+      res.ops += ops;
+      res.hist.merge(local);
+      if (!ok && !stop.load()) res.failed = true;
+    });
+  }
+
+  while (ready.load() < clients) std::this_thread::yield();
+  auto t0 = Clock::now();
+  go.store(true);
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop.store(true);
+  for (auto& t : ts) t.join();
+  res.seconds = std::chrono::duration<double>(Clock::now() - t0).count();
+  return res;
+}
+
+int main(int argc, char** argv) {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  int clients = 1;
+  double seconds = 2;
+  std::string sizes_arg = "1K,16K,256K,1M,4M,16M,64M";
+  std::string json_path;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto need = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << a << "\n";
+        std::exit(1);
+      }
+      return std::string(argv[++i]);
+    };
+    if (a == "--host")
+      host = need();
+    else if (a == "--port")
+      port = std::stoi(need());
+    else if (a == "--clients")
+      clients = std::max(1, std::stoi(need()));
+    else if (a == "--seconds")
+      seconds = std::stod(need());
+    else if (a == "--sizes")
+      sizes_arg = need();
+    else if (a == "--json")
+      json_path = need();
+    else if (a == "--help") {
+      std::cout << "Usage: blob_bench [--host H] [--port N] [--clients C] "
+                   "[--seconds S]\n"
+                   "                  [--sizes 1K,64K,1M,64M] [--json PATH]\n"
+                   "Each size runs a SETB phase then a GETB phase of S "
+                   "seconds.\n";
+      return 0;
+    }
+  }
+
+  std::vector<size_t> sizes;
+  size_t start = 0;
+  while (start <= sizes_arg.size()) {
+    size_t comma = sizes_arg.find(',', start);
+    if (comma == std::string::npos) comma = sizes_arg.size();
+    size_t n = parse_size(sizes_arg.substr(start, comma - start));
+    if (n == 0) {
+      std::cerr << "--sizes expects a list like 1K,64K,1M\n";
+      return 1;
+    }
+    sizes.push_back(n);
+    start = comma + 1;
+  }
+
+  struct Row {
+    size_t size;
+    PhaseResult set, get;
+  };
+  std::vector<Row> rows;
+
+  char buf[256];
+  std::snprintf(buf, sizeof(buf), "%-6s %10s %10s %10s %10s %10s %10s\n",
+                "size", "SET GB/s", "p50 ms", "p99 ms", "GET GB/s", "p50 ms",
+                "p99 ms");
+  std::cout << buf;
+  for (size_t size : sizes) {
+    const std::string value = make_value_pool(size, size);
+    Row row{size, run_phase(host, port, clients, seconds, size, true, value),
+            run_phase(host, port, clients, seconds, size, false, value)};
+    if (row.set.failed || row.get.failed || row.set.ops == 0) {
+      std::cerr << "transfer failed at size " << size_name(size)
+                << " (server running? --max-value-mb large enough?)\n";
+      return 1;
+    }
+    auto ms = [](const PhaseResult& r, double p) {
+      return r.hist.value_at_percentile(p) / 1e6;
+    };
+    std::snprintf(buf, sizeof(buf),
+                  "%-6s %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+                  size_name(size).c_str(), row.set.gbps(size), ms(row.set, 50),
+                  ms(row.set, 99), row.get.gbps(size), ms(row.get, 50),
+                  ms(row.get, 99));
+    std::cout << buf;
+    rows.push_back(std::move(row));
+  }
+
+  if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    if (!out) {
+      std::cerr << "cannot write " << json_path << "\n";
+      return 1;
+    }
+    out << "{\n  \"clients\": " << clients << ",\n  \"seconds\": " << seconds
+        << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < rows.size(); i++) {
+      const Row& r = rows[i];
+      auto phase = [&](const char* name, const PhaseResult& p) {
+        out << "\"" << name << "\": {\"ops\": " << p.ops
+            << ", \"gb_per_sec\": " << p.gbps(r.size)
+            << ", \"p50_us\": " << p.hist.value_at_percentile(50) / 1e3
+            << ", \"p99_us\": " << p.hist.value_at_percentile(99) / 1e3
+            << "}";
+      };
+      out << "    {\"size\": " << r.size << ", ";
+      phase("SETB", r.set);
+      out << ", ";
+      phase("GETB", r.get);
+      out << "}" << (i + 1 < rows.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <string>
+
+// Socket helpers shared by the benchmark clients.
+
+inline bool send_all(int fd, const char* data, size_t len) {
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t n = send(fd, data + sent, len - sent, 0);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    if (n == 0) return false;
+    sent += (size_t)n;
+  }
+  return true;
+}
+
+// Buffered reply reader, one per connection. Reading a byte per recv() makes
+// the client the bottleneck once values are more than a few bytes long.
+class ReplyReader {
+ public:
+  explicit ReplyReader(int fd, size_t max_line = 65536)
+      : fd_(fd), max_line_(max_line) {}
+
+  bool read_line(std::string& out) {
+    out.clear();
+    while (true) {
+      auto nl = buf_.find('\n', pos_);
+      if (nl != std::string::npos) {
+        out.assign(buf_, pos_, nl - pos_);
+        pos_ = nl + 1;
+        return true;
+      }
+      if (buf_.size() - pos_ > max_line_) return false;
+      buf_.erase(0, pos_);
+      pos_ = 0;
+      char tmp[16384];
+      ssize_t n = recv(fd_, tmp, sizeof(tmp), 0);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      buf_.append(tmp, static_cast<size_t>(n));
+    }
+  }
+
+  // Reads exactly n raw bytes (a VALUEB body), buffered bytes first.
+  bool read_exact(size_t n, std::string& out) {
+    out.resize(n);
+    size_t got = std::min(n, buf_.size() - pos_);
+    buf_.copy(&out[0], got, pos_);
+    pos_ += got;
+    while (got < n) {
+      ssize_t r = recv(fd_, &out[got], n - got, 0);
+      if (r < 0 && errno == EINTR) continue;
+      if (r <= 0) return false;
+      got += static_cast<size_t>(r);
+    }
+    return true;
+  }
+
+ private:
+  int fd_;
+  size_t max_line_;
+  std::string buf_;
+  size_t pos_ = 0;
+};
+
+inline int connect_to(const std::string& host, int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t)port);
+  if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+    close(fd);
+    return -1;
+  }
+
+  if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
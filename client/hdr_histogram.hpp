@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Minimal HDR (high dynamic range) histogram.
+// Values are bucketed with a fixed number of significant decimal digits, so
+// relative error stays bounded from nanoseconds up to `highest`.
+class HdrHistogram {
+ public:
+  explicit HdrHistogram(uint64_t highest = 3600ULL * 1000000000ULL,
+                        int sig_digits = 3) {
+    uint64_t largest_single_unit = 2;
+    for (int i = 0; i < sig_digits; i++) largest_single_unit *= 10;
+
+    int sub_bucket_count_magnitude = 0;
+    while ((1ULL << sub_bucket_count_magnitude) < largest_single_unit)
+      sub_bucket_count_magnitude++;
+    sub_bucket_half_count_magnitude_ = sub_bucket_count_magnitude - 1;
+    sub_bucket_count_ = 1ULL << sub_bucket_count_magnitude;
+    sub_bucket_half_count_ = sub_bucket_count_ / 2;
+    sub_bucket_mask_ = sub_bucket_count_ - 1;
+
+    uint64_t smallest_untrackable = sub_bucket_count_;
+    int buckets = 1;
+    while (smallest_untrackable <= highest) {
+      if (smallest_untrackable > (UINT64_MAX >> 1)) {
+        buckets++;
+        break;
+      }
+      smallest_untrackable <<= 1;
+      buckets++;
+    }
+    highest_ = highest;
+    counts_.assign((buckets + 1) * sub_bucket_half_count_, 0);
+  }
+
+  void record(uint64_t v) {
+    if (v > highest_) v = highest_;
+    counts_[counts_index_for(v)]++;
+    total_++;
+    min_ = std::min(min_, v);
+    max_ = std::max(max_, v);
+    sum_ += static_cast<double>(v);
+  }
+
+  // Histograms must have been constructed with the same parameters.
+  void merge(const HdrHistogram& o) {
+    for (size_t i = 0; i < counts_.size() && i < o.counts_.size(); i++)
+      counts_[i] += o.counts_[i];
+    total_ += o.total_;
+    min_ = std::min(min_, o.min_);
+    max_ = std::max(max_, o.max_);
+    sum_ += o.sum_;
+  }
+
+  uint64_t count() const { return total_; }
+  uint64_t min() const { return total_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  double mean() const { return total_ ? sum_ / total_ : 0.0; }
+
+  // p in [0, 100]
+  uint64_t value_at_percentile(double p) const {
+    if (total_ == 0) return 0;
+    p = std::min(std::max(p, 0.0), 100.0);
+    uint64_t target = static_cast<uint64_t>(std::ceil(p / 100.0 * total_));
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); i++) {
+      seen += counts_[i];
+      if (seen >= target) {
+        return std::min(highest_equivalent(value_at_index(i)), max_);
+      }
+    }
+    return max_;
+  }
+
+ private:
+  int bucket_index(uint64_t v) const {
+    int pow2ceiling = 64 - __builtin_clzll(v | sub_bucket_mask_);
+    return pow2ceiling - (sub_bucket_half_count_magnitude_ + 1);
+  }
+
+  size_t counts_index_for(uint64_t v) const {
+    int b = bucket_index(v);
+    uint64_t sb = v >> b;
+    return ((static_cast<size_t>(b) + 1) << sub_bucket_half_count_magnitude_) +
+           (sb - sub_bucket_half_count_);
+  }
+
+  uint64_t value_at_index(size_t i) const {
+    int b = static_cast<int>(i >> sub_bucket_half_count_magnitude_) - 1;
+    uint64_t sb = (i & (sub_bucket_half_count_ - 1)) + sub_bucket_half_count_;
+    if (b < 0) {
+      sb -= sub_bucket_half_count_;
+      b = 0;
+    }
+    return sb << b;
+  }
+
+  uint64_t highest_equivalent(uint64_t v) const {
+    int b = bucket_index(v);
+    uint64_t sb = v >> b;
+    int adjusted = (sb >= sub_bucket_count_) ? b + 1 : b;
+    uint64_t lowest = sb << b;
+    return lowest + (1ULL << adjusted) - 1;
+  }
+
+  int sub_bucket_half_count_magnitude_ = 0;
+  uint64_t sub_bucket_count_ = 0;
+  uint64_t sub_bucket_half_count_ = 0;
+  uint64_t sub_bucket_mask_ = 0;
+  uint64_t highest_ = 0;
+
+  std::vector<uint64_t> counts_;
+  uint64_t total_ = 0;
+  uint64_t min_ = UINT64_MAX;
+  uint64_t max_ = 0;
+  double sum_ = 0.0;
+};
@@ -0,0 +1,234 @@
+// Replays a traffic capture recorded with `server --capture FILE`.
+//
+// Every captured connection is re-opened when its first request is due and
+// its requests are sent on the same connection in their original order.
+// Timing is kept relative to the capture start and divided by --speed;
+// --speed max sends as fast as the server accepts. Replies are read and
+// discarded, so ordering per connection is preserved by TCP without waiting
+// on each reply.
+//
+//   replay FILE [--host H] [--port N] [--speed X|max] [--dump]
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_format.hpp"
+#include "client_conn.hpp"
+#include "hdr_histogram.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Session {
+  uint32_t conn = 0;
+  std::vector<CaptureRecord> records;
+};
+
+struct Totals {
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> errors{0};
+  std::mutex mu;
+  HdrHistogram lag;  // ns the send started behind schedule
+};
+
+Clock::time_point due(Clock::time_point t0, uint64_t ts_us, double speed) {
+  if (speed <= 0) return t0;
+  return t0 + std::chrono::nanoseconds(
+                  static_cast<int64_t>(ts_us * 1000.0 / speed));
+}
+
+// Sends one session's requests on schedule while draining replies.
+void replay_session(const std::string& host, int port, const Session& s,
+                    Clock::time_point t0, double speed, Totals& totals) {
+  int fd = connect_to(host, port);
+  if (fd < 0) {
+    totals.errors.fetch_add(1);
+    return;
+  }
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  HdrHistogram lag;
+  char sink[65536];
+  size_t next = 0;        // next record to start sending
+  const std::string* cur = nullptr;
+  size_t off = 0;         // bytes of *cur already sent
+  bool peer_closed = false;
+
+  while (!peer_closed && (cur || next < s.records.size())) {
+    int timeout_ms = 0;
+    auto now = Clock::now();
+    if (!cur) {
+      auto when = due(t0, s.records[next].ts_us, speed);
+      if (when <= now) {
+        if (speed > 0)
+          lag.record(static_cast<uint64_t>(
+              std::chrono::duration_cast<std::chrono::nanoseconds>(now - when)
+                  .count()));
+        cur = &s.records[next++].bytes;
+        off = 0;
+      } else {
+        timeout_ms = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(when - now)
+                .count()) + 1;
+      }
+    }
+
+    pollfd p{fd, static_cast<short>(POLLIN | (cur ? POLLOUT : 0)), 0};
+    if (::poll(&p, 1, cur ? -1 : timeout_ms) < 0) continue;
+    if (p.revents & (POLLIN | POLLHUP | POLLERR)) {
+      ssize_t n = ::recv(fd, sink, sizeof(sink), 0);
+      if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+        peer_closed = true;
+    }
+    if (cur && (p.revents & POLLOUT)) {
+      ssize_t n = ::send(fd, cur->data() + off, cur->size() - off,
+                         MSG_NOSIGNAL);
+      if (n > 0) off += static_cast<size_t>(n);
+      if (off == cur->size()) {
+        totals.requests.fetch_add(1);
+        totals.bytes.fetch_add(cur->size());
+        cur = nullptr;
+      }
+    }
+  }
+  // A QUIT in the capture closes the connection early; anything else is an
+  // error.
+  if (next < s.records.size() || cur) totals.errors.fetch_add(1);
+
+  // Let the server finish the pipelined replies before closing.
+  ::shutdown(fd, SHUT_WR);
+  while (!peer_closed) {
+    pollfd p{fd, POLLIN, 0};
+    if (::poll(&p, 1, 5000) <= 0) break;
+    ssize_t n = ::recv(fd, sink, sizeof(sink), 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) break;
+  }
+  ::close(fd);
+
+  std::lock_guard<std::mutex> lk(totals.mu);
+  totals.lag.merge(lag);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  double speed = 1;
+  bool dump = false;
+  std::string path;
+
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto need = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << a << "\n";
+        std::exit(1);
+      }
+      return std::string(argv[++i]);
+    };
+    if (a == "--host")
+      host = need();
+    else if (a == "--port")
+      port = std::stoi(need());
+    else if (a == "--speed") {
+      std::string v = need();
+      speed = v == "max" ? 0 : std::stod(v);
+      if (speed < 0) speed = 0;
+    } else if (a == "--dump")
+      dump = true;
+    else if (a == "--help") {
+      std::cout << "Usage: replay FILE [--host H] [--port N] [--speed X|max] "
+                   "[--dump]\n"
+                   "  --speed X   replay at X times the captured rate "
+                   "(default 1)\n"
+                   "  --speed max send every request as soon as possible\n"
+                   "  --dump      print the capture instead of replaying it\n";
+      return 0;
+    } else if (a.rfind("--", 0) != 0)
+      path = a;
+  }
+  if (path.empty()) {
+    std::cerr << "Usage: replay FILE [--host H] [--port N] [--speed X|max]\n";
+    return 1;
+  }
+
+  std::FILE* f = std::fopen(path.c_str(), "rb");
+  char magic[kCaptureMagicLen];
+  if (!f || std::fread(magic, 1, kCaptureMagicLen, f) != kCaptureMagicLen ||
+      std::string(magic, kCaptureMagicLen) != kCaptureMagic) {
+    std::cerr << path << ": not a capture file\n";
+    if (f) std::fclose(f);
+    return 1;
+  }
+
+  std::map<uint32_t, Session> by_conn;
+  uint64_t total = 0;
+  CaptureRecord r;
+  while (read_capture_record(f, r)) {
+    if (dump) {
+      size_t nl = r.bytes.find('\n');
+      std::string line = r.bytes.substr(0, nl);
+      std::cout << r.ts_us << " " << r.conn << " " << line;
+      if (nl != std::string::npos && nl + 1 < r.bytes.size())
+        std::cout << " <" << r.bytes.size() - nl - 1 << " bytes>";
+      std::cout << "\n";
+    }
+    Session& s = by_conn[r.conn];
+    s.conn = r.conn;
+    s.records.push_back(std::move(r));
+    r = CaptureRecord();
+    total++;
+  }
+  std::fclose(f);
+  if (dump) return 0;
+
+  // Sessions start in the order their first request arrived.
+  std::vector<Session*> sessions;
+  for (auto& kv : by_conn) sessions.push_back(&kv.second);
+  std::sort(sessions.begin(), sessions.end(), [](Session* a, Session* b) {
+    return a->records.front().ts_us < b->records.front().ts_us;
+  });
+  std::cerr << "replaying " << total << " requests on " << sessions.size()
+            << " connections\n";
+
+  Totals totals;
+  std::vector<std::thread> ts;
+  auto t0 = Clock::now() + std::chrono::milliseconds(10);
+  for (Session* s : sessions) {
+    std::this_thread::sleep_until(due(t0, s->records.front().ts_us, speed));
+    ts.emplace_back([&, s]() {
+      replay_session(host, port, *s, t0, speed, totals);
+    });
+  }
+  for (auto& t : ts) t.join();
+  double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  std::cout << "connections=" << sessions.size()
+            << " requests=" << totals.requests.load()
+            << " bytes=" << totals.bytes.load() << " seconds=" << sec
+            << " req/sec=" << (sec > 0 ? totals.requests.load() / sec : 0)
+            << " errors=" << totals.errors.load() << "\n";
+  if (speed > 0 && totals.lag.count() > 0) {
+    std::cout << "send lag behind schedule (us): p50="
+              << totals.lag.value_at_percentile(50) / 1e3
+              << " p99=" << totals.lag.value_at_percentile(99) / 1e3
+              << " max=" << totals.lag.max() / 1e3 << "\n";
+  }
+  return totals.errors.load() ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+
+// Key and value generators shared by the benchmark clients.
+
+enum class KeyDist { kUniform, kZipfian, kHotspot, kSequential };
+
+// nullopt for an unknown name.
+inline std::optional<KeyDist> parse_key_dist(const std::string& s) {
+  if (s == "uniform") return KeyDist::kUniform;
+  if (s == "zipfian") return KeyDist::kZipfian;
+  if (s == "hotspot") return KeyDist::kHotspot;
+  if (s == "sequential") return KeyDist::kSequential;
+  return std::nullopt;
+}
+
+// Zipfian over [0, n) as in YCSB (Gray et al., "Quickly generating
+// billion-record synthetic databases"). Item 0 is the most popular; set
+// `scrambled` to spread popular items across the keyspace.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator() = default;
+  ZipfianGenerator(uint64_t n, double theta, bool scrambled = false)
+      : n_(n), theta_(theta), scrambled_(scrambled) {
+    if (n_ == 0) n_ = 1;
+    zeta2_ = zeta(2, theta_);
+    zetan_ = zeta(n_, theta_);
+    alpha_ = 1.0 / (1.0 - theta_);
+    eta_ = (1.0 - std::pow(2.0 / n_, 1.0 - theta_)) / (1.0 - zeta2_ / zetan_);
+  }
+
+  template <typename Rng>
+  uint64_t next(Rng& rng) {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    double uz = u * zetan_;
+    uint64_t v;
+    if (uz < 1.0)
+      v = 0;
+    else if (uz < 1.0 + std::pow(0.5, theta_))
+      v = 1;
+    else
+      v = static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_));
+    if (v >= n_) v = n_ - 1;
+    return scrambled_ ? fnv64(v) % n_ : v;
+  }
+
+  static uint64_t fnv64(uint64_t v) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; i++) {
+      h ^= v & 0xff;
+      h *= 0x100000001b3ULL;
+      v >>= 8;
+    }
+    return h;
+  }
+
+ private:
+  static double zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 1; i <= n; i++) sum += 1.0 / std::pow(double(i), theta);
+    return sum;
+  }
+
+  uint64_t n_ = 1;
+  double theta_ = 0.99;
+  bool scrambled_ = false;
+  double zeta2_ = 0, zetan_ = 1, alpha_ = 0, eta_ = 0;
+};
+
+struct KeySpec {
+  KeyDist dist = KeyDist::kUniform;
+  uint64_t keyspace = 100000;
+  double zipf_theta = 0.99;
+  double hot_keys = 0.2;  // fraction of keys that are hot
+  double hot_ops = 0.8;   // fraction of operations that hit hot keys
+};
+
+// One instance per thread; copying shares the precomputed zipfian constants.
+class KeyChooser {
+ public:
+  KeyChooser() = default;
+  explicit KeyChooser(const KeySpec& spec) : spec_(spec) {
+    if (spec_.keyspace == 0) spec_.keyspace = 1;
+    if (spec_.dist == KeyDist::kZipfian)
+      zipf_ = ZipfianGenerator(spec_.keyspace, spec_.zipf_theta);
+  }
+
+  // Sequential keys start at `offset` so threads walk different ranges.
+  void set_sequential_offset(uint64_t offset) { seq_ = offset; }
+
+  template <typename Rng>
+  uint64_t next(Rng& rng) {
+    const uint64_t n = spec_.keyspace;
+    switch (spec_.dist) {
+      case KeyDist::kUniform:
+        return std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+      case KeyDist::kZipfian:
+        return zipf_.next(rng);
+      case KeyDist::kHotspot: {
+        uint64_t hot = std::max<uint64_t>(
+            1, static_cast<uint64_t>(n * spec_.hot_keys));
+        if (hot >= n) hot = n;
+        std::uniform_real_distribution<double> u(0.0, 1.0);
+        if (hot == n || u(rng) < spec_.hot_ops)
+          return std::uniform_int_distribution<uint64_t>(0, hot - 1)(rng);
+        return std::uniform_int_distribution<uint64_t>(hot, n - 1)(rng);
+      }
+      case KeyDist::kSequential:
+        return seq_++ % n;
+    }
+    return 0;
+  }
+
+ private:
+  KeySpec spec_;
+  ZipfianGenerator zipf_;
+  uint64_t seq_ = 0;
+};
+
+// Value sizes: "N" (fixed), "MIN-MAX" (uniform), "exp:MEAN" (exponential).
+class ValueSizer {
+ public:
+  ValueSizer() = default;
+  ValueSizer(const std::string& spec, size_t cap) : cap_(cap) {
+    if (spec.rfind("exp:", 0) == 0) {
+      kind_ = kExp;
+      mean_ = std::stod(spec.substr(4));
+    } else if (auto dash = spec.find('-'); dash != std::string::npos) {
+      kind_ = kUniform;
+      min_ = std::stoull(spec.substr(0, dash));
+      max_ = std::stoull(spec.substr(dash + 1));
+      if (max_ < min_) std::swap(min_, max_);
+    } else {
+      kind_ = kFixed;
+      min_ = max_ = std::stoull(spec);
+    }
+  }
+
+  template <typename Rng>
+  size_t next(Rng& rng) {
+    size_t v = min_;
+    if (kind_ == kUniform) {
+      v = std::uniform_int_distribution<size_t>(min_, max_)(rng);
+    } else if (kind_ == kExp) {
+      v = static_cast<size_t>(
+          std::exponential_distribution<double>(1.0 / mean_)(rng));
+    }
+    return std::min(std::max<size_t>(v, 1), cap_);
+  }
+
+  size_t max_size() const {
+    return kind_ == kExp ? cap_ : std::min(max_, cap_);
+  }
+
+ private:
+  enum Kind { kFixed, kUniform, kExp };
+  Kind kind_ = kFixed;
+  size_t min_ = 3, max_ = 3;
+  double mean_ = 3;
+  size_t cap_ = 8000;
+};
+
+// Printable filler; values are substrings of it so generation is free.
+inline std::string make_value_pool(size_t size, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::string s(size, 'a');
+  for (auto& c : s) c = static_cast<char>('a' + rng() % 26);
+  return s;
+}
+
+inline std::string key_name(uint64_t id) { return "k" + std::to_string(id); }
@@ -0,0 +1,539 @@
+// YCSB core workload driver for the tcp-kv protocol.
+//
+//   ycsb load -P workloads/workloada [-p name=value] [--threads N]
+//   ycsb run  -P workloads/workloada [-p name=value] [--threads N]
+//
+// Workload files use the YCSB properties format. Records are stored as one
+// value holding all fields, so updates rewrite the whole record.
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "client_conn.hpp"
+#include "hdr_histogram.hpp"
+#include "workload.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+class Properties {
+ public:
+  bool load(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+      auto hash = line.find('#');
+      if (hash != std::string::npos) line.erase(hash);
+      set_assignment(line);
+    }
+    return true;
+  }
+
+  bool set_assignment(const std::string& line) {
+    auto eq = line.find('=');
+    if (eq == std::string::npos) return false;
+    std::string k = trim(line.substr(0, eq));
+    std::string v = trim(line.substr(eq + 1));
+    if (k.empty()) return false;
+    props_[k] = v;
+    return true;
+  }
+
+  std::string str(const std::string& k, const std::string& def) const {
+    auto it = props_.find(k);
+    return it == props_.end() ? def : it->second;
+  }
+  double num(const std::string& k, double def) const {
+    auto it = props_.find(k);
+    return it == props_.end() ? def : std::stod(it->second);
+  }
+  uint64_t u64(const std::string& k, uint64_t def) const {
+    auto it = props_.find(k);
+    return it == props_.end() ? def : std::stoull(it->second);
+  }
+
+ private:
+  static std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t\r");
+    size_t e = s.find_last_not_of(" \t\r");
+    return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+  }
+
+  std::map<std::string, std::string> props_;
+};
+
+enum Op { kRead, kUpdate, kInsert, kScan, kReadModifyWrite, kOps };
+const char* kOpNames[kOps] = {"READ", "UPDATE", "INSERT", "SCAN",
+                              "READ-MODIFY-WRITE"};
+
+struct OpStats {
+  HdrHistogram hist;
+  uint64_t errors = 0;
+};
+
+struct Config {
+  std::string host = "127.0.0.1";
+  int port = 8080;
+  int threads = 1;
+  bool run = false;
+  std::string workload_name;
+  std::string json_path;
+
+  uint64_t record_count = 1000;
+  uint64_t operation_count = 1000;
+  int field_count = 10;
+  size_t field_length = 100;
+  bool hashed_keys = true;
+  std::string request_dist = "uniform";
+  double zipf_theta = 0.99;
+  double hot_data = 0.2;
+  double hot_ops = 0.8;
+  uint64_t max_scan = 1000;
+  std::string scan_dist = "uniform";
+  double proportion[kOps] = {0.95, 0.05, 0, 0, 0};
+};
+
+std::string record_key(const Config& c, uint64_t keynum) {
+  uint64_t n = c.hashed_keys ? ZipfianGenerator::fnv64(keynum) : keynum;
+  return "user" + std::to_string(n);
+}
+
+// Keys [0, last()) are known to exist. Inserts finish out of order across
+// threads, so, like YCSB's AcknowledgedCounterGenerator, an acknowledged
+// key only extends the range once every key below it has been acknowledged
+// too. A failed insert is never acknowledged and holds the range there.
+class AckedCounter {
+ public:
+  explicit AckedCounter(uint64_t start) : last_(start) {}
+
+  uint64_t last() const { return last_.load(std::memory_order_acquire); }
+
+  void ack(uint64_t key) {
+    std::lock_guard<std::mutex> lk(mu_);
+    uint64_t last = last_.load(std::memory_order_relaxed);
+    // done_[i] is key last + i.
+    if (key - last >= done_.size()) done_.resize(key - last + 1);
+    done_[key - last] = 1;
+    while (!done_.empty() && done_.front()) {
+      done_.pop_front();
+      last++;
+    }
+    last_.store(last, std::memory_order_release);
+  }
+
+ private:
+  std::atomic<uint64_t> last_;
+  std::mutex mu_;
+  std::deque<char> done_;
+};
+
+// Chooses existing records according to requestdistribution.
+class RecordChooser {
+ public:
+  RecordChooser(const Config& c, const AckedCounter& acked)
+      : c_(c), acked_(acked) {
+    uint64_t expected_new = static_cast<uint64_t>(
+        c.operation_count * c.proportion[kInsert] * 2.0);
+    if (c.request_dist == "zipfian")
+      zipf_ = ZipfianGenerator(c.record_count + expected_new, c.zipf_theta,
+                               true);
+    else if (c.request_dist == "latest")
+      zipf_ = ZipfianGenerator(c.record_count, c.zipf_theta);
+  }
+
+  template <typename Rng>
+  uint64_t next(Rng& rng) {
+    uint64_t n = acked_.last();
+    if (n == 0) return 0;
+    if (c_.request_dist == "zipfian") {
+      uint64_t v;
+      do v = zipf_.next(rng);
+      while (v >= n);
+      return v;
+    }
+    if (c_.request_dist == "latest") {
+      // Recently inserted records are the most popular.
+      uint64_t off = zipf_.next(rng);
+      return off >= n ? 0 : n - 1 - off;
+    }
+    if (c_.request_dist == "hotspot") {
+      uint64_t hot = std::max<uint64_t>(1, n * c_.hot_data);
+      std::uniform_real_distribution<double> u(0.0, 1.0);
+      if (hot >= n || u(rng) < c_.hot_ops)
+        return std::uniform_int_distribution<uint64_t>(0, hot - 1)(rng);
+      return std::uniform_int_distribution<uint64_t>(hot, n - 1)(rng);
+    }
+    return std::uniform_int_distribution<uint64_t>(0, n - 1)(rng);
+  }
+
+ private:
+  const Config& c_;
+  const AckedCounter& acked_;
+  ZipfianGenerator zipf_;
+};
+
+class Client {
+ public:
+  Client(const Config& c, int fd, uint64_t seed)
+      : c_(c), fd_(fd), rr_(fd, 1 << 20), rng_(seed) {
+    pool_ = make_value_pool(c.field_length + 4096, seed);
+  }
+
+  std::mt19937_64& rng() { return rng_; }
+
+  bool read_banner() { return rr_.read_line(line_); }
+
+  std::string record() {
+    std::string v;
+    v.reserve(c_.field_count * (c_.field_length + 8));
+    for (int f = 0; f < c_.field_count; f++) {
+      if (f) v += ' ';
+      v += "field" + std::to_string(f) + "=";
+      size_t off = std::uniform_int_distribution<size_t>(0, 4095)(rng_);
+      v.append(pool_, off, c_.field_length);
+    }
+    return v;
+  }
+
+  bool set(const std::string& key) {
+    std::string cmd = "SET " + key + " " + record() + "\n";
+    return send_all(fd_, cmd.data(), cmd.size()) && rr_.read_line(line_) &&
+           line_ == "OK";
+  }
+
+  bool get(const std::string& key) {
+    std::string cmd = "GET " + key + "\n";
+    return send_all(fd_, cmd.data(), cmd.size()) && rr_.read_line(line_) &&
+           line_.rfind("VALUE ", 0) == 0;
+  }
+
+  // A scan is RANGE from the start record's key when the server runs with
+  // --ordered-index. Otherwise it reads `len` consecutive records with one
+  // pipelined batch of GETs. With no records acked yet (`limit` 0) it is a
+  // miss, like a read of record 0 before it exists.
+  bool scan(uint64_t start, uint64_t len, uint64_t limit) {
+    if (limit == 0) return false;
+    if (use_range_) {
+      std::string cmd = "RANGE " + record_key(c_, start % limit) + " + " +
+                        std::to_string(std::min<uint64_t>(len, 10000)) +
+                        "\n";  // the server's RANGE limit cap
+      if (!send_all(fd_, cmd.data(), cmd.size()) || !rr_.read_line(line_))
+        return false;
+      if (line_.rfind("ARRAY ", 0) == 0) {
+        uint64_t n = std::stoull(line_.substr(6));
+        for (uint64_t i = 0; i < n; i++)
+          if (!rr_.read_line(line_)) return false;
+        return true;
+      }
+      if (line_ != "ERR ordered index disabled") return false;
+      use_range_ = false;
+    }
+    std::string cmd;
+    for (uint64_t i = 0; i < len; i++)
+      cmd += "GET " + record_key(c_, (start + i) % limit) + "\n";
+    if (!send_all(fd_, cmd.data(), cmd.size())) return false;
+    bool ok = true;
+    for (uint64_t i = 0; i < len; i++) {
+      if (!rr_.read_line(line_)) return false;
+      ok = ok && line_.rfind("VALUE ", 0) == 0;
+    }
+    return ok;
+  }
+
+ private:
+  const Config& c_;
+  int fd_;
+  ReplyReader rr_;
+  std::mt19937_64 rng_;
+  std::string pool_;
+  std::string line_;
+  bool use_range_ = true;
+};
+
+void json_op(std::ostream& out, const char* name, const OpStats& s,
+             bool& first) {
+  const HdrHistogram& h = s.hist;
+  if (!first) out << ",\n";
+  first = false;
+  char buf[512];
+  std::snprintf(buf, sizeof(buf),
+                "    \"%s\": {\"count\": %llu, \"errors\": %llu, "
+                "\"mean_us\": %.1f, \"min_us\": %.1f, \"p50_us\": %.1f, "
+                "\"p90_us\": %.1f, \"p95_us\": %.1f, \"p99_us\": %.1f, "
+                "\"p999_us\": %.1f, \"max_us\": %.1f}",
+                name, (unsigned long long)h.count(),
+                (unsigned long long)s.errors, h.mean() / 1000.0,
+                h.min() / 1000.0, h.value_at_percentile(50) / 1000.0,
+                h.value_at_percentile(90) / 1000.0,
+                h.value_at_percentile(95) / 1000.0,
+                h.value_at_percentile(99) / 1000.0,
+                h.value_at_percentile(99.9) / 1000.0, h.max() / 1000.0);
+  out << buf;
+}
+
+int usage() {
+  std::cout
+      << "Usage: ycsb load|run -P WORKLOAD [-p name=value]... [--host H]\n"
+      << "            [--port N] [--threads N] [--json PATH|-]\n"
+      << "Workload files use YCSB core properties: recordcount,\n"
+      << "operationcount, fieldcount, fieldlength, readproportion,\n"
+      << "updateproportion, insertproportion, scanproportion,\n"
+      << "readmodifywriteproportion, requestdistribution (uniform, zipfian,\n"
+      << "latest, hotspot), zipfianconstant, maxscanlength,\n"
+      << "scanlengthdistribution, insertorder (hashed, ordered),\n"
+      << "hotspotdatafraction, hotspotopnfraction.\n";
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) return usage();
+  Config c;
+  std::string phase = argv[1];
+  if (phase == "--help") return usage();
+  if (phase != "load" && phase != "run") {
+    std::cerr << "first argument must be 'load' or 'run'\n";
+    return 1;
+  }
+  c.run = phase == "run";
+
+  Properties props;
+  std::vector<std::string> overrides;
+  for (int i = 2; i < argc; i++) {
+    std::string a = argv[i];
+    auto need = [&]() {
+      if (i + 1 >= argc) {
+        std::cerr << "Missing value for " << a << "\n";
+        std::exit(1);
+      }
+      return std::string(argv[++i]);
+    };
+    if (a == "-P") {
+      std::string path = need();
+      if (!props.load(path)) {
+        std::cerr << "cannot read workload file " << path << "\n";
+        return 1;
+      }
+      c.workload_name = path.substr(path.find_last_of('/') + 1);
+    } else if (a == "-p")
+      overrides.push_back(need());
+    else if (a == "--host")
+      c.host = need();
+    else if (a == "--port")
+      c.port = std::stoi(need());
+    else if (a == "--threads")
+      c.threads = std::stoi(need());
+    else if (a == "--json")
+      c.json_path = need();
+    else if (a == "--help")
+      return usage();
+  }
+  for (auto& o : overrides) {
+    if (!props.set_assignment(o)) {
+      std::cerr << "bad -p override: " << o << "\n";
+      return 1;
+    }
+  }
+
+  c.record_count = props.u64("recordcount", c.record_count);
+  c.operation_count = props.u64("operationcount", c.operation_count);
+  c.field_count = static_cast<int>(props.u64("fieldcount", c.field_count));
+  c.field_length = props.u64("fieldlength", c.field_length);
+  c.hashed_keys = props.str("insertorder", "hashed") != "ordered";
+  c.request_dist = props.str("requestdistribution", c.request_dist);
+  c.zipf_theta = props.num("zipfianconstant", c.zipf_theta);
+  c.hot_data = props.num("hotspotdatafraction", c.hot_data);
+  c.hot_ops = props.num("hotspotopnfraction", c.hot_ops);
+  c.max_scan = props.u64("maxscanlength", c.max_scan);
+  c.scan_dist = props.str("scanlengthdistribution", c.scan_dist);
+  c.proportion[kRead] = props.num("readproportion", c.proportion[kRead]);
+  c.proportion[kUpdate] = props.num("updateproportion", c.proportion[kUpdate]);
+  c.proportion[kInsert] = props.num("insertproportion", 0);
+  c.proportion[kScan] = props.num("scanproportion", 0);
+  c.proportion[kReadModifyWrite] = props.num("readmodifywriteproportion", 0);
+
+  if (c.request_dist != "uniform" && c.request_dist != "zipfian" &&
+      c.request_dist != "latest" && c.request_dist != "hotspot") {
+    std::cerr << "unsupported requestdistribution " << c.request_dist << "\n";
+    return 1;
+  }
+  if (c.threads < 1) c.threads = 1;
+  if (c.field_count * (c.field_length + 8) + 64 > 8192) {
+    std::cerr << "record does not fit the server's 8192-byte line limit\n";
+    return 1;
+  }
+
+  double total_prop = 0;
+  for (double p : c.proportion) total_prop += p;
+  if (c.run && total_prop <= 0) {
+    std::cerr << "workload has no operations\n";
+    return 1;
+  }
+
+  // Inserts in the run phase extend the loaded keys.
+  AckedCounter acked(c.run ? c.record_count : 0);
+  std::atomic<uint64_t> next_insert{c.record_count};
+  std::atomic<int> failed_conns{0};
+
+  std::mutex mu;
+  std::vector<OpStats> totals(kOps);
+
+  auto worker = [&](int id) {
+    int fd = connect_to(c.host, c.port);
+    if (fd < 0) {
+      failed_conns.fetch_add(1);
+      return;
+    }
+    Client cl(c, fd, 7919 * (id + 1) + (c.run ? 1 : 0));
+    cl.read_banner();
+
+    std::vector<OpStats> local(kOps);
+    auto timed = [&](Op op, auto fn) {
+      auto t = Clock::now();
+      bool ok = fn();
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - t)
+                    .count();
+      local[op].hist.record(static_cast<uint64_t>(ns));
+      if (!ok) local[op].errors++;
+    };
+
+    if (!c.run) {
+      uint64_t lo = c.record_count * id / c.threads;
+      uint64_t hi = c.record_count * (id + 1) / c.threads;
+      for (uint64_t k = lo; k < hi; k++)
+        timed(kInsert, [&] { return cl.set(record_key(c, k)); });
+    } else {
+      RecordChooser chooser(c, acked);
+      ZipfianGenerator scan_zipf(c.max_scan, c.zipf_theta);
+      std::uniform_real_distribution<double> pick(0.0, total_prop);
+      uint64_t ops = c.operation_count * (id + 1) / c.threads -
+                     c.operation_count * id / c.threads;
+      auto& rng = cl.rng();
+
+      for (uint64_t i = 0; i < ops; i++) {
+        double r = pick(rng);
+        int op = 0;
+        while (op < kOps - 1 && r >= c.proportion[op]) r -= c.proportion[op++];
+
+        switch (op) {
+          case kRead:
+            timed(kRead,
+                  [&] { return cl.get(record_key(c, chooser.next(rng))); });
+            break;
+          case kUpdate:
+            timed(kUpdate,
+                  [&] { return cl.set(record_key(c, chooser.next(rng))); });
+            break;
+          case kInsert: {
+            uint64_t k = next_insert.fetch_add(1);
+            bool ok = false;
+            timed(kInsert, [&] { return ok = cl.set(record_key(c, k)); });
+            if (ok) acked.ack(k);
+            break;
+          }
+          case kScan: {
+            uint64_t start = chooser.next(rng);
+            uint64_t len =
+                c.scan_dist == "zipfian"
+                    ? scan_zipf.next(rng) + 1
+                    : std::uniform_int_distribution<uint64_t>(1, c.max_scan)(
+                          rng);
+            uint64_t limit = acked.last();
+            timed(kScan, [&] { return cl.scan(start, len, limit); });
+            break;
+          }
+          case kReadModifyWrite: {
+            std::string key = record_key(c, chooser.next(rng));
+            timed(kReadModifyWrite,
+                  [&] { return cl.get(key) && cl.set(key); });
+            break;
+          }
+        }
+      }
+    }
+
+    close(fd);
+    std::lock_guard<std::mutex> lk(mu);
+    for (int o = 0; o < kOps; o++) {
+      totals[o].hist.merge(local[o].hist);
+      totals[o].errors += local[o].errors;
+    }
+  };
+
+  auto t0 = Clock::now();
+  std::vector<std::thread> ts;
+  for (int i = 0; i < c.threads; i++) ts.emplace_back(worker, i);
+  for (auto& t : ts) t.join();
+  double sec = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  if (failed_conns.load() > 0) {
+    std::cerr << failed_conns.load() << " connection(s) failed\n";
+    return 1;
+  }
+
+  uint64_t total_ops = 0;
+  for (auto& s : totals) total_ops += s.hist.count();
+
+  // Human-readable summary, YCSB style.
+  std::ostream& human = (c.json_path == "-") ? std::cerr : std::cout;
+  human << "[OVERALL] Phase " << phase << "\n";
+  human << "[OVERALL] RunTime(ms), " << static_cast<uint64_t>(sec * 1000)
+        << "\n";
+  human << "[OVERALL] Throughput(ops/sec), " << total_ops / sec << "\n";
+  for (int o = 0; o < kOps; o++) {
+    const auto& h = totals[o].hist;
+    if (h.count() == 0) continue;
+    human << "[" << kOpNames[o] << "] Operations, " << h.count() << "\n";
+    human << "[" << kOpNames[o] << "] AverageLatency(us), "
+          << h.mean() / 1000.0 << "\n";
+    human << "[" << kOpNames[o] << "] 95thPercentileLatency(us), "
+          << h.value_at_percentile(95) / 1000.0 << "\n";
+    human << "[" << kOpNames[o] << "] 99thPercentileLatency(us), "
+          << h.value_at_percentile(99) / 1000.0 << "\n";
+    human << "[" << kOpNames[o] << "] Errors, " << totals[o].errors << "\n";
+  }
+
+  if (!c.json_path.empty()) {
+    std::ofstream file;
+    if (c.json_path != "-") {
+      file.open(c.json_path);
+      if (!file) {
+        std::cerr << "cannot write " << c.json_path << "\n";
+        return 1;
+      }
+    }
+    std::ostream& out = (c.json_path == "-") ? std::cout : file;
+    out << "{\n";
+    out << "  \"workload\": \"" << c.workload_name << "\",\n";
+    out << "  \"phase\": \"" << phase << "\",\n";
+    out << "  \"threads\": " << c.threads << ",\n";
+    out << "  \"recordcount\": " << c.record_count << ",\n";
+    out << "  \"operationcount\": " << (c.run ? c.operation_count : 0)
+        << ",\n";
+    out << "  \"runtime_sec\": " << sec << ",\n";
+    out << "  \"throughput_ops\": " << total_ops / sec << ",\n";
+    out << "  \"operations\": {\n";
+    bool first = true;
+    for (int o = 0; o < kOps; o++)
+      if (totals[o].hist.count() > 0)
+        json_op(out, kOpNames[o], totals[o], first);
+    out << "\n  }\n}\n";
+  }
+  return 0;
+}
@@ -0,0 +1,603 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Adaptive radix tree from byte-string keys to V, with the same interface
+// as HashTable (the hash argument is ignored) plus ordered walks.
+//
+// Inner nodes hold 4, 16, 48 or 256 children and switch size as they fill
+// or drain; Node16 is searched with one SSE2 compare. Paths are compressed:
+// an inner node stores the bytes shared by everything below it, and a leaf
+// stores only the key bytes left after its position in the tree, so keys
+// with long common prefixes ("tenant:1234:user:...") share them. A key that
+// ends at an inner node is kept in that node's `term` slot. Not
+// thread-safe.
+template <typename V>
+class ArtTree {
+ public:
+  ArtTree() = default;
+  ~ArtTree() { clear(); }
+  ArtTree(const ArtTree&) = delete;
+  ArtTree& operator=(const ArtTree&) = delete;
+
+  V* find(std::string_view key, uint64_t /*hash*/) {
+    Node* n = root_;
+    size_t depth = 0;
+    while (n) {
+      if (n->type == Type::kLeaf) {
+        Leaf* l = static_cast<Leaf*>(n);
+        return l->suffix() == key.substr(depth) ? &l->value : nullptr;
+      }
+      Inner* in = static_cast<Inner*>(n);
+      const std::string& pre = in->prefix;
+      if (key.size() - depth < pre.size() ||
+          key.compare(depth, pre.size(), pre) != 0)
+        return nullptr;
+      depth += pre.size();
+      if (depth == key.size()) return in->term ? &in->term->value : nullptr;
+      Node** child = find_child(in, static_cast<uint8_t>(key[depth]));
+      if (!child) return nullptr;
+      n = *child;
+      depth++;
+    }
+    return nullptr;
+  }
+  const V* find(std::string_view key, uint64_t hash) const {
+    return const_cast<ArtTree*>(this)->find(key, hash);
+  }
+
+  // No bucket array to warm up; present so batch lookups compile for
+  // either table.
+  void prefetch_bucket(uint64_t) const {}
+  void prefetch_head(uint64_t) const {}
+
+  // Returns the value slot for `key`, default-constructing it if absent.
+  std::pair<V*, bool> try_emplace(std::string_view key, uint64_t /*hash*/) {
+    Node** ref = &root_;
+    size_t depth = 0;
+    for (;;) {
+      Node* n = *ref;
+      if (!n) {
+        Leaf* l = make_leaf(key.substr(depth), V());
+        *ref = l;
+        size_++;
+        return {&l->value, true};
+      }
+
+      if (n->type == Type::kLeaf) {
+        // Split the leaf into a Node4 holding the shared bytes.
+        Leaf* old = static_cast<Leaf*>(n);
+        std::string_view have = old->suffix(), want = key.substr(depth);
+        if (have == want) return {&old->value, false};
+        size_t p = common_prefix(have, want);
+        Node4* in = new Node4;
+        in->prefix.assign(want.data(), p);
+        place(in, have, p, std::move(old->value));
+        Leaf* l = place(in, want, p, V());
+        free_leaf(old);
+        *ref = in;
+        size_++;
+        return {&l->value, true};
+      }
+
+      Inner* in = static_cast<Inner*>(n);
+      const size_t m = common_prefix(in->prefix, key.substr(depth));
+      if (m < in->prefix.size()) {
+        // The key leaves this node's prefix at byte m: split the prefix.
+        Node4* top = new Node4;
+        top->prefix = in->prefix.substr(0, m);
+        const uint8_t b = static_cast<uint8_t>(in->prefix[m]);
+        in->prefix.erase(0, m + 1);
+        add_sorted(top, b, in);
+        Leaf* l = place(top, key.substr(depth), m, V());
+        *ref = top;
+        size_++;
+        return {&l->value, true};
+      }
+
+      depth += in->prefix.size();
+      if (depth == key.size()) {
+        if (in->term) return {&in->term->value, false};
+        in->term = make_leaf({}, V());
+        size_++;
+        return {&in->term->value, true};
+      }
+      const uint8_t c = static_cast<uint8_t>(key[depth]);
+      if (Node** child = find_child(in, c)) {
+        ref = child;
+        depth++;
+        continue;
+      }
+      Leaf* l = make_leaf(key.substr(depth + 1), V());
+      add_child(ref, c, l);
+      size_++;
+      return {&l->value, true};
+    }
+  }
+
+  bool erase(std::string_view key, uint64_t /*hash*/) {
+    if (!erase_at(&root_, key, 0)) return false;
+    size_--;
+    return true;
+  }
+
+  size_t size() const { return size_; }
+
+  void swap(ArtTree& other) {
+    std::swap(root_, other.root_);
+    std::swap(size_, other.size_);
+  }
+
+  void clear() {
+    destroy(root_);
+    root_ = nullptr;
+    size_ = 0;
+  }
+
+  // Calls f(key, value) for every entry, in key order.
+  template <typename F>
+  void for_each(F&& f) const {
+    std::string buf;
+    auto all = [&](const std::string& k, const V& v) {
+      f(k, v);
+      return true;
+    };
+    walk_node(root_, buf, {}, false, all);
+  }
+
+  // Calls f(key, value) in key order for keys >= start until f returns
+  // false.
+  template <typename F>
+  void walk(std::string_view start, F&& f) const {
+    std::string buf;
+    walk_node(root_, buf, start, true, f);
+  }
+
+ private:
+  enum class Type : uint8_t { kLeaf, kNode4, kNode16, kNode48, kNode256 };
+
+  struct Node {
+    Type type;
+  };
+  // The suffix bytes are allocated right after the struct.
+  struct Leaf : Node {
+    uint32_t len;  // packs next to `type`
+    V value;
+    char* bytes() { return reinterpret_cast<char*>(this + 1); }
+    std::string_view suffix() const {
+      return {const_cast<Leaf*>(this)->bytes(), len};
+    }
+  };
+  struct Inner : Node {
+    uint16_t count = 0;
+    std::string prefix;   // bytes shared by every key below
+    Leaf* term = nullptr;  // the key that ends exactly here
+  };
+  struct Node4 : Inner {
+    Node4() { this->type = Type::kNode4; }
+    uint8_t keys[4] = {};
+    Node* child[4] = {};
+  };
+  struct Node16 : Inner {
+    Node16() { this->type = Type::kNode16; }
+    uint8_t keys[16] = {};
+    Node* child[16] = {};
+  };
+  struct Node48 : Inner {
+    Node48() { this->type = Type::kNode48; }
+    uint8_t index[256] = {};  // slot + 1; 0 = no child
+    Node* child[48] = {};
+  };
+  struct Node256 : Inner {
+    Node256() { this->type = Type::kNode256; }
+    Node* child[256] = {};
+  };
+
+  static size_t common_prefix(std::string_view a, std::string_view b) {
+    size_t n = std::min(a.size(), b.size()), i = 0;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+  }
+
+  static Leaf* make_leaf(std::string_view suffix, V&& value) {
+    void* mem = ::operator new(sizeof(Leaf) + suffix.size());
+    Leaf* l = new (mem) Leaf;
+    l->type = Type::kLeaf;
+    l->value = std::move(value);
+    l->len = static_cast<uint32_t>(suffix.size());
+    if (!suffix.empty())
+      std::memcpy(l->bytes(), suffix.data(), suffix.size());
+    return l;
+  }
+  static void free_leaf(Leaf* l) {
+    l->~Leaf();
+    ::operator delete(l);
+  }
+
+  // Puts a new leaf for `rem` (the key from this node's depth on) under a
+  // fresh Node4 whose prefix is rem[0..p).
+  static Leaf* place(Node4* in, std::string_view rem, size_t p, V&& value) {
+    if (rem.size() == p) return in->term = make_leaf({}, std::move(value));
+    Leaf* l = make_leaf(rem.substr(p + 1), std::move(value));
+    add_sorted(in, static_cast<uint8_t>(rem[p]), l);
+    return l;
+  }
+
+  template <typename N>
+  static void add_sorted(N* n, uint8_t c, Node* child) {
+    int i = n->count;
+    while (i > 0 && n->keys[i - 1] > c) {
+      n->keys[i] = n->keys[i - 1];
+      n->child[i] = n->child[i - 1];
+      i--;
+    }
+    n->keys[i] = c;
+    n->child[i] = child;
+    n->count++;
+  }
+
+  static Node** find_child(Inner* in, uint8_t c) {
+    switch (in->type) {
+      case Type::kNode4: {
+        Node4* n = static_cast<Node4*>(in);
+        for (int i = 0; i < n->count; i++)
+          if (n->keys[i] == c) return &n->child[i];
+        return nullptr;
+      }
+      case Type::kNode16: {
+        Node16* n = static_cast<Node16*>(in);
+#if defined(__SSE2__)
+        __m128i eq = _mm_cmpeq_epi8(
+            _mm_set1_epi8(static_cast<char>(c)),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(n->keys)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(eq)) &
+                        ((1u << n->count) - 1);
+        return mask ? &n->child[__builtin_ctz(mask)] : nullptr;
+#else
+        for (int i = 0; i < n->count; i++)
+          if (n->keys[i] == c) return &n->child[i];
+        return nullptr;
+#endif
+      }
+      case Type::kNode48: {
+        Node48* n = static_cast<Node48*>(in);
+        return n->index[c] ? &n->child[n->index[c] - 1] : nullptr;
+      }
+      case Type::kNode256: {
+        Node256* n = static_cast<Node256*>(in);
+        return n->child[c] ? &n->child[c] : nullptr;
+      }
+      default:
+        return nullptr;
+    }
+  }
+
+  static void move_header(Inner* from, Inner* to) {
+    to->count = 0;
+    to->prefix = std::move(from->prefix);
+    to->term = from->term;
+  }
+
+  // Calls f(byte, child) for each child in byte order; stops when f
+  // returns false.
+  template <typename F>
+  static bool each_child(const Inner* in, F&& f) {
+    switch (in->type) {
+      case Type::kNode4: {
+        auto* n = static_cast<const Node4*>(in);
+        for (int i = 0; i < n->count; i++)
+          if (!f(n->keys[i], n->child[i])) return false;
+        return true;
+      }
+      case Type::kNode16: {
+        auto* n = static_cast<const Node16*>(in);
+        for (int i = 0; i < n->count; i++)
+          if (!f(n->keys[i], n->child[i])) return false;
+        return true;
+      }
+      case Type::kNode48: {
+        auto* n = static_cast<const Node48*>(in);
+        for (int c = 0; c < 256; c++)
+          if (n->index[c] &&
+              !f(static_cast<uint8_t>(c), n->child[n->index[c] - 1]))
+            return false;
+        return true;
+      }
+      case Type::kNode256: {
+        auto* n = static_cast<const Node256*>(in);
+        for (int c = 0; c < 256; c++)
+          if (n->child[c] && !f(static_cast<uint8_t>(c), n->child[c]))
+            return false;
+        return true;
+      }
+      default:
+        return true;
+    }
+  }
+
+  // Adds a child to *ref, replacing it with the next node size when full.
+  static void add_child(Node** ref, uint8_t c, Node* child) {
+    Inner* in = static_cast<Inner*>(*ref);
+    switch (in->type) {
+      case Type::kNode4: {
+        Node4* n = static_cast<Node4*>(in);
+        if (n->count < 4) return add_sorted(n, c, child);
+        Node16* g = new Node16;
+        move_header(n, g);
+        each_child(n, [&](uint8_t k, Node* ch) {
+          add_sorted(g, k, ch);
+          return true;
+        });
+        delete n;
+        *ref = g;
+        return add_sorted(g, c, child);
+      }
+      case Type::kNode16: {
+        Node16* n = static_cast<Node16*>(in);
+        if (n->count < 16) return add_sorted(n, c, child);
+        Node48* g = new Node48;
+        move_header(n, g);
+        each_child(n, [&](uint8_t k, Node* ch) {
+          add48(g, k, ch);
+          return true;
+        });
+        delete n;
+        *ref = g;
+        return add48(g, c, child);
+      }
+      case Type::kNode48: {
+        Node48* n = static_cast<Node48*>(in);
+        if (n->count < 48) return add48(n, c, child);
+        Node256* g = new Node256;
+        move_header(n, g);
+        each_child(n, [&](uint8_t k, Node* ch) {
+          g->child[k] = ch;
+          g->count++;
+          return true;
+        });
+        delete n;
+        *ref = g;
+        g->child[c] = child;
+        g->count++;
+        return;
+      }
+      case Type::kNode256: {
+        Node256* n = static_cast<Node256*>(in);
+        n->child[c] = child;
+        n->count++;
+        return;
+      }
+      default:
+        return;
+    }
+  }
+
+  static void add48(Node48* n, uint8_t c, Node* child) {
+    int slot = 0;
+    while (n->child[slot]) slot++;
+    n->child[slot] = child;
+    n->index[c] = static_cast<uint8_t>(slot + 1);
+    n->count++;
+  }
+
+  // Removes the (now empty) child slot for `c` and drops to a smaller node
+  // size once the node is a quarter-ish full.
+  static void remove_child(Node** ref, uint8_t c) {
+    Inner* in = static_cast<Inner*>(*ref);
+    switch (in->type) {
+      case Type::kNode4:
+      case Type::kNode16: {
+        uint8_t* keys = in->type == Type::kNode4
+                            ? static_cast<Node4*>(in)->keys
+                            : static_cast<Node16*>(in)->keys;
+        Node** child = in->type == Type::kNode4
+                           ? static_cast<Node4*>(in)->child
+                           : static_cast<Node16*>(in)->child;
+        int i = 0;
+        while (keys[i] != c) i++;
+        for (; i + 1 < in->count; i++) {
+          keys[i] = keys[i + 1];
+          child[i] = child[i + 1];
+        }
+        in->count--;
+        if (in->type == Type::kNode16 && in->count <= 3)
+          shrink<Node16, Node4>(ref);
+        return;
+      }
+      case Type::kNode48: {
+        Node48* n = static_cast<Node48*>(in);
+        n->child[n->index[c] - 1] = nullptr;
+        n->index[c] = 0;
+        n->count--;
+        if (n->count <= 12) shrink<Node48, Node16>(ref);
+        return;
+      }
+      case Type::kNode256: {
+        Node256* n = static_cast<Node256*>(in);
+        n->child[c] = nullptr;
+        n->count--;
+        if (n->count <= 37) shrink<Node256, Node48>(ref);
+        return;
+      }
+      default:
+        return;
+    }
+  }
+
+  template <typename From, typename To>
+  static void shrink(Node** ref) {
+    From* n = static_cast<From*>(*ref);
+    To* s = new To;
+    move_header(n, s);
+    each_child(n, [&](uint8_t k, Node* ch) {
+      if constexpr (std::is_same_v<To, Node48>)
+        add48(s, k, ch);
+      else
+        add_sorted(s, k, ch);
+      return true;
+    });
+    delete n;
+    *ref = s;
+  }
+
+  static void delete_inner(Inner* in) {
+    switch (in->type) {
+      case Type::kNode4:
+        delete static_cast<Node4*>(in);
+        break;
+      case Type::kNode16:
+        delete static_cast<Node16*>(in);
+        break;
+      case Type::kNode48:
+        delete static_cast<Node48*>(in);
+        break;
+      case Type::kNode256:
+        delete static_cast<Node256*>(in);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // After an erase below *ref: removes a node left with no keys and merges
+  // a node left with a single path into what is below it.
+  static void compact(Node** ref) {
+    Inner* in = static_cast<Inner*>(*ref);
+    if (in->count == 0) {
+      if (in->term) {
+        Leaf* l = make_leaf(in->prefix, std::move(in->term->value));
+        free_leaf(in->term);
+        *ref = l;
+      } else {
+        *ref = nullptr;
+      }
+      delete_inner(in);
+      return;
+    }
+    if (in->count > 1 || in->term) return;
+
+    uint8_t b = 0;
+    Node* only = nullptr;
+    each_child(in, [&](uint8_t k, Node* ch) {
+      b = k;
+      only = ch;
+      return false;
+    });
+    std::string pre = std::move(in->prefix);
+    pre += static_cast<char>(b);
+    if (only->type == Type::kLeaf) {
+      Leaf* old = static_cast<Leaf*>(only);
+      pre.append(old->suffix().data(), old->suffix().size());
+      *ref = make_leaf(pre, std::move(old->value));
+      free_leaf(old);
+    } else {
+      Inner* child = static_cast<Inner*>(only);
+      child->prefix.insert(0, pre);
+      *ref = child;
+    }
+    delete_inner(in);
+  }
+
+  static bool erase_at(Node** ref, std::string_view key, size_t depth) {
+    Node* n = *ref;
+    if (!n) return false;
+    if (n->type == Type::kLeaf) {
+      Leaf* l = static_cast<Leaf*>(n);
+      if (l->suffix() != key.substr(depth)) return false;
+      free_leaf(l);
+      *ref = nullptr;
+      return true;
+    }
+    Inner* in = static_cast<Inner*>(n);
+    const std::string& pre = in->prefix;
+    if (key.size() - depth < pre.size() ||
+        key.compare(depth, pre.size(), pre) != 0)
+      return false;
+    depth += pre.size();
+    if (depth == key.size()) {
+      if (!in->term) return false;
+      free_leaf(in->term);
+      in->term = nullptr;
+      compact(ref);
+      return true;
+    }
+    const uint8_t c = static_cast<uint8_t>(key[depth]);
+    Node** child = find_child(in, c);
+    if (!child || !erase_at(child, key, depth + 1)) return false;
+    if (!*child) remove_child(ref, c);
+    compact(ref);
+    return true;
+  }
+
+  static void destroy(Node* n) {
+    if (!n) return;
+    if (n->type == Type::kLeaf) return free_leaf(static_cast<Leaf*>(n));
+    Inner* in = static_cast<Inner*>(n);
+    if (in->term) free_leaf(in->term);
+    each_child(in, [](uint8_t, Node* ch) {
+      destroy(ch);
+      return true;
+    });
+    delete_inner(in);
+  }
+
+  // In-order walk. `buf` holds the key bytes down to `n`. While `bounded`,
+  // the path equals `start` so far and smaller subtrees are skipped.
+  template <typename F>
+  static bool walk_node(const Node* n, std::string& buf,
+                        std::string_view start, bool bounded, F& f) {
+    if (!n) return true;
+    const size_t old = buf.size();
+    if (n->type == Type::kLeaf) {
+      const Leaf* l = static_cast<const Leaf*>(n);
+      std::string_view s = l->suffix();
+      buf.append(s.data(), s.size());
+      bool go = true;
+      if (!bounded || std::string_view(buf) >= start) go = f(buf, l->value);
+      buf.resize(old);
+      return go;
+    }
+
+    const Inner* in = static_cast<const Inner*>(n);
+    buf += in->prefix;
+    const size_t len = buf.size();
+    if (bounded) {
+      const size_t k = std::min(len, start.size());
+      int cmp = std::string_view(buf).substr(0, k).compare(start.substr(0, k));
+      if (cmp < 0) {  // everything below sorts before start
+        buf.resize(old);
+        return true;
+      }
+      if (cmp > 0 || start.size() <= len) bounded = false;
+    }
+
+    bool go = true;
+    if (in->term && !bounded) go = f(buf, in->term->value);
+    if (go) {
+      const uint8_t first = bounded ? static_cast<uint8_t>(start[len]) : 0;
+      go = each_child(in, [&](uint8_t c, const Node* ch) {
+        if (c < first) return true;
+        buf.push_back(static_cast<char>(c));
+        bool more = walk_node(ch, buf, start, bounded && c == first, f);
+        buf.pop_back();
+        return more;
+      });
+    }
+    buf.resize(old);
+    return go;
+  }
+
+  Node* root_ = nullptr;
+  size_t size_ = 0;
+};
@@ -19,6 +19,15 @@ class BlockingQueue {
     return true;
   }
 
+  // Never waits: returns false if the queue is full or closed.
+  bool try_push(T& item) {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (closed_ || q_.size() >= capacity_) return false;
+    q_.push_back(std::move(item));
+    cv_not_empty_.notify_one();
+    return true;
+  }
+
   // Returns nullopt if closed and empty.
   std::optional<T> pop() {
     std::unique_lock<std::mutex> lk(mu_);
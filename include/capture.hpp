@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Single-producer single-consumer byte ring holding captured requests until
+// the writer thread encodes them. Each worker thread owns one ring, so the
+// request path never takes a lock; when a ring is full the record is
+// dropped rather than stalling the connection.
+class CaptureRing {
+ public:
+  explicit CaptureRing(size_t capacity);  // rounded up to a power of two
+
+  // Producer side. Returns false (record dropped) when there is no room.
+  bool push(uint64_t ts_us, uint32_t conn, std::string_view line,
+            std::string_view payload);
+
+  // Consumer side: appends every complete record in the file format.
+  size_t drain(std::string& out);
+
+ private:
+  struct Header {
+    uint64_t ts_us;
+    uint32_t conn;
+    uint32_t len;
+  };
+
+  void put(uint64_t pos, const void* src, size_t n);
+  void get(uint64_t pos, void* dst, size_t n) const;
+
+  std::vector<char> buf_;
+  size_t mask_;
+  alignas(64) std::atomic<uint64_t> head_{0};  // written by the producer
+  alignas(64) std::atomic<uint64_t> tail_{0};  // written by the consumer
+};
+
+// Records incoming requests to a capture file (see capture_format.hpp)
+// through per-thread rings and a background writer thread.
+class Capture {
+ public:
+  ~Capture();
+
+  bool start(const std::string& path, size_t ring_bytes = size_t(4) << 20);
+  void stop();  // drains every ring, then closes the file
+  bool active() const { return active_.load(std::memory_order_acquire); }
+
+  uint32_t new_connection() { return next_conn_.fetch_add(1) + 1; }
+  void record(uint32_t conn, std::string_view line, std::string_view payload);
+
+  uint64_t records() const { return records_.load(); }
+  uint64_t dropped() const { return dropped_.load(); }
+
+ private:
+  CaptureRing& local_ring();
+  void writer_loop();
+  size_t drain_all(std::string& out);
+
+  std::FILE* file_ = nullptr;
+  size_t ring_bytes_ = 0;
+  uint64_t generation_ = 0;
+  std::chrono::steady_clock::time_point start_;
+  std::atomic<bool> active_{false};
+  std::atomic<uint32_t> next_conn_{0};
+  std::atomic<uint64_t> records_{0};
+  std::atomic<uint64_t> dropped_{0};
+
+  std::mutex rings_mu_;
+  std::vector<std::unique_ptr<CaptureRing>> rings_;
+  std::thread writer_;
+};
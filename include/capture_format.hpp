@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Traffic capture file format, shared by the server (writer) and `replay`.
+//
+//   file   := magic record*
+//   magic  := "TKVCAP1\n"
+//   record := varint(ts_us) varint(conn_id) varint(len) bytes[len]
+//
+// ts_us is microseconds since the capture started. bytes is the request
+// exactly as it arrived: the line plus '\n', followed by any SETB payload.
+// Records of one connection appear in arrival order; records of different
+// connections may interleave slightly out of timestamp order.
+
+constexpr char kCaptureMagic[] = "TKVCAP1\n";
+constexpr size_t kCaptureMagicLen = 8;
+
+inline void put_varint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out += static_cast<char>((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  out += static_cast<char>(v);
+}
+
+inline bool read_varint(std::FILE* f, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = std::fgetc(f);
+    if (c == EOF) return false;
+    v |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+  }
+  return false;
+}
+
+struct CaptureRecord {
+  uint64_t ts_us = 0;
+  uint32_t conn = 0;
+  std::string bytes;
+};
+
+// Returns false at end of file or on a truncated record.
+inline bool read_capture_record(std::FILE* f, CaptureRecord& r) {
+  uint64_t conn = 0, len = 0;
+  if (!read_varint(f, r.ts_us) || !read_varint(f, conn) ||
+      !read_varint(f, len))
+    return false;
+  r.conn = static_cast<uint32_t>(conn);
+  r.bytes.resize(len);
+  return len == 0 || std::fread(&r.bytes[0], 1, len, f) == len;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jobs.hpp"
+
+class KVStore;
+class Parker;
+class Stats;
+struct ParkTicket;
+class StoredValue;
+
+// A request line split into an upper-cased command name and its arguments.
+// Arguments are views into the request line, which must outlive the Command.
+struct Command {
+  std::string name;
+  std::vector<std::string_view> args;
+  std::string_view line;
+  std::string payload;  // raw bytes that followed the line (SETB)
+
+  // Raw text after argument `i`, minus one separating space (SET values).
+  std::string_view rest_after(size_t i) const;
+};
+
+struct Reply {
+  enum class Kind {
+    kOk,
+    kPong,
+    kValue,
+    kNotFound,
+    kError,
+    kRaw,
+    kBye,
+    kBlob,
+    kBlobLz,
+    kArray,
+    kBlocked  // BLPOP found nothing: the connection parks on `ticket`
+  };
+
+  Kind kind = Kind::kOk;
+  std::string text;  // value, error message, or preformatted body
+  std::shared_ptr<const std::string> blob;  // kBlob: length-prefixed value
+  size_t raw_len = 0;                       // kBlobLz: size once decoded
+  std::vector<std::string> items;           // kArray: one line each
+  std::shared_ptr<ParkTicket> ticket;       // kBlocked
+
+  Reply() = default;
+  Reply(Kind k, std::string t) : kind(k), text(std::move(t)) {}
+
+  static Reply ok() { return {Kind::kOk, {}}; }
+  static Reply error(std::string msg) { return {Kind::kError, std::move(msg)}; }
+  static Reply of_blob(std::shared_ptr<const std::string> v) {
+    Reply r;
+    r.kind = Kind::kBlob;
+    r.blob = std::move(v);
+    return r;
+  }
+};
+
+// Returns false for a blank line. `out` is reused to avoid reallocating.
+bool parse_command(std::string_view line, Command& out);
+
+// Appends the wire form of `r` to `out`.
+void format_reply(const Reply& r, std::string& out);
+
+// Appends "VALUEB <len>\n", the header sent before a kBlob body.
+void format_blob_header(size_t len, std::string& out);
+
+// Appends "VALUEZ <raw_len> <len>\n", sent before a kBlobLz body: an LZ4
+// block of len bytes that decodes to raw_len bytes.
+void format_blob_lz_header(size_t raw_len, size_t len, std::string& out);
+
+// Appends "ARRAY <n>\n"; n element lines follow (kArray replies).
+void format_array_header(size_t n, std::string& out);
+
+// RANGE/PREFIX result counts when no limit is given, and the most allowed.
+constexpr size_t kDefaultScanLimit = 100;
+constexpr size_t kMaxScanLimit = 10000;
+// Entries SCAN walks per call when no COUNT is given. COUNT is capped at
+// kMaxScanLimit, like a RANGE/PREFIX limit.
+constexpr size_t kDefaultScanCount = 10;
+
+// Largest SETB payload accepted unless the server overrides it.
+constexpr size_t kDefaultMaxValueBytes = size_t(512) << 20;
+
+// Executes parsed commands against a store. The three stages (parse,
+// execute, format) are separate so benchmarks can attribute time to each.
+class CommandEngine {
+ public:
+  CommandEngine(KVStore& kv, Stats& stats);
+
+  void set_threads(int threads) { threads_ = threads; }
+  void set_max_value_bytes(size_t n) { max_value_bytes_ = n; }
+  // Enables BLPOP; without a parker it replies with an error.
+  void set_parker(Parker* p) { parker_ = p; }
+  Parker* parker() const { return parker_; }
+
+  // Length of the raw payload that follows `cmd`'s line on the wire (0 for
+  // line-only commands). Returns false when the declared length is
+  // malformed or over the limit; the stream can't be resynced after that.
+  bool payload_size(const Command& cmd, size_t& len) const;
+
+  // May move cmd.payload into the store.
+  Reply execute(Command& cmd);
+
+  // Executes cmds[0..n) in order into replies[0..n). Runs of consecutive
+  // SET/SETB/DEL are applied with KVStore::apply, so a pipelined batch of
+  // writes takes each shard lock once instead of once per write; runs of
+  // GETs are looked up together with KVStore::get_many.
+  void execute_batch(Command* cmds, size_t n, std::vector<Reply>& replies);
+
+  // parse + execute + format for one line. A BLPOP that would block
+  // replies at once, as if its timeout had passed.
+  std::string handle(std::string_view line);
+
+  // Every kBlocked reply's ticket must end in Parker::park or one of these.
+  // end_wait: the wait is over (or is given up); returns the BLPOP reply,
+  // the element if a push served one. abandon_wait: the reply can't be
+  // delivered; a served element goes back to the head of its list.
+  Reply end_wait(const std::shared_ptr<ParkTicket>& t);
+  void abandon_wait(const std::shared_ptr<ParkTicket>& t);
+
+ private:
+  void apply_writes(Command* cmds, size_t begin, size_t end,
+                    std::vector<Reply>& replies);
+  void get_batch(Command* cmds, size_t begin, size_t end,
+                 std::vector<Reply>& replies);
+  Reply scan_reply(std::string_view start, std::string_view end,
+                   size_t limit);
+  // HSET, HGET, HMGET, HGETALL, HDEL, HLEN.
+  Reply hash_command(const Command& cmd);
+  // ZADD, ZINCRBY, ZREM, ZSCORE, ZCARD, ZRANK, ZRANGE, ZRANGEBYSCORE.
+  Reply zset_command(const Command& cmd);
+  // LPUSH, RPUSH, LPOP, RPOP, LLEN, LRANGE, BLPOP.
+  Reply list_command(const Command& cmd);
+  // Hands elements of the list `v` at `key` to blocked BLPOPs. Caller holds
+  // the shard lock (inside KVStore::modify).
+  void serve_waiters(std::string_view key, StoredValue& v);
+
+  KVStore& kv_;
+  Stats& stats_;
+  JobManager jobs_;
+  int threads_ = 0;
+  size_t max_value_bytes_ = kDefaultMaxValueBytes;
+  Parker* parker_ = nullptr;
+};
+
+// CommandEngine::handle on a process-wide engine with its own store, apart
+// from any Server's; for benchmarks and tools.
+std::string handle_command(const std::string& line);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "command.hpp"
+#include "protocol.hpp"
+
+class Capture;
+class Stats;
+
+// A client connection's state between requests. It outlives any one run of
+// serve_connection so a connection parked in BLPOP (see Parker) can be
+// picked up again by whichever worker is free.
+struct Session : std::enable_shared_from_this<Session> {
+  explicit Session(int fd) : fd(fd) {}
+
+  int fd;
+  uint32_t conn_id = 0;
+  bool greeted = false;
+  LineReader lr{8192};
+  // Commands view into their lines, so both stay at fixed slots.
+  std::vector<std::string> lines;
+  std::vector<Command> cmds;
+  std::vector<Reply> replies;
+  std::string resp;
+  std::shared_ptr<ParkTicket> ticket;  // set while parked
+};
+
+// Serves one client connection: banner, then one reply per request line,
+// until the peer disconnects, sends QUIT, or `running` turns false. SETB
+// payloads are read straight into the value buffer and GETB values are sent
+// from the store's copy, so large values are never buffered twice.
+// Requests are recorded to `capture` when it is non-null and active.
+// Returns true if the connection was parked by BLPOP instead: the parker
+// hands the session back when the wait ends, and it is served again from
+// where it stopped. Otherwise the caller closes the socket.
+bool serve_connection(Session& s, CommandEngine& engine, Stats& stats,
+                      const std::atomic<bool>& running,
+                      Capture* capture = nullptr);
+
+// For callers without a parker (the in-process loopback benchmark).
+void serve_connection(int fd, CommandEngine& engine, Stats& stats,
+                      const std::atomic<bool>& running,
+                      Capture* capture = nullptr);
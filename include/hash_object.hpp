@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "hash_table.hpp"
+#include "value_codec.hpp"
+
+// A hash value: fields mapped to values under one key. Small hashes are a
+// packed list, each entry a length byte and the field, then a length byte
+// and the value, back to back in one string, searched linearly. A hash
+// that gets more than kPackedMaxFields fields, or a field or value longer
+// than kPackedMaxLen bytes, moves to a HashTable for good.
+class HashObject : public ValueObject {
+ public:
+  static constexpr size_t kPackedMaxFields = 128;
+  static constexpr size_t kPackedMaxLen = 64;
+
+  size_t length() const override { return table_ ? table_->size() : count_; }
+  bool packed() const { return !table_; }
+
+  // Returns true if `field` is new.
+  bool set(std::string_view field, std::string_view value);
+  // `value` views the stored bytes until the next change.
+  bool get(std::string_view field, std::string_view& value) const;
+  bool del(std::string_view field);
+
+  // Calls f(field, value) for every field; packed hashes keep insertion
+  // order.
+  template <typename F>
+  void for_each(F&& f) const {
+    if (table_) {
+      table_->for_each([&](const std::string& k, const std::string& v) {
+        f(std::string_view(k), std::string_view(v));
+      });
+      return;
+    }
+    for (size_t p = 0; p < packed_.size();) {
+      std::string_view field = entry(p);
+      std::string_view value = entry(p);
+      f(field, value);
+    }
+  }
+
+ private:
+  // The length-prefixed string at `p`, advancing p past it.
+  std::string_view entry(size_t& p) const {
+    const size_t n = static_cast<unsigned char>(packed_[p]);
+    std::string_view s(packed_.data() + p + 1, n);
+    p += 1 + n;
+    return s;
+  }
+  // Offset of `field`'s entry, or npos.
+  size_t find(std::string_view field) const;
+  void convert();
+
+  std::string packed_;
+  uint32_t count_ = 0;
+  std::unique_ptr<HashTable<std::string>> table_;
+};
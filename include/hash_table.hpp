@@ -0,0 +1,139 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Chained hash table from std::string keys to V, looked up by
+// (string_view, precomputed hash). Each node keeps its full hash, so
+// lookups compare hashes before bytes and growing never rehashes keys.
+// Buckets are indexed by the low hash bits; callers that shard by hash
+// should use the high bits. Not thread-safe.
+template <typename V>
+class HashTable {
+ public:
+  HashTable() : buckets_(16, nullptr) {}
+  ~HashTable() { clear(); }
+  HashTable(const HashTable&) = delete;
+  HashTable& operator=(const HashTable&) = delete;
+
+  V* find(std::string_view key, uint64_t hash) {
+    for (Node* n = buckets_[hash & mask()]; n; n = n->next)
+      if (n->hash == hash && n->key == key) return &n->value;
+    return nullptr;
+  }
+  const V* find(std::string_view key, uint64_t hash) const {
+    return const_cast<HashTable*>(this)->find(key, hash);
+  }
+
+  // Hints for staged batch lookups: the bucket slot, then its first node.
+  void prefetch_bucket(uint64_t hash) const {
+    __builtin_prefetch(&buckets_[hash & mask()]);
+  }
+  void prefetch_head(uint64_t hash) const {
+    if (const Node* n = buckets_[hash & mask()]) __builtin_prefetch(n);
+  }
+
+  // Returns the value slot for `key`, default-constructing it if absent.
+  std::pair<V*, bool> try_emplace(std::string_view key, uint64_t hash) {
+    if (V* v = find(key, hash)) return {v, false};
+    if (size_ >= buckets_.size()) grow();
+    Node*& head = buckets_[hash & mask()];
+    head = new Node{head, hash, std::string(key), V()};
+    size_++;
+    return {&head->value, true};
+  }
+
+  bool erase(std::string_view key, uint64_t hash) {
+    for (Node** p = &buckets_[hash & mask()]; *p; p = &(*p)->next) {
+      Node* n = *p;
+      if (n->hash == hash && n->key == key) {
+        *p = n->next;
+        delete n;
+        size_--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  size_t size() const { return size_; }
+
+  // Calls f(key, value) for every entry, in no particular order.
+  template <typename F>
+  void for_each(F&& f) const {
+    for (const Node* head : buckets_)
+      for (const Node* n = head; n; n = n->next) f(n->key, n->value);
+  }
+
+  // Calls f(key, value) for the entries of the bucket at `cursor` (0 to
+  // start) and returns the next cursor, 0 after the last bucket. Cursors
+  // count up with their bits reversed, so the buckets a grown table split
+  // one into come right after each other and are all still ahead: entries
+  // present for a whole scan are visited once even if the table grows
+  // between calls.
+  template <typename F>
+  uint64_t scan(uint64_t cursor, F&& f) const {
+    const uint64_t m = mask();
+    for (const Node* n = buckets_[cursor & m]; n; n = n->next)
+      f(n->key, n->value);
+    cursor |= ~m;  // so the carry runs through the masked bits only
+    return reverse_bits(reverse_bits(cursor) + 1);
+  }
+
+  void swap(HashTable& other) {
+    buckets_.swap(other.buckets_);
+    std::swap(size_, other.size_);
+  }
+
+  void clear() {
+    for (Node*& head : buckets_) {
+      while (head) {
+        Node* n = head;
+        head = n->next;
+        delete n;
+      }
+    }
+    size_ = 0;
+  }
+
+ private:
+  struct Node {
+    Node* next;
+    uint64_t hash;
+    std::string key;
+    V value;
+  };
+
+  size_t mask() const { return buckets_.size() - 1; }
+
+  static uint64_t reverse_bits(uint64_t v) {
+    constexpr uint64_t k1 = 0x5555555555555555ull;
+    constexpr uint64_t k2 = 0x3333333333333333ull;
+    constexpr uint64_t k4 = 0x0f0f0f0f0f0f0f0full;
+    v = ((v >> 1) & k1) | ((v & k1) << 1);
+    v = ((v >> 2) & k2) | ((v & k2) << 2);
+    v = ((v >> 4) & k4) | ((v & k4) << 4);
+    return __builtin_bswap64(v);
+  }
+
+  // Doubles the bucket array at load factor 1; nodes move by stored hash.
+  void grow() {
+    std::vector<Node*> next(buckets_.size() * 2, nullptr);
+    const size_t m = next.size() - 1;
+    for (Node* head : buckets_) {
+      while (head) {
+        Node* n = head;
+        head = n->next;
+        n->next = next[n->hash & m];
+        next[n->hash & m] = n;
+      }
+    }
+    buckets_.swap(next);
+  }
+
+  std::vector<Node*> buckets_;
+  size_t size_ = 0;
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "blocking_queue.hpp"
+
+class KVStore;
+
+// Server-side bulk deletes (DELPREFIX, DELMATCH) run as background jobs,
+// one at a time on a low-priority thread started on first use. A job walks
+// the keyspace kStep keys at a time (the ordered index or ART engine
+// narrows a prefix job to its range; otherwise it follows SCAN cursors),
+// deletes the matches in one KVStore::apply per step and yields between
+// steps, so each step holds a shard lock about as long as one pipelined
+// batch does.
+class JobManager {
+ public:
+  static constexpr size_t kStep = 256;
+
+  enum class State { kQueued, kRunning, kDone, kCancelled };
+
+  struct Status {
+    State state;
+    uint64_t scanned;
+    uint64_t deleted;
+  };
+
+  explicit JobManager(KVStore& kv);
+  ~JobManager();  // cancels queued and running jobs
+  JobManager(const JobManager&) = delete;
+  JobManager& operator=(const JobManager&) = delete;
+
+  // Queues a delete of every key starting with `prefix`, or matching the
+  // glob `pattern`. Returns the job id, or 0 if too many jobs are queued.
+  uint64_t delete_prefix(std::string_view prefix);
+  uint64_t delete_matching(std::string_view pattern);
+
+  // False for an unknown id (or one old enough to have been forgotten).
+  bool status(uint64_t id, Status& out) const;
+
+ private:
+  struct Job {
+    uint64_t id = 0;
+    bool glob = false;
+    std::string match;  // prefix, or glob pattern
+    std::atomic<State> state{State::kQueued};
+    std::atomic<uint64_t> scanned{0};
+    std::atomic<uint64_t> deleted{0};
+  };
+
+  // Finished jobs kept for JOB queries; older ones are dropped.
+  static constexpr size_t kKeepJobs = 64;
+  static constexpr size_t kQueueCap = 64;
+
+  uint64_t submit(bool glob, std::string_view match);
+  void run(Job& job);
+
+  KVStore& kv_;
+  BlockingQueue<std::shared_ptr<Job>> q_;
+  mutable std::mutex mu_;
+  std::map<uint64_t, std::shared_ptr<Job>> jobs_;  // guarded by mu_
+  uint64_t next_id_ = 1;                           // guarded by mu_
+  std::atomic<bool> stop_{false};
+  std::once_flag started_;
+  std::thread thread_;
+};
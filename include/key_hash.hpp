@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Seeded 64-bit key hash used by KVStore (shard routing and buckets).
+//
+// Keys use wyhash (final v4). On CPUs with AVX2 (checked at runtime), keys
+// of kKeyHashLongMin bytes or more go through a striped multiply-accumulate
+// loop (xxh3-style) instead. The seed is random per process, so bucket
+// collisions can't be precomputed offline; set TCPKV_HASH_SEED to pin it
+// for reproducible runs.
+
+// Below this the AVX2 loop loses to wyhash (its setup and finish dominate).
+constexpr size_t kKeyHashLongMin = 1024;
+
+uint64_t key_hash_make_seed();  // random, or TCPKV_HASH_SEED
+uint64_t key_hash_long(const char* p, size_t n);
+// Portable version of the AVX2 loop (same results); for checks/benchmarks.
+uint64_t key_hash_long_scalar(const char* p, size_t n);
+bool key_hash_uses_avx2();
+
+inline uint64_t key_hash_seed() {
+  static const uint64_t seed = key_hash_make_seed();
+  return seed;
+}
+
+// ---- wyhash final v4 (public domain, by Wang Yi) ----
+
+__extension__ typedef unsigned __int128 wy_u128;
+
+constexpr uint64_t kWyP[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                              0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+inline void wy_mum(uint64_t* a, uint64_t* b) {
+  wy_u128 r = static_cast<wy_u128>(*a) * *b;
+  *a = static_cast<uint64_t>(r);
+  *b = static_cast<uint64_t>(r >> 64);
+}
+inline uint64_t wy_mix(uint64_t a, uint64_t b) {
+  wy_mum(&a, &b);
+  return a ^ b;
+}
+inline uint64_t wy_r8(const uint8_t* p) {
+  uint64_t v;
+  std::memcpy(&v, p, 8);
+  return v;
+}
+inline uint64_t wy_r4(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+inline uint64_t wy_r3(const uint8_t* p, size_t k) {
+  return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+}
+
+inline uint64_t wyhash(const void* key, size_t len, uint64_t seed) {
+  const uint8_t* p = static_cast<const uint8_t*>(key);
+  seed ^= wy_mix(seed ^ kWyP[0], kWyP[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (wy_r4(p) << 32) | wy_r4(p + ((len >> 3) << 2));
+      b = (wy_r4(p + len - 4) << 32) |
+          wy_r4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = wy_r3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+        seed = wy_mix(wy_r8(p) ^ kWyP[1], wy_r8(p + 8) ^ seed);
+        see1 = wy_mix(wy_r8(p + 16) ^ kWyP[2], wy_r8(p + 24) ^ see1);
+        see2 = wy_mix(wy_r8(p + 32) ^ kWyP[3], wy_r8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wy_mix(wy_r8(p) ^ kWyP[1], wy_r8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wy_r8(p + i - 16);
+    b = wy_r8(p + i - 8);
+  }
+  a ^= kWyP[1];
+  b ^= seed;
+  wy_mum(&a, &b);
+  return wy_mix(a ^ kWyP[0] ^ len, b ^ kWyP[1]);
+}
+
+inline uint64_t key_hash(std::string_view key) {
+  if (key.size() >= kKeyHashLongMin)
+    return key_hash_long(key.data(), key.size());
+  return wyhash(key.data(), key.size(), key_hash_seed());
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Key selection shared by SCAN MATCH and the bulk-delete jobs.
+
+// Glob match as in Redis MATCH: *, ?, [abc], [^abc], [a-z], and \x for a
+// literal x.
+bool glob_match(std::string_view pattern, std::string_view s);
+
+// Smallest string above every key that starts with `prefix` (empty when
+// there is none, i.e. the prefix is all 0xff bytes).
+std::string prefix_end(std::string_view prefix);
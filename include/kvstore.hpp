@@ -1,17 +1,253 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <optional>
 #include <shared_mutex>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <variant>
+#include <vector>
 
+#include "art_tree.hpp"
+#include "hash_table.hpp"
+#include "key_hash.hpp"
+#include "lazy_free.hpp"
+#include "skip_list.hpp"
+#include "value_codec.hpp"
+
+// A key with its hash computed once per request and reused for shard
+// routing and the table lookup.
+struct HashedKey {
+  std::string_view key;
+  uint64_t hash;
+
+  explicit HashedKey(std::string_view k)
+      : key(k), hash(key_hash(k)) {}
+};
+
+// One write in a batch: a set, or a delete when `value` is empty. Values
+// that fit inline are encoded by the caller, so they cost no allocation;
+// apply() compresses kRaw ones if compression is on.
+struct KVWrite {
+  HashedKey key;
+  StoredValue value;
+};
+
+// Per-shard table: a hash table (default) or an adaptive radix tree, which
+// shares key prefixes and keeps keys in order.
+enum class KVEngine { kHash, kArt };
+
+// Sharded store: the high hash bits pick a shard, each with its own lock
+// and table, so writers to different shards don't contend.
 class KVStore {
  public:
-  void set(const std::string& key, const std::string& value);
-  std::optional<std::string> get(const std::string& key) const;
-  bool del(const std::string& key);
+  static constexpr size_t kDefaultShards = 32;
+
+  explicit KVStore(size_t shards = kDefaultShards);  // rounded to 2^n
+  ~KVStore();
+
+  void set(const HashedKey& key, std::string&& value);
+  void set(std::string_view key, std::string_view value) {
+    set(HashedKey(key), std::string(value));
+  }
+  void set(std::string_view key, std::string&& value) {
+    set(HashedKey(key), std::move(value));
+  }
+  void set(std::string_view key, const char* value) {
+    set(key, std::string_view(value));
+  }
+
+  // String reads. A key holding a collection (hash, sorted set, list) has
+  // no string value: they find nothing, and set `*collection` if given.
+  std::optional<std::string> get(const HashedKey& key,
+                                 bool* collection = nullptr) const;
+  std::optional<std::string> get(std::string_view key) const {
+    return get(HashedKey(key));
+  }
+
+  // The stored value itself, or null (also for collections). Large values
+  // are sent from this handle without copying them or holding the lock.
+  std::shared_ptr<const std::string> get_shared(const HashedKey& key) const;
+  std::shared_ptr<const std::string> get_shared(std::string_view key) const {
+    return get_shared(HashedKey(key));
+  }
+
+  // Looks up keys[0..n) in stages across the batch (prefetch buckets, then
+  // first nodes, then probe and prefetch values) so cache misses overlap
+  // instead of being paid one key at a time. out[i] is null when absent or
+  // a collection; collection[i], if given, is set for the latter.
+  void get_many(const HashedKey* keys, size_t n,
+                std::shared_ptr<const std::string>* out,
+                char* collection = nullptr) const;
+
+  // set and del release the value they replace or remove after dropping
+  // the shard lock, so freeing a large one doesn't stall the shard.
+  bool del(const HashedKey& key);
+  bool del(std::string_view key) { return del(HashedKey(key)); }
+
+  // Like del, but values of kLazyFreeMinBytes or more, and collections of
+  // kLazyFreeMinItems or more, are freed on the background thread instead
+  // of the caller's.
+  bool unlink(const HashedKey& key);
+  bool unlink(std::string_view key) { return unlink(HashedKey(key)); }
+  static constexpr size_t kLazyFreeMinBytes = 64 << 10;
+  static constexpr size_t kLazyFreeMinItems = 64;
+
+  // Removes every key. Each shard's table (and index) is swapped for an
+  // empty one under its lock; the old ones are freed after the lock is
+  // dropped, on the background thread when `async`.
+  void flush(bool async);
+  size_t lazy_free_pending() const { return lazy_.pending(); }
+
+  // Applies `writes` grouped by shard, taking each shard's lock once.
+  // Writes to one shard (so to one key) keep their order. found[i] is set
+  // when writes[i] was a delete that removed a key. Values are moved out;
+  // the ones replaced or removed are freed after the locks are released.
+  void apply(std::vector<KVWrite>& writes, std::vector<char>& found);
+
+  // Runs f(v) under the key's write lock and returns its result. `v` is
+  // the key's value, empty if absent; f may change it in place (collection
+  // commands), and the key is added or removed if f leaves it set or
+  // empty.
+  template <typename F>
+  auto modify(const HashedKey& key, F&& f) {
+    Shard& s = shard(key);
+    std::unique_lock<std::shared_mutex> lk(s.mu);
+    s.write_locks++;
+    Value* v =
+        std::visit([&](auto& m) { return m.find(key.key, key.hash); }, s.map);
+    if (!v) {
+      Value fresh;
+      auto r = f(fresh);
+      if (fresh) {
+        s.count(fresh.enc(), Value::Enc::kNone);
+        *std::visit(
+            [&](auto& m) { return m.try_emplace(key.key, key.hash).first; },
+            s.map) = std::move(fresh);
+        if (s.index) s.index->insert(key.key);
+      }
+      return r;
+    }
+    const Value::Enc before = v->enc();
+    auto r = f(*v);
+    s.count(v->enc(), before);
+    if (!*v) {
+      std::visit([&](auto& m) { m.erase(key.key, key.hash); }, s.map);
+      if (s.index) s.index->erase(key.key);
+    }
+    return r;
+  }
+
+  // Runs f(v) under the key's shared lock, with v null if absent.
+  template <typename F>
+  auto view(const HashedKey& key, F&& f) const {
+    const Shard& s = shard(key);
+    std::shared_lock<std::shared_mutex> lk(s.mu);
+    const Value* v =
+        std::visit([&](auto& m) { return m.find(key.key, key.hash); }, s.map);
+    return f(v);
+  }
+
+  // Adds `delta` to the integer at `key` (0 if absent) and stores the sum
+  // in `result`; fails without writing if the value isn't a canonical
+  // int64 decimal or the sum would overflow.
+  enum class IncrResult { kOk, kNotInt, kOverflow };
+  IncrResult incr(const HashedKey& key, int64_t delta, int64_t& result);
+
+  // Live values per StoredValue::Enc, indexed by the enum.
+  std::array<size_t, StoredValue::kEncodings> encoding_counts() const;
+
+  // Compresses values of at least `min_bytes` from now on (0 = off), with
+  // a trained dictionary if `dict`; see ValueCodec.
+  void set_compression(size_t min_bytes, bool dict) {
+    codec_.configure(min_bytes, dict);
+  }
+  ValueCodec::Counters codec_counters() const { return codec_.counters(); }
+
+  // The value as stored, possibly compressed (GETZ), or a collection;
+  // empty when absent.
+  StoredValue get_stored(const HashedKey& key) const;
+  std::shared_ptr<const std::string> decode(const StoredValue& v) const {
+    return codec_.decode(v);
+  }
+
+  // Switches every shard's table to `e`, moving existing entries. Meant for
+  // startup, before requests arrive.
+  void set_engine(KVEngine e);
+  KVEngine engine() const {
+    return art_.load(std::memory_order_acquire) ? KVEngine::kArt
+                                                : KVEngine::kHash;
+  }
+
+  // Adds a per-shard skip list of keys (built from the current contents)
+  // and keeps it in step with every write, for range_keys.
+  void enable_ordered_index();
+  bool ordered() const {
+    return ordered_.load(std::memory_order_acquire) ||
+           engine() == KVEngine::kArt;
+  }
+
+  // Up to `limit` keys in [start, end), in order; an empty `end` means no
+  // upper bound. Merges the shards' indexes without taking shard locks, so
+  // scans never block writers. Requires the ordered index or the ART
+  // engine; ART shards are walked under their shared lock instead.
+  void range_keys(std::string_view start, std::string_view end, size_t limit,
+                  std::vector<std::string>& out) const;
+
+  // Resumable walk over every key, a little at a time. Appends the keys of
+  // about `count` entries from `cursor` on ("0" to begin) and returns the
+  // cursor to pass next, "0" once the walk is complete, or "" if `cursor`
+  // is malformed. Each shard's shared lock is held only while its part of
+  // one call is copied. Keys present for the whole walk are returned once;
+  // keys written or deleted meanwhile may or may not be. Hash shards use
+  // reverse-binary bucket cursors (see HashTable::scan); ART shards resume
+  // after the last key returned ("<shard>:<key>").
+  std::string scan(std::string_view cursor, size_t count,
+                   std::vector<std::string>& out) const;
+
   size_t size() const;
+  // Exclusive lock acquisitions so far, summed over shards.
+  uint64_t write_locks() const;
+  size_t shard_count() const { return size_t(1) << shard_bits_; }
+  size_t shard_of(const HashedKey& key) const {
+    return shard_bits_ ? key.hash >> (64 - shard_bits_) : 0;
+  }
 
  private:
-  mutable std::shared_mutex mu_;
-  std::unordered_map<std::string, std::string> map_;
+  using Value = StoredValue;
+  using Map = std::variant<HashTable<Value>, ArtTree<Value>>;
+
+  struct alignas(64) Shard {
+    mutable std::shared_mutex mu;
+    Map map;
+    uint64_t write_locks = 0;  // guarded by mu
+    // Live values per encoding, guarded by mu; [0] (kNone) is unused.
+    int64_t encodings[StoredValue::kEncodings] = {};
+    // Swapped under mu (std::atomic_store); lock-free readers take it
+    // with std::atomic_load, which keeps a flushed index alive for them.
+    std::shared_ptr<SkipList> index;
+
+    void count(Value::Enc added, Value::Enc removed) {
+      encodings[static_cast<int>(added)]++;
+      encodings[static_cast<int>(removed)]--;
+    }
+  };
+
+  Shard& shard(const HashedKey& key) const { return shards_[shard_of(key)]; }
+
+  // Moves the value for `key` into `out` and erases the entry; the caller
+  // holds the shard lock.
+  static bool take(Shard& s, const HashedKey& key, Value& out);
+
+  void range_keys_art(std::string_view start, std::string_view end,
+                      size_t limit, std::vector<std::string>& out) const;
+
+  mutable ValueCodec codec_;
+  LazyFree lazy_;
+  std::atomic<bool> ordered_{false};  // skip-list index enabled
+  std::atomic<bool> art_{false};
+  unsigned shard_bits_ = 0;
+  std::unique_ptr<Shard[]> shards_;
 };
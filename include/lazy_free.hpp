@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "blocking_queue.hpp"
+
+// Background thread that drops the references handed to it, so large values
+// and detached tables are freed off the request path. The thread starts on
+// first use; the destructor frees whatever is still queued.
+class LazyFree {
+ public:
+  LazyFree();
+  ~LazyFree();
+  LazyFree(const LazyFree&) = delete;
+  LazyFree& operator=(const LazyFree&) = delete;
+
+  // Releases `p` on the background thread, or right here (never waiting)
+  // if the queue is full. Call without holding locks.
+  void release(std::shared_ptr<const void> p);
+
+  // Objects queued and not yet released.
+  size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr size_t kQueueCap = 4096;
+
+  BlockingQueue<std::shared_ptr<const void>> q_;
+  std::once_flag started_;
+  std::thread thread_;
+  std::atomic<size_t> pending_{0};
+};
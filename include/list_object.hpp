@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "value_codec.hpp"
+
+// A list value, kept as a quicklist: a deque of chunks, each a packed run
+// of entries of up to kChunkBytes. An entry is its length, the bytes, then
+// the length again (mirrored) so the last entry can be found from the end.
+// Pushes and pops touch only the end chunks, and small elements cost two
+// length bytes each rather than a heap node. Not thread-safe; see
+// ValueObject.
+class ListObject : public ValueObject {
+ public:
+  static constexpr size_t kChunkBytes = 4096;
+
+  size_t length() const override { return length_; }
+  size_t chunks() const { return chunks_.size(); }
+
+  void push_front(std::string_view v);
+  void push_back(std::string_view v);
+  bool pop_front(std::string& out);
+  bool pop_back(std::string& out);
+
+  // Elements at positions [start, stop], in order.
+  void range(size_t start, size_t stop, std::vector<std::string>& out) const;
+
+ private:
+  struct Chunk {
+    std::string bytes;  // [begin, size) holds the entries
+    size_t begin = 0;   // room for front pushes, or bytes already popped
+    uint32_t count = 0;
+    size_t used() const { return bytes.size() - begin; }
+    // Once full: drops popped bytes and the spare capacity that growing
+    // the string left (up to half of it).
+    void seal() {
+      bytes.erase(0, begin);
+      begin = 0;
+      bytes.shrink_to_fit();
+    }
+  };
+
+  // Whether an entry of `need` bytes goes into `c` or a new chunk.
+  static bool fits(const Chunk& c, size_t need) {
+    return c.count == 0 || c.used() + need <= kChunkBytes;
+  }
+
+  std::deque<Chunk> chunks_;
+  size_t length_ = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Byte-oriented LZ77 codec writing the LZ4 block format (no frame), so
+// blocks can also be decoded with liblz4's LZ4_decompress_safe and
+// LZ4_decompress_safe_usingDict. Greedy matching through a 4096-entry hash
+// table of 4-byte sequences, with LZ4's skip-ahead over incompressible
+// runs: a few hundred MB/s to compress and over 1 GB/s to decode.
+
+class LzDict;
+
+// Largest block lz_compress can write for n input bytes.
+constexpr size_t lz_bound(size_t n) { return n + n / 255 + 16; }
+
+// Compresses src[0..n) into dst, which must hold lz_bound(n) bytes, and
+// returns the block length.
+size_t lz_compress(const char* src, size_t n, char* dst,
+                   const LzDict* dict = nullptr);
+
+// Decodes a block that must expand to exactly n bytes. Returns false for a
+// malformed block, without reading or writing out of bounds.
+bool lz_decompress(const char* src, size_t len, char* dst, size_t n,
+                   const LzDict* dict = nullptr);
+
+// Builds a dictionary of up to max_bytes from sample values: 64-byte
+// segments are picked greedily by how many not yet covered 8-byte
+// substrings (seen in at least two samples) they contain, as in zstd's
+// COVER trainer.
+std::string lz_train_dict(const std::vector<std::string>& samples,
+                          size_t max_bytes);
+
+// Preset history that blocks may refer back into; see lz_train_dict.
+class LzDict {
+ public:
+  static constexpr size_t kMaxBytes = 64 << 10;  // one LZ4 window
+
+  explicit LzDict(std::string bytes);  // truncated to kMaxBytes
+
+  const std::string& bytes() const { return bytes_; }
+
+ private:
+  friend size_t lz_compress(const char*, size_t, char*, const LzDict*);
+  std::string bytes_;
+  std::vector<uint32_t> table_;  // hash table preloaded with bytes_
+};
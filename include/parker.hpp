@@ -0,0 +1,111 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct Session;
+
+// One BLPOP wait. Created under the key's shard lock by Parker::wait and
+// ended exactly once: served an element by a push, or timed out (which
+// also covers the peer hanging up and server shutdown).
+struct ParkTicket {
+  using Clock = std::chrono::steady_clock;
+  enum class State { kWaiting, kServed, kTimedOut };
+
+  std::string key;
+  Clock::time_point deadline;  // max() = no timeout
+  State state = State::kWaiting;
+  std::string value;  // kServed: the element popped for this waiter
+
+  // Owned by Parker, under its mutex.
+  std::shared_ptr<Session> session;  // set once parked
+  int fd = -1;
+  std::multimap<Clock::time_point, ParkTicket*>::iterator timer;
+};
+
+// Holds connections blocked in BLPOP without holding a worker thread for
+// them. The worker returns the connection's Session here and goes back to
+// the pool; one thread waits in epoll for the earliest timeout or a parked
+// peer hanging up. A push hands elements to waiters directly, in arrival
+// order, under the key's shard lock, so an element can't be missed or
+// taken twice. Each ended wait is passed to `resume` (on the parker
+// thread), which reschedules the connection to send the reply without
+// waiting; if it can't yet (the pool's queue is full) it returns false and
+// the connection is offered again shortly. A consumer
+// that has had its BLPOP reply waits here for its next request as well, so
+// idle queue consumers don't hold workers either.
+class Parker {
+ public:
+  using Resume = std::function<bool(const std::shared_ptr<Session>&)>;
+
+  explicit Parker(Resume resume);
+  ~Parker();
+  Parker(const Parker&) = delete;
+  Parker& operator=(const Parker&) = delete;
+
+  bool start();
+  // Joins the thread, then ends every wait as timed out and resumes its
+  // connection, retrying until all are taken.
+  void stop();
+
+  // Queues a wait for `key`, which the caller found empty under its shard
+  // lock. `timeout` 0 waits forever.
+  std::shared_ptr<ParkTicket> wait(std::string_view key,
+                                   std::chrono::milliseconds timeout);
+
+  // Called under `key`'s shard lock after a push: serves waiters in order
+  // while pop(out) yields elements, skipping parked ones whose peer has
+  // hung up. Returns the number served.
+  size_t serve(std::string_view key,
+               const std::function<bool(std::string&)>& pop);
+  bool has_waiters() const { return waiting() > 0; }
+
+  // Parks the connection on `t` until its wait ends. Returns false if it
+  // already has, or ends it (parker stopped, fd not watchable); the caller
+  // then replies itself.
+  bool park(const std::shared_ptr<ParkTicket>& t, int fd,
+            std::shared_ptr<Session> session);
+  // Ends a wait that won't be parked (the connection failed first).
+  void cancel(const std::shared_ptr<ParkTicket>& t);
+  // Parks the connection until it has input (or hangs up). Returns false
+  // if the parker is stopped.
+  bool park_idle(int fd, std::shared_ptr<Session> session);
+
+  size_t waiting() const { return waiting_.load(std::memory_order_acquire); }
+
+ private:
+  void loop();
+  // Ends `t` in `state`; its connection, if parked, is queued to resume.
+  // Caller holds mu_.
+  void finish(ParkTicket* t, ParkTicket::State state);
+  // Caller holds mu_.
+  void wake_thread();
+  // Resumes `ready` in order; whatever `resume_` refuses goes back to the
+  // front of ready_. Returns false if any was refused.
+  bool resume_all(std::vector<std::shared_ptr<Session>>& ready);
+
+  Resume resume_;
+  std::thread thread_;
+  std::atomic<bool> running_{false};  // written under mu_
+  std::atomic<size_t> waiting_{0};
+
+  mutable std::mutex mu_;
+  int epoll_fd_ = -1;  // closed and reset under mu_
+  int event_fd_ = -1;
+  std::unordered_map<std::string, std::deque<std::shared_ptr<ParkTicket>>>
+      by_key_;
+  std::multimap<ParkTicket::Clock::time_point, ParkTicket*> timers_;
+  std::unordered_map<int, ParkTicket*> by_fd_;
+  std::unordered_map<int, std::shared_ptr<Session>> idle_;
+  std::vector<std::shared_ptr<Session>> ready_;  // to resume
+};
@@ -12,6 +12,13 @@ class LineReader {
   // If line too long, returns "**LINE_TOO_LONG**".
   std::optional<std::string> read_line(int fd);
 
+  // True when a complete line is already buffered, so read_line won't block.
+  bool has_line() const { return buffer_.find('\n') != std::string::npos; }
+
+  // Reads exactly `n` raw bytes into `out` (buffered bytes first, then
+  // straight from the socket). Returns false on disconnect/error.
+  bool read_exact(int fd, size_t n, std::string& out);
+
  private:
   size_t max_line_;
   std::string buffer_;
@@ -19,6 +26,3 @@ class LineReader {
 
 bool send_all(int fd, const char* data, size_t len);
 bool send_str(int fd, const std::string& s);
-
-// Implemented in server.cpp (needs KV/Stats)
-std::string handle_command(const std::string& line);
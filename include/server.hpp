@@ -1,10 +1,22 @@
 #pragma once
 #include <cstddef>
 #include <cstdint>
+#include <string>
+
+#include "kvstore.hpp"
 
 class Server {
  public:
-  Server(uint16_t port, int threads, int max_conns, size_t queue_cap);
+  Server(uint16_t port, int threads, int max_conns, size_t queue_cap,
+         int backlog);
+  void set_max_value_bytes(size_t n) { max_value_bytes_ = n; }
+  void set_capture_path(std::string path) { capture_path_ = std::move(path); }
+  void set_ordered_index(bool on) { ordered_index_ = on; }
+  void set_engine(KVEngine e) { engine_ = e; }
+  void set_compression(size_t min_bytes, bool dict) {
+    compress_min_ = min_bytes;
+    compress_dict_ = dict;
+  }
   bool start();  // blocking accept loop
   void stop();   // best-effort shutdown
 
@@ -13,4 +25,11 @@ class Server {
   int threads_;
   int max_conns_;
   size_t queue_cap_;
+  int backlog_;  // listen() accept-queue length
+  size_t max_value_bytes_ = size_t(512) << 20;  // SETB payload limit
+  std::string capture_path_;                    // empty = no capture
+  bool ordered_index_ = false;                  // RANGE/PREFIX support
+  KVEngine engine_ = KVEngine::kHash;
+  size_t compress_min_ = 0;                     // 0 = store values raw
+  bool compress_dict_ = false;
 };
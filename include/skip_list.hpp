@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Ordered set of keys for range scans. One writer at a time (callers hold
+// a lock); any number of readers run alongside it without locking.
+//
+// Writers publish nodes with release stores and readers follow links with
+// acquire loads. Unlinked nodes are freed only once no reader that could
+// still hold them remains: readers register in one of two epoch counters,
+// and a retired batch waits for the counter of the epoch it was retired in
+// to drain (two-epoch reclamation).
+class SkipList {
+ public:
+  struct Node;
+
+  SkipList();
+  ~SkipList();
+  SkipList(const SkipList&) = delete;
+  SkipList& operator=(const SkipList&) = delete;
+
+  // Writer side; callers serialize these.
+  void insert(std::string_view key);  // no-op if present
+  void erase(std::string_view key);   // no-op if absent
+
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+  size_t memory_bytes() const {
+    return bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Reader side: walks keys >= start in order. Keys stay readable until
+  // the cursor is destroyed or re-seeked, even if they are erased.
+  class Cursor {
+   public:
+    Cursor() = default;
+    ~Cursor() { release(); }
+    Cursor(const Cursor&) = delete;
+    Cursor& operator=(const Cursor&) = delete;
+
+    void seek(const SkipList& list, std::string_view start);
+    bool valid() const { return node_ != nullptr; }
+    std::string_view key() const;
+    void next();
+
+   private:
+    void release();
+
+    const SkipList* list_ = nullptr;
+    unsigned slot_ = 0;
+    const Node* node_ = nullptr;
+  };
+
+ private:
+  static constexpr int kMaxHeight = 12;
+
+  Node* new_node(std::string_view key, int height);
+  void free_node(Node* n);
+  int random_height();
+  // Last node at each level with key < `key`; returns the level-0 successor.
+  Node* find_preds(std::string_view key, Node** preds) const;
+
+  unsigned enter() const;
+  void leave(unsigned slot) const;
+  void reclaim();
+
+  Node* head_;
+  std::atomic<int> height_{1};
+  std::atomic<size_t> size_{0};
+  std::atomic<size_t> bytes_{0};
+  uint64_t rng_ = 0x9e3779b97f4a7c15ull;
+
+  std::atomic<uint64_t> epoch_{0};
+  mutable std::atomic<uint64_t> readers_[2] = {{0}, {0}};
+  Node* pending_ = nullptr;  // retired since the last flip
+  Node* limbo_ = nullptr;    // retired before the last flip
+};
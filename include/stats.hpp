@@ -5,13 +5,38 @@
 #include <cstdint>
 #include <string>
 
+// Store-side figures that the caller gathers for STATS.
+struct StoreStats {
+  size_t keys = 0;
+  uint64_t write_locks = 0;
+  size_t lazy_free_pending = 0;
+  size_t blocked_clients = 0;  // BLPOPs waiting
+  // Live values by encoding (see StoredValue).
+  size_t values_int = 0;
+  size_t values_embedded = 0;
+  size_t values_raw = 0;
+  size_t values_lz = 0;
+  size_t values_hash = 0;
+  size_t values_zset = 0;
+  size_t values_list = 0;
+  // Value compression (see ValueCodec::Counters).
+  uint64_t compressed_values = 0;
+  uint64_t compress_bytes_in = 0;
+  uint64_t compress_bytes_out = 0;
+  uint64_t compress_bytes_tried = 0;
+  uint64_t compress_ns = 0;
+  uint64_t decompressed_bytes = 0;
+  uint64_t decompress_ns = 0;
+  size_t dict_bytes = 0;
+};
+
 class Stats {
  public:
   void on_start();
   void inc_active();
   void dec_active();
   void inc_requests();
-  std::string render(int threads, size_t keys) const;
+  std::string render(int threads, const StoreStats& store) const;
 
  private:
   std::chrono::steady_clock::time_point start_;
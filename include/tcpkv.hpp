@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Embeddable API of libtcpkv: the server's store and command engine without
+// the socket hop. Only this header is stable; the other headers are
+// internal and may change between versions.
+//
+//   TcpKv kv;
+//   kv.set("user:1", "alice");
+//   if (auto v = kv.get("user:1")) use(*v);   // large values aren't copied
+//   std::string reply = kv.execute("GET user:1");  // "VALUE alice\n"
+
+#define TCPKV_VERSION_MAJOR 1
+#define TCPKV_VERSION_MINOR 3
+
+class TcpKv {
+ public:
+  // Shared, immutable view of a stored value. Stays valid after the key is
+  // overwritten or deleted.
+  using ValueHandle = std::shared_ptr<const std::string>;
+
+  TcpKv();
+  ~TcpKv();
+  TcpKv(const TcpKv&) = delete;
+  TcpKv& operator=(const TcpKv&) = delete;
+
+  // Thread-safe, like the server.
+  ValueHandle get(std::string_view key) const;  // null when missing
+  void set(std::string_view key, std::string_view value);
+  void set(std::string_view key, std::string&& value);
+  void set(std::string_view key, const char* value) {
+    set(key, std::string_view(value));
+  }
+  bool del(std::string_view key);
+  // del that frees large values on a background thread; flush removes every
+  // key, freeing them there when `async` (since 1.2).
+  bool unlink(std::string_view key);
+  void flush(bool async);
+  // Adds `delta` to the integer value at `key` (0 if missing) and returns
+  // the sum in `result`; false if the value isn't an integer or the sum
+  // would overflow (since 1.3).
+  bool incr(std::string_view key, int64_t delta, int64_t& result);
+  size_t size() const;
+
+  // Keeps keys in order as well, for RANGE/PREFIX (since 1.1).
+  void enable_ordered_index();
+
+  // Runs one protocol request line and appends the wire reply to `out`,
+  // exactly as a connection would see it (SETB/GETB excepted).
+  void execute(std::string_view line, std::string& out);
+  std::string execute(std::string_view line);
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
@@ -16,6 +16,9 @@ class ThreadPool {
   void start();
   void stop();
   bool submit(Job job);
+  // Never waits: false if the queue is full or the pool is stopped.
+  bool try_submit(Job& job);
+  bool running() const { return running_.load(); }
 
  private:
   void worker_loop();
@@ -0,0 +1,221 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lz_block.hpp"
+
+// Base of the collection types (hashes, sorted sets, lists) a value can
+// hold. They are changed in place under the owning shard's write lock and
+// read under its shared lock.
+class ValueObject {
+ public:
+  virtual ~ValueObject() = default;
+  virtual size_t length() const = 0;  // elements
+};
+
+// A value as kept in a table slot, in 24 bytes. Canonical int64 decimals
+// ("-42", not "007" or "+1") and strings of up to kEmbedMax bytes are held
+// inline, with no allocation; anything longer is a shared string of the
+// bytes, or of an LZ4 block of them. Collections are a ValueObject, tagged
+// with their type.
+class StoredValue {
+ public:
+  enum class Enc : uint8_t {
+    kNone,
+    kRaw,
+    kLz,
+    kLzDict,
+    kInt,
+    kEmbed,
+    kHash,  // collections from here on
+    kZSet,
+    kList
+  };
+  static constexpr int kEncodings = 9;
+  static constexpr size_t kEmbedMax = 16;
+
+  StoredValue() : int_(0) {}
+  StoredValue(std::shared_ptr<const std::string> data, Enc enc = Enc::kRaw,
+              uint32_t raw_len = 0)
+      : data_(std::move(data)),
+        len_(enc == Enc::kRaw ? static_cast<uint32_t>(data_->size())
+                              : raw_len),
+        enc_(enc) {}
+  static StoredValue of_object(std::shared_ptr<ValueObject> obj, Enc type) {
+    StoredValue v;
+    new (&v.obj_) std::shared_ptr<ValueObject>(std::move(obj));
+    v.enc_ = type;
+    return v;
+  }
+  static StoredValue of_int(int64_t v);
+  // The inline form of `v`, or an empty value if it needs the heap.
+  static StoredValue of_inline(std::string_view v);
+
+  StoredValue(const StoredValue& o) : len_(o.len_), enc_(o.enc_) {
+    if (on_heap())
+      new (&data_) std::shared_ptr<const std::string>(o.data_);
+    else if (is_object())
+      new (&obj_) std::shared_ptr<ValueObject>(o.obj_);
+    else
+      std::memcpy(embed_, o.embed_, kEmbedMax);
+  }
+  StoredValue(StoredValue&& o) noexcept : int_(0) { move_from(o); }
+  StoredValue& operator=(const StoredValue& o) {
+    if (this != &o) *this = StoredValue(o);
+    return *this;
+  }
+  StoredValue& operator=(StoredValue&& o) noexcept {
+    if (this != &o) {
+      reset();
+      move_from(o);
+    }
+    return *this;
+  }
+  ~StoredValue() { reset(); }
+
+  explicit operator bool() const { return enc_ != Enc::kNone; }
+  Enc enc() const { return enc_; }
+  // A string in data(), raw or compressed.
+  bool on_heap() const {
+    return enc_ == Enc::kRaw || enc_ == Enc::kLz || enc_ == Enc::kLzDict;
+  }
+  bool is_inline() const { return enc_ == Enc::kInt || enc_ == Enc::kEmbed; }
+  bool is_object() const { return enc_ >= Enc::kHash; }
+  // Size of the value's bytes (decoded, or formatted for kInt).
+  uint32_t raw_len() const { return len_; }
+
+  // kRaw and kLz*: the stored string.
+  const std::shared_ptr<const std::string>& data() const { return data_; }
+  std::shared_ptr<const std::string> take_data() {
+    auto d = std::move(data_);
+    reset();
+    return d;
+  }
+  int64_t int_value() const { return int_; }  // kInt
+  template <typename T>
+  T* object() const {  // collections; T must match the type tag
+    return static_cast<T*>(obj_.get());
+  }
+  // Whatever this value owns on the heap (null if inline), for freeing
+  // elsewhere; leaves the value empty.
+  std::shared_ptr<const void> take_heap() {
+    std::shared_ptr<const void> p;
+    if (on_heap()) p = std::move(data_);
+    if (is_object()) p = std::move(obj_);
+    reset();
+    return p;
+  }
+
+  // kInt and kEmbed: the value's bytes. inline_copy writes them to `out`
+  // (kInlineMax bytes of room) and returns their length.
+  static constexpr size_t kInlineMax = 20;
+  std::string inline_string() const;
+  size_t inline_copy(char* out) const;
+
+ private:
+  // Requires *this empty; leaves `o` empty.
+  void move_from(StoredValue& o) noexcept {
+    len_ = o.len_;
+    enc_ = o.enc_;
+    if (on_heap())
+      new (&data_) std::shared_ptr<const std::string>(std::move(o.data_));
+    else if (is_object())
+      new (&obj_) std::shared_ptr<ValueObject>(std::move(o.obj_));
+    else
+      std::memcpy(embed_, o.embed_, kEmbedMax);
+    o.reset();
+  }
+  void reset() {
+    if (on_heap()) data_.~shared_ptr();
+    if (is_object()) obj_.~shared_ptr();
+    int_ = 0;
+    enc_ = Enc::kNone;
+  }
+
+  union {
+    std::shared_ptr<const std::string> data_;
+    std::shared_ptr<ValueObject> obj_;
+    int64_t int_;
+    char embed_[kEmbedMax];
+  };
+  uint32_t len_ = 0;
+  Enc enc_ = Enc::kNone;
+};
+
+// Parses a canonical int64 decimal: what to_chars would print for it.
+bool parse_canonical_int(std::string_view s, int64_t& out);
+
+// Picks each value's encoding. Short values are stored inline (see
+// StoredValue); with compression on, values of at least min_bytes are
+// stored as LZ4 blocks when that saves an eighth or more; everything else
+// stays raw. With a dictionary, the first kSamples compressible values are
+// sampled and a shared dictionary is trained from them once; values under
+// 64 KB are compressed against it from then on, which is what makes small
+// JSON records compress. Encoding and decoding run outside the store's
+// locks; decoding happens on read.
+class ValueCodec {
+ public:
+  static constexpr size_t kSamples = 256;
+  static constexpr size_t kDictBytes = 16 << 10;
+
+  struct Counters {
+    uint64_t compressed = 0;    // values stored compressed
+    uint64_t bytes_in = 0;      // their raw size
+    uint64_t bytes_out = 0;     // their compressed size
+    uint64_t bytes_tried = 0;   // raw size of every value tried
+    uint64_t compress_ns = 0;   // time spent on those
+    uint64_t decompressed = 0;  // bytes produced by reads
+    uint64_t decompress_ns = 0;
+    size_t dict_bytes = 0;
+  };
+
+  // min_bytes == 0 turns compression off (the default).
+  void configure(size_t min_bytes, bool train_dict);
+  bool enabled() const {
+    return min_bytes_.load(std::memory_order_relaxed) != 0;
+  }
+
+  StoredValue encode(std::string&& value);
+  StoredValue encode(std::shared_ptr<const std::string> value);
+
+  // The raw bytes: the stored string itself when kRaw, else a fresh copy.
+  // Inline values are copied into a string the calling thread recycles once
+  // every handle to it is gone, so reading them doesn't allocate. Empty for
+  // collections, or if a block fails to decode (memory corruption).
+  std::shared_ptr<const std::string> decode(const StoredValue& v);
+  std::optional<std::string> decode_string(const StoredValue& v);
+
+  Counters counters() const;
+
+ private:
+  // Compresses v into a new string, or returns null when not worth it.
+  std::shared_ptr<const std::string> compress(const std::string& v,
+                                              StoredValue::Enc& enc);
+  bool decode_into(const StoredValue& v, char* out);
+  void sample(const std::string& v);
+
+  std::atomic<size_t> min_bytes_{0};
+  std::atomic<bool> train_{false};
+
+  std::mutex sample_mu_;
+  std::vector<std::string> samples_;  // guarded by sample_mu_
+  // Set once, then never replaced: stored blocks depend on it.
+  std::shared_ptr<const LzDict> dict_;  // std::atomic_load/store
+
+  std::atomic<uint64_t> compressed_{0};
+  std::atomic<uint64_t> bytes_in_{0};
+  std::atomic<uint64_t> bytes_out_{0};
+  std::atomic<uint64_t> bytes_tried_{0};
+  std::atomic<uint64_t> compress_ns_{0};
+  std::atomic<uint64_t> decompressed_{0};
+  std::atomic<uint64_t> decompress_ns_{0};
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "hash_table.hpp"
+#include "value_codec.hpp"
+
+// A sorted set value: members ordered by (score, member). A skip list
+// keeps the order, and each link also records how many entries it jumps
+// (its span), so rank lookups and rank ranges take O(log n) like updates.
+// A HashTable from member to node gives O(1) score lookups. Not
+// thread-safe; see ValueObject.
+class ZSetObject : public ValueObject {
+ public:
+  using Entry = std::pair<std::string, double>;  // member, score
+
+  ZSetObject();
+  ~ZSetObject() override;
+  ZSetObject(const ZSetObject&) = delete;
+  ZSetObject& operator=(const ZSetObject&) = delete;
+
+  size_t length() const override { return length_; }
+
+  // Sets `member`'s score; returns true if it is new.
+  bool add(std::string_view member, double score);
+  bool remove(std::string_view member);
+  bool score(std::string_view member, double& out) const;
+  // 0-based position in ascending order.
+  bool rank(std::string_view member, size_t& out) const;
+
+  // Entries at positions [start, stop], in order.
+  void range(size_t start, size_t stop, std::vector<Entry>& out) const;
+  // Entries with min <= score <= max (bounds excluded when *_excl), in
+  // order, skipping the first `offset` and returning at most `limit`.
+  void range_by_score(double min, bool min_excl, double max, bool max_excl,
+                      size_t offset, size_t limit,
+                      std::vector<Entry>& out) const;
+
+ private:
+  struct Node;
+  static constexpr int kMaxHeight = 32;
+
+  static Node* new_node(std::string_view member, double score, int height);
+  // Whether `n` sorts before (score, member).
+  static bool before(const Node* n, double score, std::string_view member);
+  int random_height();
+  // Fills update[] with the last node before (score, member) on each
+  // level, and rank[] with their positions (head = 0).
+  void find_path(double score, std::string_view member, Node** update,
+                 size_t* rank) const;
+  Node* insert(std::string_view member, double score);
+  void unlink(Node* x, Node** update);
+
+  Node* head_;
+  size_t length_ = 0;
+  int height_ = 1;
+  uint64_t rng_ = 0x9e3779b97f4a7c15ull;
+  HashTable<Node*> members_;
+};
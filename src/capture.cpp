@@ -0,0 +1,141 @@
+#include "capture.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "capture_format.hpp"
+
+// ---- CaptureRing ----
+CaptureRing::CaptureRing(size_t capacity) {
+  size_t cap = 64;
+  while (cap < capacity) cap <<= 1;
+  buf_.resize(cap);
+  mask_ = cap - 1;
+}
+
+void CaptureRing::put(uint64_t pos, const void* src, size_t n) {
+  size_t at = pos & mask_;
+  size_t first = std::min(n, buf_.size() - at);
+  std::memcpy(&buf_[at], src, first);
+  std::memcpy(&buf_[0], static_cast<const char*>(src) + first, n - first);
+}
+
+void CaptureRing::get(uint64_t pos, void* dst, size_t n) const {
+  size_t at = pos & mask_;
+  size_t first = std::min(n, buf_.size() - at);
+  std::memcpy(dst, &buf_[at], first);
+  std::memcpy(static_cast<char*>(dst) + first, &buf_[0], n - first);
+}
+
+bool CaptureRing::push(uint64_t ts_us, uint32_t conn, std::string_view line,
+                       std::string_view payload) {
+  const size_t len = line.size() + 1 + payload.size();
+  const size_t need = sizeof(Header) + len;
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  uint64_t tail = tail_.load(std::memory_order_acquire);
+  if (need > buf_.size() - (head - tail)) return false;
+
+  Header h{ts_us, conn, static_cast<uint32_t>(len)};
+  put(head, &h, sizeof(h));
+  put(head + sizeof(h), line.data(), line.size());
+  put(head + sizeof(h) + line.size(), "\n", 1);
+  put(head + sizeof(h) + line.size() + 1, payload.data(), payload.size());
+  head_.store(head + need, std::memory_order_release);
+  return true;
+}
+
+size_t CaptureRing::drain(std::string& out) {
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  uint64_t head = head_.load(std::memory_order_acquire);
+  size_t n = 0;
+  while (tail < head) {
+    Header h;
+    get(tail, &h, sizeof(h));
+    put_varint(out, h.ts_us);
+    put_varint(out, h.conn);
+    put_varint(out, h.len);
+    size_t at = out.size();
+    out.resize(at + h.len);
+    get(tail + sizeof(h), &out[at], h.len);
+    tail += sizeof(h) + h.len;
+    n++;
+  }
+  tail_.store(tail, std::memory_order_release);
+  return n;
+}
+
+// ---- Capture ----
+static std::atomic<uint64_t> g_capture_generation{0};
+
+Capture::~Capture() { stop(); }
+
+bool Capture::start(const std::string& path, size_t ring_bytes) {
+  if (active()) return false;
+  file_ = std::fopen(path.c_str(), "wb");
+  if (!file_) return false;
+  std::fwrite(kCaptureMagic, 1, kCaptureMagicLen, file_);
+
+  ring_bytes_ = ring_bytes;
+  generation_ = g_capture_generation.fetch_add(1) + 1;
+  start_ = std::chrono::steady_clock::now();
+  active_.store(true, std::memory_order_release);
+  writer_ = std::thread([this]() { writer_loop(); });
+  return true;
+}
+
+void Capture::stop() {
+  if (!active_.exchange(false)) return;
+  if (writer_.joinable()) writer_.join();
+
+  // A request recorded concurrently with the flip may miss the final drain;
+  // everything recorded before stop() was called is written.
+  std::string out;
+  drain_all(out);
+  std::fwrite(out.data(), 1, out.size(), file_);
+  std::fclose(file_);
+  file_ = nullptr;
+}
+
+CaptureRing& Capture::local_ring() {
+  thread_local uint64_t tl_generation = 0;
+  thread_local CaptureRing* tl_ring = nullptr;
+  if (tl_generation != generation_) {
+    auto ring = std::make_unique<CaptureRing>(ring_bytes_);
+    tl_ring = ring.get();
+    tl_generation = generation_;
+    std::lock_guard<std::mutex> lk(rings_mu_);
+    rings_.push_back(std::move(ring));
+  }
+  return *tl_ring;
+}
+
+void Capture::record(uint32_t conn, std::string_view line,
+                     std::string_view payload) {
+  if (!active()) return;
+  auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_)
+                .count();
+  if (local_ring().push(static_cast<uint64_t>(us), conn, line, payload))
+    records_.fetch_add(1, std::memory_order_relaxed);
+  else
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t Capture::drain_all(std::string& out) {
+  std::lock_guard<std::mutex> lk(rings_mu_);
+  size_t n = 0;
+  for (auto& r : rings_) n += r->drain(out);
+  return n;
+}
+
+void Capture::writer_loop() {
+  std::string out;
+  while (active()) {
+    out.clear();
+    if (drain_all(out) == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      continue;
+    }
+    std::fwrite(out.data(), 1, out.size(), file_);
+  }
+}
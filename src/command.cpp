@@ -0,0 +1,907 @@
+#include "command.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+#include <memory>
+
+#include "hash_object.hpp"
+#include "key_match.hpp"
+#include "kvstore.hpp"
+#include "list_object.hpp"
+#include "parker.hpp"
+#include "stats.hpp"
+#include "zset_object.hpp"
+
+std::string_view Command::rest_after(size_t i) const {
+  if (i >= args.size()) return {};
+  size_t end = static_cast<size_t>(args[i].data() - line.data()) +
+               args[i].size();
+  std::string_view rest = line.substr(end);
+  if (!rest.empty() && rest.front() == ' ') rest.remove_prefix(1);
+  return rest;
+}
+
+bool parse_command(std::string_view line, Command& out) {
+  out.name.clear();
+  out.args.clear();
+  out.line = line;
+
+  size_t i = 0;
+  const size_t n = line.size();
+  bool first = true;
+  while (i < n) {
+    while (i < n && std::isspace(static_cast<unsigned char>(line[i]))) i++;
+    if (i >= n) break;
+    size_t start = i;
+    while (i < n && !std::isspace(static_cast<unsigned char>(line[i]))) i++;
+    std::string_view tok = line.substr(start, i - start);
+    if (first) {
+      out.name.assign(tok.data(), tok.size());
+      for (auto& c : out.name)
+        c = static_cast<char>(::toupper(static_cast<unsigned char>(c)));
+      first = false;
+    } else {
+      out.args.push_back(tok);
+    }
+  }
+  return !first;
+}
+
+void format_reply(const Reply& r, std::string& out) {
+  switch (r.kind) {
+    case Reply::Kind::kOk:
+      out += "OK\n";
+      break;
+    case Reply::Kind::kPong:
+      out += "PONG\n";
+      break;
+    case Reply::Kind::kValue:
+      out += "VALUE ";
+      out += r.text;
+      out += '\n';
+      break;
+    case Reply::Kind::kNotFound:
+      out += "NOTFOUND\n";
+      break;
+    case Reply::Kind::kError:
+      out += "ERR ";
+      out += r.text;
+      out += '\n';
+      break;
+    case Reply::Kind::kRaw:
+      out += r.text;
+      break;
+    case Reply::Kind::kBye:
+      out += "OK bye\n";
+      break;
+    case Reply::Kind::kBlob:
+      format_blob_header(r.blob->size(), out);
+      out += *r.blob;
+      break;
+    case Reply::Kind::kBlobLz:
+      format_blob_lz_header(r.raw_len, r.blob->size(), out);
+      out += *r.blob;
+      break;
+    case Reply::Kind::kArray:
+      format_array_header(r.items.size(), out);
+      for (const auto& item : r.items) {
+        out += item;
+        out += '\n';
+      }
+      break;
+    case Reply::Kind::kBlocked:
+      break;  // the connection replies when the wait ends
+  }
+}
+
+void format_blob_header(size_t len, std::string& out) {
+  out += "VALUEB ";
+  out += std::to_string(len);
+  out += '\n';
+}
+
+void format_blob_lz_header(size_t raw_len, size_t len, std::string& out) {
+  out += "VALUEZ ";
+  out += std::to_string(raw_len);
+  out += ' ';
+  out += std::to_string(len);
+  out += '\n';
+}
+
+void format_array_header(size_t n, std::string& out) {
+  out += "ARRAY ";
+  out += std::to_string(n);
+  out += '\n';
+}
+
+CommandEngine::CommandEngine(KVStore& kv, Stats& stats)
+    : kv_(kv), stats_(stats), jobs_(kv) {}
+
+bool CommandEngine::payload_size(const Command& cmd, size_t& len) const {
+  len = 0;
+  if (cmd.name != "SETB" || cmd.args.size() < 2) return true;
+  std::string_view s = cmd.args[1];
+  auto res = std::from_chars(s.data(), s.data() + s.size(), len);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size() &&
+         len <= max_value_bytes_;
+}
+
+static bool iequals(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++)
+    if (::toupper(static_cast<unsigned char>(a[i])) !=
+        ::toupper(static_cast<unsigned char>(b[i])))
+      return false;
+  return true;
+}
+
+static Reply wrong_type() {
+  return Reply::error("key holds another type");
+}
+
+Reply CommandEngine::scan_reply(std::string_view start, std::string_view end,
+                                size_t limit) {
+  std::vector<std::string> keys;
+  kv_.range_keys(start, end, limit, keys);
+  std::vector<HashedKey> hashed(keys.begin(), keys.end());
+  std::vector<std::shared_ptr<const std::string>> vals(keys.size());
+  std::vector<char> collection(keys.size());
+  kv_.get_many(hashed.data(), hashed.size(), vals.data(), collection.data());
+
+  // Keys deleted since the index walk are left out. A collection has no
+  // string value, so its line is the bare key.
+  Reply r(Reply::Kind::kArray, {});
+  r.items.reserve(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (collection[i]) {
+      r.items.push_back(std::move(keys[i]));
+      continue;
+    }
+    if (!vals[i]) continue;
+    std::string& item = keys[i];
+    item += ' ';
+    item += *vals[i];
+    r.items.push_back(std::move(item));
+  }
+  return r;
+}
+
+Reply CommandEngine::execute(Command& cmd) {
+  const std::string& name = cmd.name;
+
+  if (name == "PING") return {Reply::Kind::kPong, {}};
+
+  if (name == "GET") {
+    if (cmd.args.empty()) return Reply::error("usage: GET key");
+    bool collection = false;
+    auto v = kv_.get(HashedKey(cmd.args[0]), &collection);
+    if (collection) return wrong_type();
+    if (!v) return {Reply::Kind::kNotFound, {}};
+    return {Reply::Kind::kValue, std::move(*v)};
+  }
+
+  if (name == "MGET") {
+    if (cmd.args.empty()) return Reply::error("usage: MGET key [key ...]");
+    std::vector<HashedKey> keys(cmd.args.begin(), cmd.args.end());
+    std::vector<std::shared_ptr<const std::string>> vals(keys.size());
+    std::vector<char> collection(keys.size());
+    kv_.get_many(keys.data(), keys.size(), vals.data(), collection.data());
+    Reply r(Reply::Kind::kArray, {});
+    r.items.reserve(vals.size());
+    for (size_t i = 0; i < vals.size(); i++) {
+      if (vals[i])
+        r.items.push_back("VALUE " + *vals[i]);
+      else if (collection[i])
+        r.items.emplace_back("ERR key holds another type");
+      else
+        r.items.emplace_back("NOTFOUND");
+    }
+    return r;
+  }
+
+  // Ordered scans; the index is optional (server --ordered-index).
+  if (name == "RANGE" || name == "PREFIX") {
+    const bool range = name == "RANGE";
+    const size_t nargs = range ? 2 : 1;
+    if (cmd.args.size() < nargs)
+      return Reply::error(range ? "usage: RANGE start end|+ [limit]"
+                                : "usage: PREFIX prefix [limit]");
+    if (!kv_.ordered()) return Reply::error("ordered index disabled");
+    size_t limit = kDefaultScanLimit;
+    if (cmd.args.size() > nargs) {
+      std::string_view l = cmd.args[nargs];
+      auto res = std::from_chars(l.data(), l.data() + l.size(), limit);
+      if (res.ec != std::errc() || res.ptr != l.data() + l.size() ||
+          limit == 0 || limit > kMaxScanLimit)
+        return Reply::error("bad limit");
+    }
+    std::string_view start = cmd.args[0];
+    std::string end;
+    if (range) {
+      if (cmd.args[1] != "+") end = std::string(cmd.args[1]);
+    } else {
+      end = prefix_end(start);
+    }
+    return scan_reply(start, end, limit);
+  }
+
+  // Incremental walk over every key: SCAN cursor [COUNT n] [MATCH pattern].
+  // Replies with the next cursor, then the keys; COUNT bounds the work
+  // done, so MATCH may leave fewer (or none) in a reply.
+  if (name == "SCAN") {
+    const char* usage = "usage: SCAN cursor [COUNT n] [MATCH pattern]";
+    if (cmd.args.empty() || cmd.args.size() % 2 == 0)
+      return Reply::error(usage);
+    size_t count = kDefaultScanCount;
+    std::string_view pattern;
+    for (size_t i = 1; i < cmd.args.size(); i += 2) {
+      std::string_view v = cmd.args[i + 1];
+      if (iequals(cmd.args[i], "COUNT")) {
+        auto res = std::from_chars(v.data(), v.data() + v.size(), count);
+        if (res.ec != std::errc() || res.ptr != v.data() + v.size() ||
+            count == 0 || count > kMaxScanLimit)
+          return Reply::error("bad count");
+      } else if (iequals(cmd.args[i], "MATCH")) {
+        pattern = v;
+      } else {
+        return Reply::error(usage);
+      }
+    }
+    std::vector<std::string> keys;
+    std::string next = kv_.scan(cmd.args[0], count, keys);
+    if (next.empty()) return Reply::error("bad cursor");
+    Reply r(Reply::Kind::kArray, {});
+    r.items.reserve(keys.size() + 1);
+    r.items.push_back("CURSOR " + next);
+    for (auto& k : keys)
+      if (pattern.empty() || glob_match(pattern, k))
+        r.items.push_back(std::move(k));
+    return r;
+  }
+
+  if (name == "SET") {
+    if (cmd.args.empty()) return Reply::error("usage: SET key value");
+    kv_.set(HashedKey(cmd.args[0]), std::string(cmd.rest_after(0)));
+    return Reply::ok();
+  }
+
+  // Length-prefixed values: any bytes, up to the value limit.
+  if (name == "SETB") {
+    if (cmd.args.size() < 2) return Reply::error("usage: SETB key len");
+    kv_.set(HashedKey(cmd.args[0]), std::move(cmd.payload));
+    cmd.payload.clear();
+    return Reply::ok();
+  }
+
+  if (name == "GETB") {
+    if (cmd.args.empty()) return Reply::error("usage: GETB key");
+    StoredValue v = kv_.get_stored(HashedKey(cmd.args[0]));
+    if (!v) return {Reply::Kind::kNotFound, {}};
+    if (v.is_object()) return wrong_type();
+    auto raw = kv_.decode(v);
+    if (!raw) return {Reply::Kind::kNotFound, {}};
+    return Reply::of_blob(std::move(raw));
+  }
+
+  // GETB for clients that decode LZ4 blocks themselves: a value stored
+  // compressed (without the dictionary) is sent as is.
+  if (name == "GETZ") {
+    if (cmd.args.empty()) return Reply::error("usage: GETZ key");
+    StoredValue v = kv_.get_stored(HashedKey(cmd.args[0]));
+    if (!v) return {Reply::Kind::kNotFound, {}};
+    if (v.is_object()) return wrong_type();
+    if (v.enc() == StoredValue::Enc::kLz) {
+      Reply r = Reply::of_blob(v.take_data());
+      r.kind = Reply::Kind::kBlobLz;
+      r.raw_len = v.raw_len();
+      return r;
+    }
+    auto raw = kv_.decode(v);
+    if (!raw) return {Reply::Kind::kNotFound, {}};
+    return Reply::of_blob(std::move(raw));
+  }
+
+  // Counters: the value is kept as an int64, so no parsing per update.
+  if (name == "INCR" || name == "DECR" || name == "INCRBY" ||
+      name == "DECRBY") {
+    const bool by = name.size() == 6;
+    if (cmd.args.size() != (by ? 2u : 1u))
+      return Reply::error("usage: " + name + (by ? " key delta" : " key"));
+    int64_t delta = 1;
+    if (by) {
+      std::string_view d = cmd.args[1];
+      auto res = std::from_chars(d.data(), d.data() + d.size(), delta);
+      if (res.ec != std::errc() || res.ptr != d.data() + d.size())
+        return Reply::error("delta is not an integer");
+    }
+    if (name[0] == 'D') {
+      if (delta == INT64_MIN) return Reply::error("increment would overflow");
+      delta = -delta;
+    }
+    int64_t result;
+    switch (kv_.incr(HashedKey(cmd.args[0]), delta, result)) {
+      case KVStore::IncrResult::kOk:
+        return {Reply::Kind::kValue, std::to_string(result)};
+      case KVStore::IncrResult::kNotInt:
+        return Reply::error("value is not an integer");
+      case KVStore::IncrResult::kOverflow:
+        break;
+    }
+    return Reply::error("increment would overflow");
+  }
+
+  if (name == "HSET" || name == "HGET" || name == "HMGET" ||
+      name == "HGETALL" || name == "HDEL" || name == "HLEN")
+    return hash_command(cmd);
+
+  if (name == "ZADD" || name == "ZINCRBY" || name == "ZREM" ||
+      name == "ZSCORE" || name == "ZCARD" || name == "ZRANK" ||
+      name == "ZRANGE" || name == "ZRANGEBYSCORE")
+    return zset_command(cmd);
+
+  if (name == "LPUSH" || name == "RPUSH" || name == "LPOP" ||
+      name == "RPOP" || name == "LLEN" || name == "LRANGE" ||
+      name == "BLPOP")
+    return list_command(cmd);
+
+  if (name == "TYPE") {
+    if (cmd.args.empty()) return Reply::error("usage: TYPE key");
+    const char* type = kv_.view(
+        HashedKey(cmd.args[0]), [](const StoredValue* v) -> const char* {
+          if (!v) return "none";
+          if (v->enc() == StoredValue::Enc::kHash) return "hash";
+          if (v->enc() == StoredValue::Enc::kZSet) return "zset";
+          if (v->enc() == StoredValue::Enc::kList) return "list";
+          return "string";
+        });
+    return {Reply::Kind::kRaw, std::string("TYPE ") + type + "\n"};
+  }
+
+  if (name == "DEL") {
+    if (cmd.args.empty()) return Reply::error("usage: DEL key");
+    bool removed = kv_.del(HashedKey(cmd.args[0]));
+    return removed ? Reply::ok() : Reply{Reply::Kind::kNotFound, {}};
+  }
+
+  // Detaches the entry under the lock; large values are freed on the
+  // store's background thread.
+  if (name == "UNLINK") {
+    if (cmd.args.empty()) return Reply::error("usage: UNLINK key");
+    bool removed = kv_.unlink(HashedKey(cmd.args[0]));
+    return removed ? Reply::ok() : Reply{Reply::Kind::kNotFound, {}};
+  }
+
+  if (name == "FLUSHALL") {
+    bool async = false;
+    if (!cmd.args.empty()) {
+      async = iequals(cmd.args[0], "ASYNC");
+      if (!async && !iequals(cmd.args[0], "SYNC"))
+        return Reply::error("usage: FLUSHALL [ASYNC|SYNC]");
+    }
+    kv_.flush(async);
+    return Reply::ok();
+  }
+
+  // Bulk deletes run as background jobs; the reply is the job id.
+  if (name == "DELPREFIX" || name == "DELMATCH") {
+    if (cmd.args.empty())
+      return Reply::error(name == "DELPREFIX" ? "usage: DELPREFIX prefix"
+                                              : "usage: DELMATCH pattern");
+    uint64_t id = name == "DELPREFIX" ? jobs_.delete_prefix(cmd.args[0])
+                                      : jobs_.delete_matching(cmd.args[0]);
+    if (id == 0) return Reply::error("too many jobs");
+    return {Reply::Kind::kRaw, "JOB " + std::to_string(id) + "\n"};
+  }
+
+  if (name == "JOB") {
+    uint64_t id = 0;
+    JobManager::Status st;
+    std::string_view a = cmd.args.empty() ? std::string_view() : cmd.args[0];
+    auto res = std::from_chars(a.data(), a.data() + a.size(), id);
+    if (a.empty() || res.ec != std::errc() || res.ptr != a.data() + a.size())
+      return Reply::error("usage: JOB id");
+    if (!jobs_.status(id, st)) return {Reply::Kind::kNotFound, {}};
+    static const char* const kStates[] = {"queued", "running", "done",
+                                          "cancelled"};
+    return {Reply::Kind::kRaw,
+            "JOB " + std::to_string(id) + ' ' +
+                kStates[static_cast<int>(st.state)] + " scanned " +
+                std::to_string(st.scanned) + " deleted " +
+                std::to_string(st.deleted) + "\n"};
+  }
+
+  if (name == "STATS") {
+    StoreStats st;
+    st.keys = kv_.size();
+    st.write_locks = kv_.write_locks();
+    st.lazy_free_pending = kv_.lazy_free_pending();
+    const ValueCodec::Counters c = kv_.codec_counters();
+    st.compressed_values = c.compressed;
+    st.compress_bytes_in = c.bytes_in;
+    st.compress_bytes_out = c.bytes_out;
+    st.compress_bytes_tried = c.bytes_tried;
+    st.compress_ns = c.compress_ns;
+    st.decompressed_bytes = c.decompressed;
+    st.decompress_ns = c.decompress_ns;
+    st.dict_bytes = c.dict_bytes;
+    const auto enc = kv_.encoding_counts();
+    st.values_int = enc[static_cast<int>(StoredValue::Enc::kInt)];
+    st.values_embedded = enc[static_cast<int>(StoredValue::Enc::kEmbed)];
+    st.values_raw = enc[static_cast<int>(StoredValue::Enc::kRaw)];
+    st.values_lz = enc[static_cast<int>(StoredValue::Enc::kLz)] +
+                   enc[static_cast<int>(StoredValue::Enc::kLzDict)];
+    st.values_hash = enc[static_cast<int>(StoredValue::Enc::kHash)];
+    st.values_zset = enc[static_cast<int>(StoredValue::Enc::kZSet)];
+    st.values_list = enc[static_cast<int>(StoredValue::Enc::kList)];
+    st.blocked_clients = parker_ ? parker_->waiting() : 0;
+    return {Reply::Kind::kRaw, stats_.render(threads_, st)};
+  }
+
+  if (name == "QUIT") return {Reply::Kind::kBye, {}};
+
+  return Reply::error("unknown command");
+}
+
+// Fields are single tokens, so values can't contain spaces here (unlike
+// SET).
+Reply CommandEngine::hash_command(const Command& cmd) {
+  const std::string& name = cmd.name;
+  const auto& a = cmd.args;
+  using Enc = StoredValue::Enc;
+
+  if (name == "HSET" || name == "HDEL") {
+    const bool set = name == "HSET";
+    if (set ? a.size() < 3 || a.size() % 2 == 0 : a.size() < 2)
+      return Reply::error(set ? "usage: HSET key field value [field value ...]"
+                              : "usage: HDEL key field [field ...]");
+    return kv_.modify(HashedKey(a[0]), [&](StoredValue& v) {
+      if (!v && set)
+        v = StoredValue::of_object(std::make_shared<HashObject>(), Enc::kHash);
+      if (!v) return Reply(Reply::Kind::kValue, "0");
+      if (v.enc() != Enc::kHash) return wrong_type();
+      auto* h = v.object<HashObject>();
+      size_t n = 0;
+      if (set) {
+        for (size_t i = 1; i < a.size(); i += 2) n += h->set(a[i], a[i + 1]);
+      } else {
+        for (size_t i = 1; i < a.size(); i++) n += h->del(a[i]);
+        if (h->length() == 0) v = StoredValue();
+      }
+      return Reply(Reply::Kind::kValue, std::to_string(n));
+    });
+  }
+
+  if (a.empty() || (name == "HGET" && a.size() != 2) ||
+      (name == "HMGET" && a.size() < 2))
+    return Reply::error("usage: " + name +
+                        (name == "HGET"    ? " key field"
+                         : name == "HMGET" ? " key field [field ...]"
+                                           : " key"));
+  return kv_.view(HashedKey(a[0]), [&](const StoredValue* v) {
+    const HashObject* h = nullptr;
+    if (v) {
+      if (v->enc() != Enc::kHash) return wrong_type();
+      h = v->object<HashObject>();
+    }
+    if (name == "HLEN")
+      return Reply(Reply::Kind::kValue, std::to_string(h ? h->length() : 0));
+    std::string_view val;
+    if (name == "HGET") {
+      if (!h || !h->get(a[1], val)) return Reply(Reply::Kind::kNotFound, {});
+      return Reply(Reply::Kind::kValue, std::string(val));
+    }
+    Reply r(Reply::Kind::kArray, {});
+    if (name == "HMGET") {
+      r.items.reserve(a.size() - 1);
+      for (size_t i = 1; i < a.size(); i++) {
+        if (h && h->get(a[i], val))
+          r.items.push_back("VALUE " + std::string(val));
+        else
+          r.items.emplace_back("NOTFOUND");
+      }
+    } else if (h) {  // HGETALL
+      r.items.reserve(h->length());
+      h->for_each([&](std::string_view f, std::string_view fv) {
+        std::string item(f);
+        item += ' ';
+        item += fv;
+        r.items.push_back(std::move(item));
+      });
+    }
+    return r;
+  });
+}
+
+// Scores are doubles; "inf", "+inf" and "-inf" are allowed, NaN is not.
+static bool parse_score(std::string_view s, double& out) {
+  if (!s.empty() && s[0] == '+') s.remove_prefix(1);
+  if (s.empty() || s[0] == '+') return false;
+  auto res = std::from_chars(s.data(), s.data() + s.size(), out);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size() &&
+         !std::isnan(out);
+}
+
+// A ZRANGEBYSCORE bound: a score, or "(score" to exclude it.
+static bool parse_bound(std::string_view s, double& out, bool& excl) {
+  excl = !s.empty() && s[0] == '(';
+  if (excl) s.remove_prefix(1);
+  return parse_score(s, out);
+}
+
+// Shortest form that parses back to the same double.
+static std::string format_score(double d) {
+  char buf[32];
+  return std::string(buf, std::to_chars(buf, buf + sizeof(buf), d).ptr);
+}
+
+static bool parse_i64(std::string_view s, int64_t& out) {
+  auto res = std::from_chars(s.data(), s.data() + s.size(), out);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size();
+}
+
+Reply CommandEngine::zset_command(const Command& cmd) {
+  const std::string& name = cmd.name;
+  const auto& a = cmd.args;
+  using Enc = StoredValue::Enc;
+
+  if (name == "ZADD" || name == "ZINCRBY" || name == "ZREM") {
+    const bool add = name == "ZADD", incr = name == "ZINCRBY";
+    if (add ? a.size() < 3 || a.size() % 2 == 0
+            : incr ? a.size() != 3 : a.size() < 2)
+      return Reply::error(
+          add    ? "usage: ZADD key score member [score member ...]"
+          : incr ? "usage: ZINCRBY key delta member"
+                 : "usage: ZREM key member [member ...]");
+    std::vector<double> scores;  // parsed before taking the lock
+    for (size_t i = 1; (add || incr) && i < a.size(); i += 2) {
+      scores.emplace_back();
+      if (!parse_score(a[i], scores.back()))
+        return Reply::error("score is not a number");
+    }
+    return kv_.modify(HashedKey(a[0]), [&](StoredValue& v) {
+      if (!v && !add && !incr) return Reply(Reply::Kind::kValue, "0");
+      if (!v)
+        v = StoredValue::of_object(std::make_shared<ZSetObject>(), Enc::kZSet);
+      if (v.enc() != Enc::kZSet) return wrong_type();
+      auto* z = v.object<ZSetObject>();
+      if (incr) {
+        double s = 0;
+        z->score(a[2], s);
+        s += scores[0];
+        if (std::isnan(s)) {
+          if (z->length() == 0) v = StoredValue();
+          return Reply::error("resulting score is not a number");
+        }
+        z->add(a[2], s);
+        return Reply(Reply::Kind::kValue, format_score(s));
+      }
+      size_t n = 0;
+      if (add) {
+        for (size_t i = 1; i < a.size(); i += 2)
+          n += z->add(a[i + 1], scores[i / 2]);
+      } else {
+        for (size_t i = 1; i < a.size(); i++) n += z->remove(a[i]);
+        if (z->length() == 0) v = StoredValue();
+      }
+      return Reply(Reply::Kind::kValue, std::to_string(n));
+    });
+  }
+
+  // Reads. Range replies are ARRAY n, then "member" or "member score"
+  // lines (WITHSCORES).
+  bool with_scores = false;
+  int64_t start = 0, stop = -1;
+  double min = 0, max = 0;
+  bool min_excl = false, max_excl = false;
+  size_t offset = 0, limit = SIZE_MAX;
+  if (name == "ZRANGE" || name == "ZRANGEBYSCORE") {
+    const bool by_score = name == "ZRANGEBYSCORE";
+    bool ok = a.size() >= 3;
+    for (size_t i = 3; ok && i < a.size(); i++) {
+      if (iequals(a[i], "WITHSCORES")) {
+        with_scores = true;
+      } else if (by_score && iequals(a[i], "LIMIT") && i + 2 < a.size()) {
+        int64_t off, count;
+        ok = parse_i64(a[i + 1], off) && parse_i64(a[i + 2], count) &&
+             off >= 0;
+        offset = static_cast<size_t>(off);
+        if (count >= 0) limit = static_cast<size_t>(count);
+        i += 2;
+      } else {
+        ok = false;
+      }
+    }
+    if (ok && by_score)
+      ok = parse_bound(a[1], min, min_excl) &&
+           parse_bound(a[2], max, max_excl);
+    else if (ok)
+      ok = parse_i64(a[1], start) && parse_i64(a[2], stop);
+    if (!ok)
+      return Reply::error(
+          by_score ? "usage: ZRANGEBYSCORE key min max [WITHSCORES] "
+                     "[LIMIT offset count]"
+                   : "usage: ZRANGE key start stop [WITHSCORES]");
+  } else if (a.size() != (name == "ZCARD" ? 1u : 2u)) {
+    return Reply::error("usage: " + name +
+                        (name == "ZCARD" ? " key" : " key member"));
+  }
+
+  return kv_.view(HashedKey(a[0]), [&](const StoredValue* v) {
+    const ZSetObject* z = nullptr;
+    if (v) {
+      if (v->enc() != Enc::kZSet) return wrong_type();
+      z = v->object<ZSetObject>();
+    }
+    if (name == "ZCARD")
+      return Reply(Reply::Kind::kValue, std::to_string(z ? z->length() : 0));
+    if (name == "ZSCORE") {
+      double s;
+      if (!z || !z->score(a[1], s)) return Reply(Reply::Kind::kNotFound, {});
+      return Reply(Reply::Kind::kValue, format_score(s));
+    }
+    if (name == "ZRANK") {
+      size_t r;
+      if (!z || !z->rank(a[1], r)) return Reply(Reply::Kind::kNotFound, {});
+      return Reply(Reply::Kind::kValue, std::to_string(r));
+    }
+    std::vector<ZSetObject::Entry> entries;
+    if (z && name == "ZRANGE") {
+      // Negative positions count from the end, as in Redis.
+      const int64_t n = static_cast<int64_t>(z->length());
+      if (start < 0) start = std::max<int64_t>(start + n, 0);
+      if (stop < 0) stop += n;
+      if (stop >= 0)
+        z->range(static_cast<size_t>(start), static_cast<size_t>(stop),
+                 entries);
+    } else if (z) {
+      z->range_by_score(min, min_excl, max, max_excl, offset, limit, entries);
+    }
+    Reply r(Reply::Kind::kArray, {});
+    r.items.reserve(entries.size());
+    for (auto& [member, score] : entries) {
+      r.items.push_back(std::move(member));
+      if (with_scores) r.items.back() += ' ' + format_score(score);
+    }
+    return r;
+  });
+}
+
+// Longest BLPOP timeout accepted, in seconds.
+static constexpr double kMaxBlockSeconds = 1e9;
+
+// Elements are single tokens, as hash fields are. BLPOP replies as LPOP
+// does, or NOTFOUND once its timeout (seconds, 0 = none) passes; see Parker.
+Reply CommandEngine::list_command(const Command& cmd) {
+  const std::string& name = cmd.name;
+  const auto& a = cmd.args;
+  using Enc = StoredValue::Enc;
+
+  if (name == "LPUSH" || name == "RPUSH") {
+    if (a.size() < 2)
+      return Reply::error("usage: " + name + " key element [element ...]");
+    return kv_.modify(HashedKey(a[0]), [&](StoredValue& v) {
+      if (!v)
+        v = StoredValue::of_object(std::make_shared<ListObject>(), Enc::kList);
+      if (v.enc() != Enc::kList) return wrong_type();
+      auto* l = v.object<ListObject>();
+      for (size_t i = 1; i < a.size(); i++) {
+        if (name[0] == 'L')
+          l->push_front(a[i]);
+        else
+          l->push_back(a[i]);
+      }
+      const size_t n = l->length();
+      serve_waiters(a[0], v);
+      return Reply(Reply::Kind::kValue, std::to_string(n));
+    });
+  }
+
+  if (name == "LPOP" || name == "RPOP" || name == "BLPOP") {
+    const bool block = name == "BLPOP";
+    if (a.size() != (block ? 2u : 1u))
+      return Reply::error("usage: " + name + (block ? " key timeout" : " key"));
+    std::chrono::milliseconds timeout{0};
+    if (block) {
+      double secs;
+      std::string_view t = a[1];
+      auto res = std::from_chars(t.data(), t.data() + t.size(), secs);
+      if (res.ec != std::errc() || res.ptr != t.data() + t.size() ||
+          !(secs >= 0 && secs <= kMaxBlockSeconds))
+        return Reply::error("timeout is not a number of seconds");
+      if (!parker_) return Reply::error("blocking commands are unavailable");
+      timeout = std::chrono::ceil<std::chrono::milliseconds>(
+          std::chrono::duration<double>(secs));
+    }
+    return kv_.modify(HashedKey(a[0]), [&](StoredValue& v) {
+      if (v && v.enc() != Enc::kList) return wrong_type();
+      if (!v) {
+        if (!block) return Reply(Reply::Kind::kNotFound, {});
+        Reply r(Reply::Kind::kBlocked, {});
+        r.ticket = parker_->wait(a[0], timeout);
+        return r;
+      }
+      auto* l = v.object<ListObject>();
+      std::string out;
+      if (name[0] == 'R')
+        l->pop_back(out);
+      else
+        l->pop_front(out);
+      if (l->length() == 0) v = StoredValue();
+      return Reply(Reply::Kind::kValue, std::move(out));
+    });
+  }
+
+  int64_t start = 0, stop = -1;
+  if (name == "LLEN" ? a.size() != 1
+                     : a.size() != 3 || !parse_i64(a[1], start) ||
+                           !parse_i64(a[2], stop))
+    return Reply::error(name == "LLEN" ? "usage: LLEN key"
+                                       : "usage: LRANGE key start stop");
+  return kv_.view(HashedKey(a[0]), [&](const StoredValue* v) {
+    const ListObject* l = nullptr;
+    if (v) {
+      if (v->enc() != Enc::kList) return wrong_type();
+      l = v->object<ListObject>();
+    }
+    if (name == "LLEN")
+      return Reply(Reply::Kind::kValue, std::to_string(l ? l->length() : 0));
+    Reply r(Reply::Kind::kArray, {});
+    if (l) {
+      const int64_t n = static_cast<int64_t>(l->length());
+      if (start < 0) start = std::max<int64_t>(start + n, 0);
+      if (stop < 0) stop += n;
+      if (stop >= 0)
+        l->range(static_cast<size_t>(start), static_cast<size_t>(stop),
+                 r.items);
+    }
+    return r;
+  });
+}
+
+// Well-formed writes only; malformed ones go through execute() for the
+// usage error.
+static bool is_batchable_write(const Command& cmd) {
+  if (cmd.name == "SET" || cmd.name == "DEL") return !cmd.args.empty();
+  if (cmd.name == "SETB") return cmd.args.size() >= 2;
+  return false;
+}
+
+static bool is_batchable_get(const Command& cmd) {
+  return cmd.name == "GET" && !cmd.args.empty();
+}
+
+void CommandEngine::execute_batch(Command* cmds, size_t n,
+                                  std::vector<Reply>& replies) {
+  replies.resize(n);
+  size_t i = 0;
+  while (i < n) {
+    if (is_batchable_get(cmds[i])) {
+      size_t end = i + 1;
+      while (end < n && is_batchable_get(cmds[end])) end++;
+      if (end - i == 1)
+        replies[i] = execute(cmds[i]);
+      else
+        get_batch(cmds, i, end, replies);
+      i = end;
+      continue;
+    }
+    if (!is_batchable_write(cmds[i])) {
+      replies[i] = execute(cmds[i]);
+      i++;
+      continue;
+    }
+    size_t end = i + 1;
+    while (end < n && is_batchable_write(cmds[end])) end++;
+    if (end - i == 1)
+      replies[i] = execute(cmds[i]);
+    else
+      apply_writes(cmds, i, end, replies);
+    i = end;
+  }
+}
+
+void CommandEngine::apply_writes(Command* cmds, size_t begin, size_t end,
+                                 std::vector<Reply>& replies) {
+  std::vector<KVWrite> writes;
+  writes.reserve(end - begin);
+  for (size_t i = begin; i < end; i++) {
+    Command& cmd = cmds[i];
+    StoredValue v;
+    if (cmd.name == "SET") {
+      const std::string_view s = cmd.rest_after(0);
+      if (!(v = StoredValue::of_inline(s)))
+        v = StoredValue(std::make_shared<const std::string>(s));
+    } else if (cmd.name == "SETB") {
+      if (!(v = StoredValue::of_inline(cmd.payload)))
+        v = StoredValue(
+            std::make_shared<const std::string>(std::move(cmd.payload)));
+      cmd.payload.clear();
+    }
+    writes.push_back({HashedKey(cmd.args[0]), std::move(v)});
+  }
+
+  std::vector<char> found;
+  kv_.apply(writes, found);
+
+  for (size_t i = begin; i < end; i++) {
+    if (cmds[i].name != "DEL" || found[i - begin])
+      replies[i] = Reply::ok();
+    else
+      replies[i] = {Reply::Kind::kNotFound, {}};
+  }
+}
+
+void CommandEngine::get_batch(Command* cmds, size_t begin, size_t end,
+                              std::vector<Reply>& replies) {
+  std::vector<HashedKey> keys;
+  keys.reserve(end - begin);
+  for (size_t i = begin; i < end; i++) keys.emplace_back(cmds[i].args[0]);
+  std::vector<std::shared_ptr<const std::string>> vals(keys.size());
+  std::vector<char> collection(keys.size());
+  kv_.get_many(keys.data(), keys.size(), vals.data(), collection.data());
+
+  for (size_t i = begin; i < end; i++) {
+    const auto& v = vals[i - begin];
+    if (v)
+      replies[i] = {Reply::Kind::kValue, *v};
+    else if (collection[i - begin])
+      replies[i] = wrong_type();
+    else
+      replies[i] = {Reply::Kind::kNotFound, {}};
+  }
+}
+
+void CommandEngine::serve_waiters(std::string_view key, StoredValue& v) {
+  // Blocked BLPOPs take elements before the lock is released, so nobody
+  // else can pop them first.
+  if (!parker_ || !parker_->has_waiters()) return;
+  auto* l = v.object<ListObject>();
+  parker_->serve(key, [&](std::string& out) { return l->pop_front(out); });
+  if (l->length() == 0) v = StoredValue();
+}
+
+Reply CommandEngine::end_wait(const std::shared_ptr<ParkTicket>& t) {
+  if (parker_) parker_->cancel(t);
+  if (t->state == ParkTicket::State::kServed)
+    return {Reply::Kind::kValue, t->value};
+  return {Reply::Kind::kNotFound, {}};
+}
+
+void CommandEngine::abandon_wait(const std::shared_ptr<ParkTicket>& t) {
+  if (parker_) parker_->cancel(t);
+  if (t->state != ParkTicket::State::kServed) return;
+  using Enc = StoredValue::Enc;
+  kv_.modify(HashedKey(t->key), [&](StoredValue& v) {
+    if (!v)
+      v = StoredValue::of_object(std::make_shared<ListObject>(), Enc::kList);
+    if (v.enc() != Enc::kList) return 0;  // the key was reused meanwhile
+    v.object<ListObject>()->push_front(t->value);
+    serve_waiters(t->key, v);
+    return 0;
+  });
+}
+
+std::string CommandEngine::handle(std::string_view line) {
+  Command cmd;
+  std::string out;
+  if (!parse_command(line, cmd)) {
+    format_reply(Reply::error("unknown command"), out);
+    return out;
+  }
+  Reply r = execute(cmd);
+  if (r.kind == Reply::Kind::kBlocked) r = end_wait(r.ticket);
+  format_reply(r, out);
+  return out;
+}
+
+std::string handle_command(const std::string& line) {
+  static KVStore kv;
+  static Stats stats;
+  static CommandEngine engine(kv, stats);
+  return engine.handle(line);
+}
@@ -0,0 +1,141 @@
+#include "connection.hpp"
+
+#include <string>
+#include <vector>
+
+#include "capture.hpp"
+#include "command.hpp"
+#include "parker.hpp"
+#include "protocol.hpp"
+#include "stats.hpp"
+
+// Most requests already buffered when the first one is read are executed as
+// one batch, with one send for all their replies.
+static constexpr size_t kMaxBatch = 64;
+
+// After a BLPOP reply, with no request buffered, the connection waits for
+// the next one in the parker rather than on this worker.
+static bool park_idle(Session& s, CommandEngine& engine) {
+  Parker* p = engine.parker();
+  return p && !s.lr.has_line() && p->park_idle(s.fd, s.shared_from_this());
+}
+
+bool serve_connection(Session& s, CommandEngine& engine, Stats& stats,
+                      const std::atomic<bool>& running, Capture* capture) {
+  const int fd = s.fd;
+  LineReader& lr = s.lr;
+  std::vector<std::string>& lines = s.lines;
+  std::vector<Command>& cmds = s.cmds;
+  std::vector<Reply>& replies = s.replies;
+  std::string& resp = s.resp;
+
+  if (!s.greeted) {
+    s.greeted = true;
+    lines.resize(kMaxBatch);
+    cmds.resize(kMaxBatch);
+    s.conn_id = capture ? capture->new_connection() : 0;
+    // banner
+    send_str(fd, "OK tcp-kv ready\n");
+  }
+  if (s.ticket) {  // back from a BLPOP wait
+    auto ticket = std::move(s.ticket);
+    resp.clear();
+    format_reply(engine.end_wait(ticket), resp);
+    if (!send_str(fd, resp)) {
+      engine.abandon_wait(ticket);
+      return false;
+    }
+    if (park_idle(s, engine)) return true;
+  }
+
+  while (running.load()) {
+    // Block for one line, then take whatever complete lines are buffered.
+    // A BLPOP ends the batch, since it may park the connection.
+    size_t n = 0;
+    const char* fatal = nullptr;
+    do {
+      auto line_opt = lr.read_line(fd);
+      if (!line_opt.has_value()) return false;
+      if (*line_opt == "**LINE_TOO_LONG**") {
+        fatal = "ERR line too long\n";
+        break;
+      }
+      std::string& line = lines[n];
+      line = std::move(*line_opt);
+      Command& cmd = cmds[n];
+      if (!parse_command(line, cmd)) continue;
+
+      size_t payload = 0;
+      if (!engine.payload_size(cmd, payload)) {
+        fatal = "ERR bad value length\n";
+        break;
+      }
+      if (payload > 0 && !lr.read_exact(fd, payload, cmd.payload))
+        return false;
+      if (capture) capture->record(s.conn_id, line, cmd.payload);
+
+      stats.inc_requests();
+      n++;
+      if (cmd.name == "QUIT" || cmd.name == "BLPOP") break;
+    } while (n < kMaxBatch && lr.has_line());
+
+    engine.execute_batch(cmds.data(), n, replies);
+    std::shared_ptr<ParkTicket> ticket;
+    if (n > 0 && replies[n - 1].kind == Reply::Kind::kBlocked)
+      ticket = std::move(replies[n - 1].ticket);
+    resp.clear();
+    bool bye = false;
+    for (size_t i = 0; i < n; i++) {
+      const Reply& r = replies[i];
+      if (r.kind == Reply::Kind::kBlob || r.kind == Reply::Kind::kBlobLz) {
+        // Send the stored value directly instead of copying it into resp.
+        if (r.kind == Reply::Kind::kBlob)
+          format_blob_header(r.blob->size(), resp);
+        else
+          format_blob_lz_header(r.raw_len, r.blob->size(), resp);
+        if (!send_str(fd, resp) ||
+            !send_all(fd, r.blob->data(), r.blob->size())) {
+          if (ticket) engine.abandon_wait(ticket);
+          return false;
+        }
+        resp.clear();
+        continue;
+      }
+      format_reply(r, resp);
+      if (r.kind == Reply::Kind::kBye) bye = true;
+    }
+    if (fatal) resp += fatal;
+    replies.clear();  // drop blob handles before blocking again
+    if (!resp.empty() && !send_str(fd, resp)) {
+      if (ticket) engine.abandon_wait(ticket);
+      return false;
+    }
+    if (bye || fatal) {
+      if (ticket) engine.abandon_wait(ticket);
+      return false;
+    }
+
+    if (ticket) {
+      // Once parked, another worker may resume the session at any time.
+      s.ticket = ticket;
+      if (engine.parker()->park(ticket, fd, s.shared_from_this()))
+        return true;
+      s.ticket.reset();
+      resp.clear();
+      format_reply(engine.end_wait(ticket), resp);
+      if (!send_str(fd, resp)) {
+        engine.abandon_wait(ticket);
+        return false;
+      }
+    }
+    if (n > 0 && cmds[n - 1].name == "BLPOP" && park_idle(s, engine))
+      return true;
+  }
+  return false;
+}
+
+void serve_connection(int fd, CommandEngine& engine, Stats& stats,
+                      const std::atomic<bool>& running, Capture* capture) {
+  auto s = std::make_shared<Session>(fd);
+  serve_connection(*s, engine, stats, running, capture);
+}
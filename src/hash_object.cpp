@@ -0,0 +1,79 @@
+#include "hash_object.hpp"
+
+#include "key_hash.hpp"
+
+size_t HashObject::find(std::string_view field) const {
+  for (size_t p = 0; p < packed_.size();) {
+    const size_t at = p;
+    if (entry(p) == field) return at;
+    entry(p);  // its value
+  }
+  return std::string::npos;
+}
+
+void HashObject::convert() {
+  auto table = std::make_unique<HashTable<std::string>>();
+  for_each([&](std::string_view f, std::string_view v) {
+    table->try_emplace(f, key_hash(f)).first->assign(v.data(), v.size());
+  });
+  table_ = std::move(table);
+  packed_.clear();
+  packed_.shrink_to_fit();
+  count_ = 0;
+}
+
+bool HashObject::set(std::string_view field, std::string_view value) {
+  size_t at = std::string::npos;
+  if (!table_) {
+    at = find(field);
+    if (field.size() > kPackedMaxLen || value.size() > kPackedMaxLen ||
+        (at == std::string::npos && count_ == kPackedMaxFields))
+      convert();
+  }
+  if (table_) {
+    auto slot = table_->try_emplace(field, key_hash(field));
+    slot.first->assign(value.data(), value.size());
+    return slot.second;
+  }
+
+  if (at != std::string::npos) {
+    size_t p = at;
+    entry(p);
+    const size_t old = static_cast<unsigned char>(packed_[p]);
+    packed_[p] = static_cast<char>(value.size());
+    packed_.replace(p + 1, old, value.data(), value.size());
+    return false;
+  }
+  packed_ += static_cast<char>(field.size());
+  packed_.append(field.data(), field.size());
+  packed_ += static_cast<char>(value.size());
+  packed_.append(value.data(), value.size());
+  count_++;
+  return true;
+}
+
+bool HashObject::get(std::string_view field, std::string_view& value) const {
+  if (table_) {
+    const std::string* v = table_->find(field, key_hash(field));
+    if (!v) return false;
+    value = *v;
+    return true;
+  }
+  size_t p = find(field);
+  if (p == std::string::npos) return false;
+  entry(p);
+  value = entry(p);
+  return true;
+}
+
+bool HashObject::del(std::string_view field) {
+  if (table_) return table_->erase(field, key_hash(field));
+  const size_t at = find(field);
+  if (at == std::string::npos) return false;
+  size_t p = at;
+  entry(p);
+  entry(p);
+  packed_.erase(at, p - at);
+  count_--;
+  return true;
+}
@@ -0,0 +1,117 @@
+#include "jobs.hpp"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "key_match.hpp"
+#include "kvstore.hpp"
+
+JobManager::JobManager(KVStore& kv) : kv_(kv), q_(kQueueCap) {}
+
+JobManager::~JobManager() {
+  stop_.store(true);
+  q_.close();
+  if (thread_.joinable()) thread_.join();
+}
+
+uint64_t JobManager::delete_prefix(std::string_view prefix) {
+  return submit(false, prefix);
+}
+
+uint64_t JobManager::delete_matching(std::string_view pattern) {
+  return submit(true, pattern);
+}
+
+uint64_t JobManager::submit(bool glob, std::string_view match) {
+  std::call_once(started_, [this] {
+    thread_ = std::thread([this] {
+      // Jobs are never urgent; leave the CPU to request threads.
+      setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+      while (auto job = q_.pop()) {
+        if (stop_.load())
+          (*job)->state.store(State::kCancelled);
+        else
+          run(**job);
+      }
+    });
+  });
+
+  auto job = std::make_shared<Job>();
+  job->glob = glob;
+  job->match = std::string(match);
+  std::lock_guard<std::mutex> lk(mu_);
+  job->id = next_id_;
+  std::shared_ptr<Job> queued = job;
+  if (!q_.try_push(queued)) return 0;
+  next_id_++;
+  jobs_.emplace(job->id, job);
+  // Forget the oldest finished jobs.
+  for (auto it = jobs_.begin();
+       jobs_.size() > kKeepJobs && it != jobs_.end();) {
+    State st = it->second->state.load();
+    if (st == State::kDone || st == State::kCancelled)
+      it = jobs_.erase(it);
+    else
+      ++it;
+  }
+  return job->id;
+}
+
+bool JobManager::status(uint64_t id, Status& out) const {
+  std::lock_guard<std::mutex> lk(mu_);
+  auto it = jobs_.find(id);
+  if (it == jobs_.end()) return false;
+  const Job& job = *it->second;
+  out = {job.state.load(), job.scanned.load(), job.deleted.load()};
+  return true;
+}
+
+void JobManager::run(Job& job) {
+  job.state.store(State::kRunning);
+  // With keys in order, a prefix job only visits its own range.
+  const bool ranged = !job.glob && kv_.ordered();
+  const std::string end = ranged ? prefix_end(job.match) : std::string();
+  std::string from = job.match;
+  std::string cursor = "0";
+
+  std::vector<std::string> keys;
+  std::vector<KVWrite> dels;
+  std::vector<char> found;
+  for (;;) {
+    if (stop_.load()) {
+      job.state.store(State::kCancelled);
+      return;
+    }
+    keys.clear();
+    bool last;
+    if (ranged) {
+      kv_.range_keys(from, end, kStep, keys);
+      last = keys.size() < kStep;
+      if (!last) from = keys.back() + '\0';  // next possible key
+    } else {
+      cursor = kv_.scan(cursor, kStep, keys);
+      last = cursor == "0";
+    }
+    job.scanned.fetch_add(keys.size());
+
+    dels.clear();
+    for (const auto& k : keys) {
+      bool hit = job.glob ? glob_match(job.match, k)
+                          : k.compare(0, job.match.size(), job.match) == 0;
+      if (hit) dels.push_back({HashedKey(k), {}});
+    }
+    if (!dels.empty()) {
+      // Also frees the removed values, here rather than on a request thread.
+      kv_.apply(dels, found);
+      uint64_t n = 0;
+      for (char f : found) n += f;
+      job.deleted.fetch_add(n);
+    }
+    if (last) break;
+    std::this_thread::yield();
+  }
+  job.state.store(State::kDone);
+}
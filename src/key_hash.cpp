@@ -0,0 +1,161 @@
+#include "key_hash.hpp"
+
+#include <cstdlib>
+#include <random>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// ---- Long keys: 8 x 64-bit lanes over 64-byte stripes ----
+//
+// Per lane i: k = data[i] ^ secret[i]; acc[i ^ 1] += data[i];
+// acc[i] += lo32(k) * hi32(k). Every 16 stripes the lanes are scrambled.
+// The remaining tail and the folded lanes are finished with wyhash.
+
+namespace {
+
+constexpr size_t kStripe = 64;
+constexpr size_t kStripesPerBlock = 16;
+constexpr uint64_t kPrime32 = 0x9E3779B1u;
+
+struct LongState {
+  uint64_t seed;
+  uint64_t secret[8];
+  uint64_t scramble[8];
+};
+
+const LongState& long_state() {
+  static const LongState st = [] {
+    LongState s{};
+    s.seed = key_hash_seed();
+    for (int i = 0; i < 8; i++) {
+      s.secret[i] = wy_mix(s.seed ^ kWyP[i & 3], kWyP[(i + 1) & 3] + i);
+      s.scramble[i] = wy_mix(s.secret[i], kWyP[(i + 2) & 3]);
+    }
+    return s;
+  }();
+  return st;
+}
+
+void accumulate_scalar(uint64_t* acc, const uint8_t* p, size_t stripes,
+                       const LongState& st) {
+  for (size_t s = 0; s < stripes; s++, p += kStripe) {
+    for (int i = 0; i < 8; i++) {
+      uint64_t d = wy_r8(p + 8 * i);
+      uint64_t k = d ^ st.secret[i];
+      acc[i ^ 1] += d;
+      acc[i] += (k & 0xffffffffu) * (k >> 32);
+    }
+    if ((s + 1) % kStripesPerBlock == 0) {
+      for (int i = 0; i < 8; i++) {
+        acc[i] ^= acc[i] >> 47;
+        acc[i] ^= st.scramble[i];
+        acc[i] *= kPrime32;
+      }
+    }
+  }
+}
+
+#if defined(__x86_64__)
+#define TCPKV_AVX2 __attribute__((target("avx2")))
+
+TCPKV_AVX2 __m256i load256(const void* p) {
+  return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+}
+
+TCPKV_AVX2 __m256i accumulate_lanes(__m256i acc, __m256i d, __m256i secret) {
+  __m256i k = _mm256_xor_si256(d, secret);
+  __m256i prod = _mm256_mul_epu32(k, _mm256_srli_epi64(k, 32));
+  // Swap adjacent 64-bit lanes: acc[i ^ 1] += d[i].
+  __m256i swapped = _mm256_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+  return _mm256_add_epi64(_mm256_add_epi64(acc, swapped), prod);
+}
+
+TCPKV_AVX2 __m256i scramble_lanes(__m256i acc, __m256i key) {
+  const __m256i prime = _mm256_set1_epi32(static_cast<int>(kPrime32));
+  acc = _mm256_xor_si256(acc, _mm256_srli_epi64(acc, 47));
+  acc = _mm256_xor_si256(acc, key);
+  // 64 x 32-bit multiply from two 32 x 32 products.
+  __m256i lo = _mm256_mul_epu32(acc, prime);
+  __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(acc, 32), prime);
+  return _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+}
+
+TCPKV_AVX2 void accumulate_avx2(uint64_t* acc, const uint8_t* p,
+                                size_t stripes, const LongState& st) {
+  __m256i a0 = load256(acc), a1 = load256(acc + 4);
+  const __m256i s0 = load256(st.secret), s1 = load256(st.secret + 4);
+  const __m256i c0 = load256(st.scramble), c1 = load256(st.scramble + 4);
+  for (size_t s = 0; s < stripes; s++, p += kStripe) {
+    a0 = accumulate_lanes(a0, load256(p), s0);
+    a1 = accumulate_lanes(a1, load256(p + 32), s1);
+    if ((s + 1) % kStripesPerBlock == 0) {
+      a0 = scramble_lanes(a0, c0);
+      a1 = scramble_lanes(a1, c1);
+    }
+  }
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), a0);
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + 4), a1);
+}
+#endif
+
+bool detect_avx2() {
+#if defined(__x86_64__)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+uint64_t finish_long(uint64_t* acc, const uint8_t* p, size_t n,
+                     const LongState& st) {
+  uint64_t h = n * kWyP[0];
+  for (int i = 0; i < 8; i += 2)
+    h ^= wy_mix(acc[i] ^ st.secret[i], acc[i + 1] ^ st.scramble[i]);
+  // The last 1..64 bytes are not in any stripe.
+  size_t tail = n % kStripe == 0 ? kStripe : n % kStripe;
+  return wyhash(p + n - tail, tail, st.seed ^ h);
+}
+
+uint64_t hash_long(const char* data, size_t n, bool avx2) {
+  const LongState& st = long_state();
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+  uint64_t acc[8];
+  for (int i = 0; i < 8; i++) acc[i] = st.seed ^ st.secret[i];
+  size_t stripes = (n - 1) / kStripe;
+#if defined(__x86_64__)
+  if (avx2)
+    accumulate_avx2(acc, p, stripes, st);
+  else
+    accumulate_scalar(acc, p, stripes, st);
+#else
+  (void)avx2;
+  accumulate_scalar(acc, p, stripes, st);
+#endif
+  return finish_long(acc, p, n, st);
+}
+
+}  // namespace
+
+uint64_t key_hash_make_seed() {
+  if (const char* env = std::getenv("TCPKV_HASH_SEED"))
+    return std::strtoull(env, nullptr, 0);
+  std::random_device rd;
+  return (uint64_t(rd()) << 32) ^ rd();
+}
+
+bool key_hash_uses_avx2() {
+  static const bool avx2 = detect_avx2();
+  return avx2;
+}
+
+uint64_t key_hash_long(const char* p, size_t n) {
+  // Without AVX2 the striped loop is slower than plain wyhash.
+  if (!key_hash_uses_avx2()) return wyhash(p, n, key_hash_seed());
+  return hash_long(p, n, true);
+}
+
+uint64_t key_hash_long_scalar(const char* p, size_t n) {
+  return hash_long(p, n, false);
+}
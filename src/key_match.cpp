@@ -0,0 +1,72 @@
+#include "key_match.hpp"
+
+#include <utility>
+
+std::string prefix_end(std::string_view prefix) {
+  std::string end(prefix);
+  while (!end.empty() && static_cast<unsigned char>(end.back()) == 0xff)
+    end.pop_back();
+  if (!end.empty()) end.back() = static_cast<char>(end.back() + 1);
+  return end;
+}
+
+// Matches one pattern element at p[i] (?, [set], \x or a literal byte)
+// against c and sets `next` past it.
+static bool glob_one(std::string_view p, size_t i, char c, size_t& next) {
+  if (p[i] == '?') {
+    next = i + 1;
+    return true;
+  }
+  if (p[i] == '[') {
+    size_t j = i + 1;
+    const bool negate = j < p.size() && p[j] == '^';
+    if (negate) j++;
+    bool hit = false;
+    for (bool first = true; j < p.size() && (first || p[j] != ']');
+         first = false) {
+      if (p[j] == '\\' && j + 1 < p.size()) j++;
+      if (j + 2 < p.size() && p[j + 1] == '-' && p[j + 2] != ']') {
+        auto lo = static_cast<unsigned char>(p[j]);
+        auto hi = static_cast<unsigned char>(p[j + 2]);
+        if (lo > hi) std::swap(lo, hi);
+        auto u = static_cast<unsigned char>(c);
+        hit |= lo <= u && u <= hi;
+        j += 3;
+      } else {
+        hit |= p[j] == c;
+        j++;
+      }
+    }
+    if (j < p.size()) {
+      next = j + 1;
+      return hit != negate;
+    }
+    // No closing ']': the '[' is a literal.
+  }
+  if (p[i] == '\\' && i + 1 < p.size()) i++;
+  next = i + 1;
+  return p[i] == c;
+}
+
+// A failed match after '*' retries with the star taking one more byte.
+bool glob_match(std::string_view p, std::string_view s) {
+  size_t pi = 0, si = 0;
+  size_t star = std::string_view::npos, mark = 0;
+  while (si < s.size()) {
+    size_t next;
+    if (pi < p.size() && p[pi] == '*') {
+      star = pi++;
+      mark = si;
+    } else if (pi < p.size() && glob_one(p, pi, s[si], next)) {
+      pi = next;
+      si++;
+    } else if (star != std::string_view::npos) {
+      pi = star + 1;
+      si = ++mark;
+    } else {
+      return false;
+    }
+  }
+  while (pi < p.size() && p[pi] == '*') pi++;
+  return pi == p.size();
+}
@@ -1,26 +1,463 @@
 #include "kvstore.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <functional>
 #include <mutex>
+#include <queue>
 #include <shared_mutex>
+#include <type_traits>
+#include <variant>
 
-void KVStore::set(const std::string& key, const std::string& value) {
-  std::unique_lock<std::shared_mutex> lk(mu_);
-  map_[key] = value;
+KVStore::KVStore(size_t shards) {
+  while ((size_t(1) << shard_bits_) < shards && shard_bits_ < 16)
+    shard_bits_++;
+  shards_ = std::make_unique<Shard[]>(shard_count());
 }
 
-std::optional<std::string> KVStore::get(const std::string& key) const {
-  std::shared_lock<std::shared_mutex> lk(mu_);
-  auto it = map_.find(key);
-  if (it == map_.end()) return std::nullopt;
-  return it->second;
+KVStore::~KVStore() = default;
+
+void KVStore::set(const HashedKey& key, std::string&& value) {
+  // Encoded before the lock and declared before it, so the replaced value
+  // is freed after it.
+  Value v = codec_.encode(std::move(value));
+  Shard& s = shard(key);
+  std::unique_lock<std::shared_mutex> lk(s.mu);
+  s.write_locks++;
+  auto slot = std::visit(
+      [&](auto& m) { return m.try_emplace(key.key, key.hash); }, s.map);
+  std::swap(*slot.first, v);
+  s.count(slot.first->enc(), v.enc());
+  if (slot.second && s.index) s.index->insert(key.key);
+}
+
+std::optional<std::string> KVStore::get(const HashedKey& key,
+                                        bool* collection) const {
+  Value stored;
+  {
+    const Shard& s = shard(key);
+    std::shared_lock<std::shared_mutex> lk(s.mu);
+    auto* v =
+        std::visit([&](auto& m) { return m.find(key.key, key.hash); }, s.map);
+    if (!v) return std::nullopt;
+    if (v->enc() == Value::Enc::kRaw) return *v->data();
+    if (v->is_inline()) return v->inline_string();
+    if (v->is_object()) {
+      if (collection) *collection = true;
+      return std::nullopt;
+    }
+    stored = *v;  // decompressed below, after the lock
+  }
+  return codec_.decode_string(stored);
+}
+
+std::shared_ptr<const std::string> KVStore::get_shared(
+    const HashedKey& key) const {
+  Value v = get_stored(key);
+  return v && !v.is_object() ? codec_.decode(v) : nullptr;
+}
+
+StoredValue KVStore::get_stored(const HashedKey& key) const {
+  const Shard& s = shard(key);
+  std::shared_lock<std::shared_mutex> lk(s.mu);
+  auto* v =
+      std::visit([&](auto& m) { return m.find(key.key, key.hash); }, s.map);
+  return v ? *v : Value();
+}
+
+void KVStore::get_many(const HashedKey* keys, size_t n,
+                       std::shared_ptr<const std::string>* out,
+                       char* collection) const {
+  // Keys prefetched ahead of their probe; small enough that the lines are
+  // still in L1 when used.
+  constexpr size_t kGroup = 16;
+
+  // Readers may hold several shard locks: writers only ever hold one, and
+  // shards are locked in ascending order.
+  std::vector<uint32_t> ids(n);
+  for (size_t i = 0; i < n; i++)
+    ids[i] = static_cast<uint32_t>(shard_of(keys[i]));
+  std::vector<uint32_t> locked(ids);
+  std::sort(locked.begin(), locked.end());
+  locked.erase(std::unique(locked.begin(), locked.end()), locked.end());
+  // Compressed and inline hits, decoded after the locks are dropped.
+  std::vector<std::pair<size_t, Value>> packed;
+  std::vector<std::shared_lock<std::shared_mutex>> lks;
+  lks.reserve(locked.size());
+  for (uint32_t id : locked) lks.emplace_back(shards_[id].mu);
+
+  // All shards use the same engine, so dispatch once per batch.
+  auto run = [&](auto* tag) {
+    using Map = std::remove_pointer_t<decltype(tag)>;
+    auto map = [&](size_t i) -> const Map& {
+      return std::get<Map>(shards_[ids[i]].map);
+    };
+    for (size_t g = 0; g < n; g += kGroup) {
+      const size_t end = std::min(n, g + kGroup);
+      for (size_t i = g; i < end; i++) map(i).prefetch_bucket(keys[i].hash);
+      for (size_t i = g; i < end; i++) map(i).prefetch_head(keys[i].hash);
+      for (size_t i = g; i < end; i++) {
+        auto* v = map(i).find(keys[i].key, keys[i].hash);
+        if (!v) {
+          out[i] = nullptr;
+          continue;
+        }
+        if (v->enc() != Value::Enc::kRaw) {
+          out[i] = nullptr;
+          if (!v->is_object())
+            packed.emplace_back(i, *v);
+          else if (collection)
+            collection[i] = 1;
+          continue;
+        }
+        out[i] = v->data();
+        __builtin_prefetch(out[i]->data());
+      }
+    }
+  };
+  if (engine() == KVEngine::kArt)
+    run(static_cast<ArtTree<Value>*>(nullptr));
+  else
+    run(static_cast<HashTable<Value>*>(nullptr));
+  lks.clear();
+  for (auto& [i, v] : packed) out[i] = codec_.decode(v);
+}
+
+bool KVStore::take(Shard& s, const HashedKey& key, Value& out) {
+  return std::visit(
+      [&](auto& m) {
+        auto* v = m.find(key.key, key.hash);
+        if (!v) return false;
+        out = std::move(*v);
+        s.count(Value::Enc::kNone, out.enc());
+        return m.erase(key.key, key.hash);
+      },
+      s.map);
+}
+
+bool KVStore::del(const HashedKey& key) {
+  Value old;  // freed after the lock is released
+  Shard& s = shard(key);
+  std::unique_lock<std::shared_mutex> lk(s.mu);
+  s.write_locks++;
+  if (!take(s, key, old)) return false;
+  if (s.index) s.index->erase(key.key);
+  return true;
+}
+
+bool KVStore::unlink(const HashedKey& key) {
+  Value old;
+  Shard& s = shard(key);
+  {
+    std::unique_lock<std::shared_mutex> lk(s.mu);
+    s.write_locks++;
+    if (!take(s, key, old)) return false;
+    if (s.index) s.index->erase(key.key);
+  }
+  if (old.on_heap() ? old.data()->size() >= kLazyFreeMinBytes
+                    : old.is_object() &&
+                          old.object<ValueObject>()->length() >=
+                              kLazyFreeMinItems)
+    lazy_.release(old.take_heap());
+  return true;
+}
+
+void KVStore::flush(bool async) {
+  for (size_t i = 0; i < shard_count(); i++) {
+    Shard& s = shards_[i];
+    std::shared_ptr<const void> old_map, old_index;
+    {
+      std::unique_lock<std::shared_mutex> lk(s.mu);
+      s.write_locks++;
+      std::visit(
+          [&](auto& m) {
+            auto old = std::make_shared<std::decay_t<decltype(m)>>();
+            old->swap(m);
+            old_map = std::move(old);
+          },
+          s.map);
+      std::fill(std::begin(s.encodings), std::end(s.encodings), 0);
+      if (s.index)
+        old_index = std::atomic_exchange(&s.index,
+                                         std::make_shared<SkipList>());
+    }
+    if (async) {
+      lazy_.release(std::move(old_map));
+      if (old_index) lazy_.release(std::move(old_index));
+    }
+  }
+}
+
+void KVStore::apply(std::vector<KVWrite>& writes,
+                    std::vector<char>& found) {
+  found.assign(writes.size(), 0);
+  // Encoded up front, outside the locks; each slot then receives the value
+  // its write replaced or removed, freed when this returns.
+  std::vector<Value> values(writes.size());
+  for (size_t i = 0; i < writes.size(); i++) {
+    Value& v = writes[i].value;
+    values[i] = v.enc() == Value::Enc::kRaw ? codec_.encode(v.take_data())
+                                             : std::move(v);
+  }
+  // Stable order by shard, so each shard's writes stay in request order.
+  std::vector<uint32_t> order(writes.size());
+  for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    return shard_of(writes[a].key) < shard_of(writes[b].key);
+  });
+
+  for (size_t i = 0; i < order.size();) {
+    const size_t idx = shard_of(writes[order[i]].key);
+    Shard& s = shards_[idx];
+    std::unique_lock<std::shared_mutex> lk(s.mu);
+    s.write_locks++;
+    for (; i < order.size() && shard_of(writes[order[i]].key) == idx; i++) {
+      const HashedKey& key = writes[order[i]].key;
+      Value& v = values[order[i]];
+      if (v) {
+        auto slot = std::visit(
+            [&](auto& m) { return m.try_emplace(key.key, key.hash); },
+            s.map);
+        std::swap(*slot.first, v);
+        s.count(slot.first->enc(), v.enc());
+        if (slot.second && s.index) s.index->insert(key.key);
+      } else if (take(s, key, v)) {
+        found[order[i]] = 1;
+        if (s.index) s.index->erase(key.key);
+      }
+    }
+  }
+}
+
+KVStore::IncrResult KVStore::incr(const HashedKey& key, int64_t delta,
+                                  int64_t& result) {
+  Shard& s = shard(key);
+  std::unique_lock<std::shared_mutex> lk(s.mu);
+  s.write_locks++;
+  auto* v =
+      std::visit([&](auto& m) { return m.find(key.key, key.hash); }, s.map);
+  // Every canonical decimal that fits is stored as kInt.
+  if (v && v->enc() != Value::Enc::kInt) return IncrResult::kNotInt;
+  if (__builtin_add_overflow(v ? v->int_value() : 0, delta, &result))
+    return IncrResult::kOverflow;
+  Value next = Value::of_int(result);
+  if (!v) {
+    v = std::visit(
+        [&](auto& m) { return m.try_emplace(key.key, key.hash).first; },
+        s.map);
+    if (s.index) s.index->insert(key.key);
+  }
+  s.count(Value::Enc::kInt, v->enc());
+  *v = std::move(next);
+  return IncrResult::kOk;
 }
 
-bool KVStore::del(const std::string& key) {
-  std::unique_lock<std::shared_mutex> lk(mu_);
-  return map_.erase(key) > 0;
+std::array<size_t, StoredValue::kEncodings> KVStore::encoding_counts()
+    const {
+  std::array<size_t, StoredValue::kEncodings> n{};
+  for (size_t i = 0; i < shard_count(); i++) {
+    std::shared_lock<std::shared_mutex> lk(shards_[i].mu);
+    for (int e = 1; e < StoredValue::kEncodings; e++)
+      n[e] += static_cast<size_t>(shards_[i].encodings[e]);
+  }
+  return n;
 }
 
 size_t KVStore::size() const {
-  std::shared_lock<std::shared_mutex> lk(mu_);
-  return map_.size();
+  size_t n = 0;
+  for (size_t i = 0; i < shard_count(); i++) {
+    std::shared_lock<std::shared_mutex> lk(shards_[i].mu);
+    n += std::visit([](auto& m) { return m.size(); }, shards_[i].map);
+  }
+  return n;
+}
+
+uint64_t KVStore::write_locks() const {
+  uint64_t n = 0;
+  for (size_t i = 0; i < shard_count(); i++) {
+    std::shared_lock<std::shared_mutex> lk(shards_[i].mu);
+    n += shards_[i].write_locks;
+  }
+  return n;
+}
+
+void KVStore::enable_ordered_index() {
+  if (ordered()) return;
+  for (size_t i = 0; i < shard_count(); i++) {
+    Shard& s = shards_[i];
+    std::unique_lock<std::shared_mutex> lk(s.mu);
+    if (s.index) continue;
+    auto index = std::make_shared<SkipList>();
+    std::visit(
+        [&](auto& m) {
+          m.for_each(
+              [&](const std::string& k, const auto&) { index->insert(k); });
+        },
+        s.map);
+    std::atomic_store(&s.index, std::move(index));
+  }
+  ordered_.store(true, std::memory_order_release);
+}
+
+void KVStore::range_keys(std::string_view start, std::string_view end,
+                         size_t limit, std::vector<std::string>& out) const {
+  if (!ordered() || limit == 0) return;
+  if (engine() == KVEngine::kArt) return range_keys_art(start, end, limit, out);
+  // k-way merge of the shards' cursors, smallest key first.
+  // Held for the walk, so a FLUSHALL can't free an index under it.
+  std::vector<std::shared_ptr<SkipList>> lists(shard_count());
+  std::vector<SkipList::Cursor> cursors(shard_count());
+  using Head = std::pair<std::string_view, size_t>;  // (key, shard)
+  std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heap;
+  for (size_t i = 0; i < shard_count(); i++) {
+    lists[i] = std::atomic_load(&shards_[i].index);
+    cursors[i].seek(*lists[i], start);
+    if (cursors[i].valid()) heap.emplace(cursors[i].key(), i);
+  }
+  while (!heap.empty() && out.size() < limit) {
+    auto [k, i] = heap.top();
+    heap.pop();
+    if (!end.empty() && k >= end) break;
+    out.emplace_back(k);
+    cursors[i].next();
+    if (cursors[i].valid()) heap.emplace(cursors[i].key(), i);
+  }
+}
+
+// Keys are spread evenly over shards, so each shard is asked for a small
+// share of `limit` first (a bounded walk under its shared lock). A shard
+// whose whole share made it into the current answer may hold more keys
+// that belong there; those are fetched in further rounds until no shard
+// can change the answer.
+void KVStore::range_keys_art(std::string_view start, std::string_view end,
+                             size_t limit,
+                             std::vector<std::string>& out) const {
+  const size_t n = shard_count();
+  const size_t share = limit / n + 8;
+  std::vector<std::vector<std::string>> got(n);
+  std::vector<char> done(n, 0);
+
+  auto fetch = [&](size_t i) {
+    std::shared_lock<std::shared_mutex> lk(shards_[i].mu);
+    std::string from(got[i].empty() ? start : got[i].back());
+    const bool skip_first = !got[i].empty();
+    size_t taken = 0;
+    std::get<ArtTree<Value>>(shards_[i].map)
+        .walk(from, [&](const std::string& k, const Value&) {
+          if (skip_first && k == from) return true;
+          if (!end.empty() && k >= end) return false;
+          got[i].push_back(k);
+          return ++taken < share;
+        });
+    if (taken < share) done[i] = 1;
+  };
+
+  std::vector<std::string_view> merged;
+  for (size_t i = 0; i < n; i++) fetch(i);
+  for (;;) {
+    merged.clear();
+    for (auto& keys : got)
+      merged.insert(merged.end(), keys.begin(), keys.end());
+    std::sort(merged.begin(), merged.end());
+    const bool full = merged.size() >= limit;
+    std::string cutoff = full ? std::string(merged[limit - 1]) : std::string();
+    bool more = false;
+    for (size_t i = 0; i < n; i++) {
+      if (done[i] || (full && got[i].back() >= cutoff)) continue;
+      fetch(i);
+      more = true;
+    }
+    if (!more) break;
+  }
+  if (merged.size() > limit) merged.resize(limit);
+  for (auto k : merged) out.emplace_back(k);
+}
+
+static bool parse_cursor(std::string_view s, uint64_t& v) {
+  auto res = std::from_chars(s.data(), s.data() + s.size(), v);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size();
+}
+
+std::string KVStore::scan(std::string_view cursor, size_t count,
+                          std::vector<std::string>& out) const {
+  const size_t n = shard_count();
+  if (count == 0) count = 1;
+  size_t taken = 0;
+
+  if (engine() == KVEngine::kArt) {
+    const size_t colon = cursor.find(':');
+    uint64_t shard;
+    if (!parse_cursor(cursor.substr(0, colon), shard) || shard >= n)
+      return {};
+    bool resume = colon != std::string_view::npos;
+    std::string after(resume ? cursor.substr(colon + 1) : "");
+    for (; shard < n && taken < count; shard++) {
+      bool more = false;
+      {
+        std::shared_lock<std::shared_mutex> lk(shards_[shard].mu);
+        std::get<ArtTree<Value>>(shards_[shard].map)
+            .walk(after, [&](const std::string& k, const Value&) {
+              if (resume && k == after) return true;
+              if (taken == count) {
+                more = true;
+                return false;
+              }
+              out.push_back(k);
+              taken++;
+              return true;
+            });
+      }
+      if (more) return std::to_string(shard) + ':' + out.back();
+      after.clear();
+      resume = false;
+    }
+    return shard < n ? std::to_string(shard) : "0";
+  }
+
+  // Cursor = bucket cursor above the shard number.
+  uint64_t c;
+  if (!parse_cursor(cursor, c)) return {};
+  size_t shard = c & (n - 1);
+  uint64_t bucket = c >> shard_bits_;
+  size_t budget = count * 10;  // buckets visited, since many are empty
+  while (shard < n && taken < count && budget > 0) {
+    std::shared_lock<std::shared_mutex> lk(shards_[shard].mu);
+    const auto& t = std::get<HashTable<Value>>(shards_[shard].map);
+    do {
+      bucket = t.scan(bucket, [&](const std::string& k, const Value&) {
+        out.push_back(k);
+        taken++;
+      });
+    } while (bucket != 0 && taken < count && --budget > 0);
+    if (bucket == 0) shard++;
+  }
+  if (shard == n) return "0";
+  return std::to_string((bucket << shard_bits_) | shard);
+}
+
+void KVStore::set_engine(KVEngine e) {
+  if (e == engine()) return;
+  for (size_t i = 0; i < shard_count(); i++) {
+    Shard& s = shards_[i];
+    std::unique_lock<std::shared_mutex> lk(s.mu);
+    std::vector<std::pair<std::string, Value>> entries;
+    std::visit(
+        [&](auto& m) {
+          m.for_each([&](const std::string& k, const Value& v) {
+            entries.emplace_back(k, v);
+          });
+        },
+        s.map);
+    if (e == KVEngine::kArt)
+      s.map.emplace<ArtTree<Value>>();
+    else
+      s.map.emplace<HashTable<Value>>();
+    std::visit(
+        [&](auto& m) {
+          for (auto& [k, v] : entries)
+            *m.try_emplace(k, key_hash(k)).first = std::move(v);
+        },
+        s.map);
+  }
+  art_.store(e == KVEngine::kArt, std::memory_order_release);
 }
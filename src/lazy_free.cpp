@@ -0,0 +1,28 @@
+#include "lazy_free.hpp"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+LazyFree::LazyFree() : q_(kQueueCap) {}
+
+LazyFree::~LazyFree() {
+  q_.close();
+  if (thread_.joinable()) thread_.join();
+}
+
+void LazyFree::release(std::shared_ptr<const void> p) {
+  std::call_once(started_, [this] {
+    thread_ = std::thread([this] {
+      // Lowest priority (Linux nice is per thread): freeing can wait while
+      // request threads need the CPU.
+      setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+      while (auto item = q_.pop()) {
+        item->reset();
+        pending_.fetch_sub(1, std::memory_order_relaxed);
+      }
+    });
+  });
+  pending_.fetch_add(1, std::memory_order_relaxed);
+  if (!q_.try_push(p)) pending_.fetch_sub(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,137 @@
+#include "list_object.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+// Lengths are LEB128: 7 bits per byte, low bits first, high bit set on all
+// but the last byte. Elements under 128 bytes take one length byte.
+static size_t len_size(size_t n) {
+  size_t k = 1;
+  for (; n >= 128; n >>= 7) k++;
+  return k;
+}
+
+static size_t entry_size(size_t n) { return 2 * len_size(n) + n; }
+
+static size_t read_len(const char*& p) {
+  size_t n = 0;
+  int shift = 0;
+  unsigned char b;
+  do {
+    b = static_cast<unsigned char>(*p++);
+    n |= size_t(b & 127) << shift;
+    shift += 7;
+  } while (b & 128);
+  return n;
+}
+
+// The trailing copy is stored back to front, so reading backwards from the
+// entry's end sees the low bits first.
+static size_t read_len_back(const char* end) {
+  size_t n = 0;
+  int shift = 0;
+  unsigned char b;
+  do {
+    b = static_cast<unsigned char>(*--end);
+    n |= size_t(b & 127) << shift;
+    shift += 7;
+  } while (b & 128);
+  return n;
+}
+
+static void write_entry(char* p, std::string_view v) {
+  char len[10];
+  size_t k = 0;
+  for (size_t n = v.size(); k == 0 || n > 0; n >>= 7)
+    len[k++] = static_cast<char>((n & 127) | (n >= 128 ? 128 : 0));
+  std::memcpy(p, len, k);
+  if (!v.empty()) std::memcpy(p + k, v.data(), v.size());
+  p += k + v.size();
+  for (size_t i = 0; i < k; i++) p[k - 1 - i] = len[i];
+}
+
+void ListObject::push_back(std::string_view v) {
+  const size_t need = entry_size(v.size());
+  if (chunks_.empty() || !fits(chunks_.back(), need)) {
+    if (!chunks_.empty()) chunks_.back().seal();
+    chunks_.emplace_back();
+  }
+  Chunk& c = chunks_.back();
+  const size_t at = c.bytes.size();
+  c.bytes.resize(at + need);
+  write_entry(&c.bytes[at], v);
+  c.count++;
+  length_++;
+}
+
+void ListObject::push_front(std::string_view v) {
+  const size_t need = entry_size(v.size());
+  if (chunks_.empty() || !fits(chunks_.front(), need)) {
+    if (!chunks_.empty()) chunks_.front().seal();
+    chunks_.emplace_front();
+  }
+  Chunk& c = chunks_.front();
+  if (c.begin < need) {
+    // Open a gap as large as the live bytes, so a run of front pushes
+    // moves them a logarithmic number of times rather than every push.
+    const size_t gap = std::max(need, c.used());
+    std::string grown(gap, '\0');
+    grown.append(c.bytes, c.begin, std::string::npos);
+    c.bytes = std::move(grown);
+    c.begin = gap;
+  }
+  c.begin -= need;
+  write_entry(&c.bytes[c.begin], v);
+  c.count++;
+  length_++;
+}
+
+bool ListObject::pop_front(std::string& out) {
+  if (length_ == 0) return false;
+  Chunk& c = chunks_.front();
+  const char* p = c.bytes.data() + c.begin;
+  const size_t n = read_len(p);
+  out.assign(p, n);
+  c.begin += entry_size(n);
+  if (--c.count == 0) {
+    chunks_.pop_front();
+  } else if (c.begin > kChunkBytes) {
+    // A queue pushing at the back keeps appending to this chunk; drop the
+    // consumed prefix once it outgrows a chunk.
+    c.bytes.erase(0, c.begin);
+    c.begin = 0;
+  }
+  length_--;
+  return true;
+}
+
+bool ListObject::pop_back(std::string& out) {
+  if (length_ == 0) return false;
+  Chunk& c = chunks_.back();
+  const size_t n = read_len_back(c.bytes.data() + c.bytes.size());
+  const size_t at = c.bytes.size() - entry_size(n);
+  out.assign(c.bytes, at + len_size(n), n);
+  c.bytes.resize(at);
+  if (--c.count == 0) chunks_.pop_back();
+  length_--;
+  return true;
+}
+
+void ListObject::range(size_t start, size_t stop,
+                       std::vector<std::string>& out) const {
+  if (start >= length_ || start > stop) return;
+  size_t left = std::min(stop, length_ - 1) - start + 1;
+  auto it = chunks_.begin();
+  for (; start >= it->count; ++it) start -= it->count;
+  for (; left > 0; ++it, start = 0) {
+    const char* p = it->bytes.data() + it->begin;
+    for (uint32_t i = 0; i < it->count && left > 0; i++) {
+      const size_t n = read_len(p);
+      if (i >= start) {
+        out.emplace_back(p, n);
+        left--;
+      }
+      p += n + len_size(n);
+    }
+  }
+}
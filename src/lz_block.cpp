@@ -0,0 +1,286 @@
+#include "lz_block.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+
+// LZ4 block rules: matches are at least 4 bytes, the last 5 bytes are
+// always literals, and the last match starts at least 12 bytes before the
+// end.
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMfLimit = 12;
+constexpr size_t kMaxOffset = 65535;
+constexpr int kMaxHashLog = 12;
+
+static uint32_t read32(const char* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+static uint32_t seq_hash(uint32_t seq, int log) {
+  return (seq * 2654435761u) >> (32 - log);
+}
+
+// Writes the 255-byte extension of a length whose nibble was 15.
+static char* write_len(char* op, size_t len) {
+  for (len -= 15; len >= 255; len -= 255) *op++ = static_cast<char>(255);
+  *op++ = static_cast<char>(len);
+  return op;
+}
+
+static char* write_literals(char* op, char* token, const char* lit,
+                            size_t n) {
+  if (n >= 15) {
+    *token = static_cast<char>(15 << 4);
+    op = write_len(op, n);
+  } else {
+    *token = static_cast<char>(n << 4);
+  }
+  std::memcpy(op, lit, n);
+  return op + n;
+}
+
+// A dictionary as seen by compress_block: history that comes right before
+// the input, with its own hash table (kMaxHashLog bits), which is only
+// read.
+struct ExtDict {
+  const char* bytes = nullptr;
+  size_t size = 0;
+  const uint32_t* table = nullptr;
+};
+
+// Compresses base[0, n). `table` maps sequence hashes to positions in base
+// and starts cleared. A sequence not found there is looked up in `dict`'s
+// table, so matches may reach back into the dictionary without copying it
+// or its table (LZ4's external dictionary). Without one (kDict false) the
+// extra checks compile away.
+template <bool kDict>
+static size_t compress_block(const char* base, size_t n, char* dst,
+                             uint32_t* table, int log, const ExtDict& dict) {
+  const char* ip = base;
+  const char* anchor = ip;
+  const char* const iend = base + n;
+  const char* const dend = dict.bytes + dict.size;
+  char* op = dst;
+
+  if (n > kMfLimit) {
+    const char* const mflimit = iend - kMfLimit;
+    const char* const matchlimit = iend - kLastLiterals;
+    while (ip < mflimit) {
+      const uint32_t seq = read32(ip);
+      const uint32_t h = seq_hash(seq, log);
+      const char* ref = base + table[h];
+      table[h] = static_cast<uint32_t>(ip - base);
+      size_t off = static_cast<size_t>(ip - ref);
+      bool found = ref < ip && off <= kMaxOffset && read32(ref) == seq;
+      bool in_dict = false;
+      if (kDict && !found) {
+        ref = dict.bytes + dict.table[seq_hash(seq, kMaxHashLog)];
+        off = static_cast<size_t>(ip - base) + static_cast<size_t>(dend - ref);
+        found = in_dict = off <= kMaxOffset && read32(ref) == seq;
+      }
+      if (!found) {
+        // Step further the longer nothing has matched.
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      const char* const low = in_dict ? dict.bytes : base;
+      while (ip > anchor && ref > low && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+      const char* m = ip + kMinMatch;
+      const char* r = ref + kMinMatch;
+      if (kDict && in_dict) {
+        // The input follows the dictionary, so a match that runs off its
+        // end goes on from the input's start.
+        while (m < matchlimit && r < dend && *m == *r) {
+          m++;
+          r++;
+        }
+        if (r == dend) r = base;
+      }
+      while (m < matchlimit && *m == *r) {
+        m++;
+        r++;
+      }
+
+      char* token = op++;
+      op = write_literals(op, token, anchor, static_cast<size_t>(ip - anchor));
+      *op++ = static_cast<char>(off & 0xff);
+      *op++ = static_cast<char>(off >> 8);
+      const size_t ml = static_cast<size_t>(m - ip) - kMinMatch;
+      if (ml >= 15) {
+        *token = static_cast<char>(*token | 15);
+        op = write_len(op, ml);
+      } else {
+        *token = static_cast<char>(*token | ml);
+      }
+
+      ip = anchor = m;
+      if (ip < mflimit)
+        table[seq_hash(read32(ip - 2), log)] =
+            static_cast<uint32_t>(ip - 2 - base);
+    }
+  }
+  char* token = op++;
+  op = write_literals(op, token, anchor, static_cast<size_t>(iend - anchor));
+  return static_cast<size_t>(op - dst);
+}
+
+LzDict::LzDict(std::string bytes) : bytes_(std::move(bytes)) {
+  if (bytes_.size() > kMaxBytes) bytes_.erase(0, bytes_.size() - kMaxBytes);
+  table_.assign(size_t(1) << kMaxHashLog, 0);
+  for (size_t p = 0; p + 4 <= bytes_.size(); p++)
+    table_[seq_hash(read32(bytes_.data() + p), kMaxHashLog)] =
+        static_cast<uint32_t>(p);
+}
+
+size_t lz_compress(const char* src, size_t n, char* dst,
+                   const LzDict* dict) {
+  // Small inputs get a small table: clearing 16 KB would cost more than
+  // compressing a few hundred bytes. A dictionary's table is shared.
+  uint32_t table[size_t(1) << kMaxHashLog];
+  int log = 8;
+  while (log < kMaxHashLog && (size_t(1) << log) < n) log++;
+  std::memset(table, 0, sizeof(uint32_t) << log);
+  if (!dict || dict->bytes_.size() < kMinMatch)
+    return compress_block<false>(src, n, dst, table, log, ExtDict());
+  const ExtDict ext{dict->bytes_.data(), dict->bytes_.size(),
+                    dict->table_.data()};
+  return compress_block<true>(src, n, dst, table, log, ext);
+}
+
+bool lz_decompress(const char* src, size_t len, char* dst, size_t n,
+                   const LzDict* dict) {
+  const auto* ip = reinterpret_cast<const unsigned char*>(src);
+  const auto* const iend = ip + len;
+  char* op = dst;
+  char* const oend = dst + n;
+  const std::string_view history =
+      dict ? std::string_view(dict->bytes()) : std::string_view();
+
+  auto read_len = [&](size_t& v) {
+    for (unsigned b = 255; b == 255; v += b) {
+      if (ip >= iend) return false;
+      b = *ip++;
+    }
+    return true;
+  };
+
+  for (;;) {
+    if (ip >= iend) return false;
+    const unsigned token = *ip++;
+    size_t lit = token >> 4;
+    if (lit == 15 && !read_len(lit)) return false;
+    if (lit > static_cast<size_t>(iend - ip) ||
+        lit > static_cast<size_t>(oend - op))
+      return false;
+    std::memcpy(op, ip, lit);
+    ip += lit;
+    op += lit;
+    if (ip == iend) return op == oend;  // the last sequence has no match
+
+    if (iend - ip < 2) return false;
+    const size_t off = ip[0] | (size_t(ip[1]) << 8);
+    ip += 2;
+    size_t ml = token & 15;
+    if (ml == 15 && !read_len(ml)) return false;
+    ml += kMinMatch;
+    if (off == 0 || ml > static_cast<size_t>(oend - op)) return false;
+
+    const size_t produced = static_cast<size_t>(op - dst);
+    if (off > produced) {  // starts in the dictionary
+      const size_t back = off - produced;
+      if (back > history.size()) return false;
+      const size_t k = std::min(back, ml);
+      std::memcpy(op, history.data() + history.size() - back, k);
+      op += k;
+      ml -= k;
+      if (ml == 0) continue;
+    }
+    const char* m = op - off;
+    if (off >= ml) {
+      std::memcpy(op, m, ml);
+      op += ml;
+    } else {
+      for (size_t i = 0; i < ml; i++) *op++ = *m++;  // overlapping repeat
+    }
+  }
+}
+
+std::string lz_train_dict(const std::vector<std::string>& samples,
+                          size_t max_bytes) {
+  constexpr size_t kSeg = 64;
+  constexpr size_t kGram = 8;
+  constexpr int kLog = 20;
+  auto gram = [](const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return static_cast<size_t>((v * 0x9e3779b97f4a7c15ull) >> (64 - kLog));
+  };
+
+  // In how many samples each 8-byte substring (by hash) occurs; ones seen
+  // in a single sample are worth nothing to a shared dictionary.
+  std::vector<uint32_t> freq(size_t(1) << kLog, 0);
+  std::vector<uint32_t> seen(size_t(1) << kLog, UINT32_MAX);
+  for (uint32_t i = 0; i < samples.size(); i++) {
+    const std::string& s = samples[i];
+    for (size_t p = 0; p + kGram <= s.size(); p++) {
+      size_t h = gram(s.data() + p);
+      if (seen[h] != i) {
+        seen[h] = i;
+        freq[h]++;
+      }
+    }
+  }
+  for (auto& f : freq)
+    if (f < 2) f = 0;
+
+  struct Seg {
+    uint64_t score;
+    uint32_t sample;
+    uint32_t off;
+    bool operator<(const Seg& o) const { return score < o.score; }
+  };
+  auto score = [&](const Seg& c) {
+    const char* p = samples[c.sample].data() + c.off;
+    uint64_t sum = 0;
+    for (size_t j = 0; j + kGram <= kSeg; j++) sum += freq[gram(p + j)];
+    return sum;
+  };
+  std::priority_queue<Seg> heap;
+  for (uint32_t i = 0; i < samples.size(); i++)
+    for (size_t off = 0; off + kSeg <= samples[i].size(); off += kSeg / 2) {
+      Seg c{0, i, static_cast<uint32_t>(off)};
+      c.score = score(c);
+      if (c.score) heap.push(c);
+    }
+
+  // Lazy greedy: scores only drop as substrings get covered, so a popped
+  // segment whose fresh score still beats the next stale one is the best.
+  std::vector<Seg> picked;
+  while (!heap.empty() && (picked.size() + 1) * kSeg <= max_bytes) {
+    Seg c = heap.top();
+    heap.pop();
+    c.score = score(c);
+    if (c.score == 0) continue;
+    if (!heap.empty() && c.score < heap.top().score) {
+      heap.push(c);
+      continue;
+    }
+    picked.push_back(c);
+    const char* p = samples[c.sample].data() + c.off;
+    for (size_t j = 0; j + kGram <= kSeg; j++) freq[gram(p + j)] = 0;
+  }
+
+  // Best segments last: they stay within reach (64 KB back) of the most
+  // input bytes.
+  std::string dict;
+  dict.reserve(picked.size() * kSeg);
+  for (auto it = picked.rbegin(); it != picked.rend(); ++it)
+    dict.append(samples[it->sample], it->off, kSeg);
+  return dict;
+}
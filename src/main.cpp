@@ -41,6 +41,13 @@ int main(int argc, char** argv) {
   int threads = 8;
   int max_conns = 2000;
   size_t queue_cap = 4096;
+  int backlog = 4096;
+  int max_value_mb = 512;
+  std::string capture_path;
+  bool ordered_index = false;
+  KVEngine engine = KVEngine::kHash;
+  int compress_min = 0;
+  bool compress_dict = false;
 
   // Support: ./server 8080
   if (argc >= 2 && std::string(argv[1]).rfind("--", 0) != 0) {
@@ -66,16 +73,78 @@ int main(int argc, char** argv) {
     else if (a == "--queue-cap")
       queue_cap =
           (size_t)parse_i32(need("--queue-cap"), (int)queue_cap, 1, 2000000);
+    else if (a == "--backlog")
+      backlog = parse_i32(need("--backlog"), backlog, 1, 65535);
+    else if (a == "--max-value-mb")
+      // StoredValue keeps sizes in 32 bits.
+      max_value_mb = parse_i32(need("--max-value-mb"), max_value_mb, 1, 4095);
+    else if (a == "--capture")
+      capture_path = need("--capture");
+    else if (a == "--ordered-index")
+      ordered_index = true;
+    else if (a == "--engine") {
+      std::string e = need("--engine");
+      if (e != "hash" && e != "art") {
+        std::cerr << "--engine must be hash or art\n";
+        return 1;
+      }
+      engine = e == "art" ? KVEngine::kArt : KVEngine::kHash;
+    }
+    else if (a == "--compress-min")
+      compress_min =
+          parse_i32(need("--compress-min"), compress_min, 0, 1 << 30);
+    else if (a == "--compress-dict")
+      compress_dict = true;
     else if (a == "--help") {
       std::cout << "Usage: server [--port N] [--threads N] [--max-conns N] "
-                   "[--queue-cap N]\n"
+                   "[--queue-cap N] [--backlog N]\n"
+                   "              [--max-value-mb N] [--capture FILE] "
+                   "[--ordered-index]\n"
+                   "              [--engine hash|art] [--compress-min BYTES] "
+                   "[--compress-dict]\n"
                 << "Protocol: SET key value | GET key | DEL key | STATS | PING "
-                   "| QUIT\n";
+                   "| QUIT\n"
+                << "          UNLINK key | FLUSHALL [ASYNC|SYNC]\n"
+                << "          INCR key | DECR key | INCRBY key n | "
+                   "DECRBY key n -> VALUE n\n"
+                << "          HSET key field value [field value ...] | "
+                   "HDEL key field [field ...] -> VALUE n\n"
+                << "          HGET key field | HMGET key field [field ...] | "
+                   "HGETALL key | HLEN key | TYPE key\n"
+                << "          ZADD key score member [score member ...] | "
+                   "ZINCRBY key delta member | ZREM key member [...]\n"
+                << "          ZSCORE key member | ZCARD key | ZRANK key member "
+                   "| ZRANGE key start stop [WITHSCORES]\n"
+                << "          ZRANGEBYSCORE key min max [WITHSCORES] "
+                   "[LIMIT offset count]\n"
+                << "          LPUSH|RPUSH key element [element ...] -> "
+                   "VALUE length | LPOP|RPOP key | LLEN key\n"
+                << "          LRANGE key start stop | BLPOP key timeout-secs "
+                   "(0 = forever; NOTFOUND on timeout)\n"
+                << "          DELPREFIX prefix | DELMATCH pattern -> JOB id; "
+                   "JOB id -> progress\n"
+                << "          SETB key len<LF><len bytes> | GETB key -> "
+                   "VALUEB len<LF><bytes>\n"
+                << "          GETZ key -> VALUEZ rawlen len<LF><LZ4 block> "
+                   "if stored compressed, else as GETB\n"
+                << "          MGET key [key ...] -> ARRAY n<LF> then n "
+                   "VALUE/NOTFOUND lines\n"
+                << "          RANGE start end|+ [limit] | PREFIX p [limit] -> "
+                   "ARRAY n<LF> then n 'key value' lines\n"
+                << "          (RANGE/PREFIX need --ordered-index or "
+                   "--engine art)\n"
+                << "          SCAN cursor [COUNT n] [MATCH pattern] -> "
+                   "ARRAY n<LF> CURSOR next<LF> then keys\n";
       return 0;
     }
   }
 
-  Server s(port, threads, max_conns, queue_cap);
+  Server s(port, threads, max_conns, queue_cap, backlog);
+  s.set_max_value_bytes(static_cast<size_t>(max_value_mb) << 20);
+  s.set_capture_path(capture_path);
+  s.set_ordered_index(ordered_index);
+  s.set_engine(engine);
+  s.set_compression(static_cast<size_t>(compress_min), compress_dict);
   g_server_ptr = &s;
 
   // Install Ctrl+C handler
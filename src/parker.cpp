@@ -0,0 +1,249 @@
+#include "parker.hpp"
+
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <iterator>
+
+Parker::Parker(Resume resume) : resume_(std::move(resume)) {}
+
+Parker::~Parker() { stop(); }
+
+bool Parker::start() {
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  event_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (epoll_fd_ < 0 || event_fd_ < 0) {
+    perror("parker");
+    return false;
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = event_fd_;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev) < 0) {
+    perror("epoll_ctl");
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    running_.store(true);
+  }
+  thread_ = std::thread([this] { loop(); });
+  return true;
+}
+
+void Parker::stop() {
+  bool joining;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    // The thread takes mu_ after waking, so it sees running_ false.
+    wake_thread();
+    joining = running_.exchange(false);
+  }
+  if (joining) thread_.join();
+  {
+    // Workers may still call in; with running_ false they won't park.
+    std::lock_guard<std::mutex> lk(mu_);
+    std::vector<ParkTicket*> all;
+    for (auto& [key, q] : by_key_)
+      for (auto& t : q) all.push_back(t.get());
+    for (ParkTicket* t : all) finish(t, ParkTicket::State::kTimedOut);
+    for (auto& [fd, s] : idle_) ready_.push_back(std::move(s));
+    idle_.clear();
+    if (epoll_fd_ >= 0) ::close(epoll_fd_);
+    if (event_fd_ >= 0) ::close(event_fd_);
+    epoll_fd_ = event_fd_ = -1;
+  }
+  // The pool's workers drain its queue, so this ends.
+  for (;;) {
+    std::vector<std::shared_ptr<Session>> ready;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      ready.swap(ready_);
+    }
+    if (ready.empty()) break;
+    if (!resume_all(ready))
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+void Parker::wake_thread() {
+  if (!running_.load()) return;  // no thread, or it is stopping
+  const uint64_t one = 1;
+  ssize_t r = ::write(event_fd_, &one, sizeof(one));  // EAGAIN: pending
+  (void)r;
+}
+
+bool Parker::resume_all(std::vector<std::shared_ptr<Session>>& ready) {
+  size_t i = 0;
+  while (i < ready.size() && resume_(ready[i])) i++;
+  if (i == ready.size()) return true;
+  std::lock_guard<std::mutex> lk(mu_);
+  ready_.insert(ready_.begin(), std::make_move_iterator(ready.begin() + i),
+                std::make_move_iterator(ready.end()));
+  return false;
+}
+
+std::shared_ptr<ParkTicket> Parker::wait(std::string_view key,
+                                         std::chrono::milliseconds timeout) {
+  auto t = std::make_shared<ParkTicket>();
+  t->key = std::string(key);
+  t->deadline = timeout.count() > 0 ? ParkTicket::Clock::now() + timeout
+                                    : ParkTicket::Clock::time_point::max();
+  std::lock_guard<std::mutex> lk(mu_);
+  t->timer = timers_.end();
+  if (timeout.count() > 0) {
+    t->timer = timers_.emplace(t->deadline, t.get());
+    // The thread sleeps until the earliest deadline; this one may be it.
+    if (t->timer == timers_.begin()) wake_thread();
+  }
+  by_key_[t->key].push_back(t);
+  waiting_.fetch_add(1, std::memory_order_release);
+  return t;
+}
+
+// Whether the peer has hung up, before the thread has seen it: a reply to
+// it would be lost, and with it the element.
+static bool hung_up(int fd) {
+  pollfd p{fd, POLLRDHUP, 0};
+  return ::poll(&p, 1, 0) > 0 &&
+         (p.revents & (POLLRDHUP | POLLHUP | POLLERR)) != 0;
+}
+
+size_t Parker::serve(std::string_view key,
+                     const std::function<bool(std::string&)>& pop) {
+  const std::string k(key);
+  std::lock_guard<std::mutex> lk(mu_);
+  size_t n = 0;
+  bool parked = false;
+  for (auto it = by_key_.find(k); it != by_key_.end(); it = by_key_.find(k)) {
+    ParkTicket* t = it->second.front().get();
+    if (t->fd >= 0 && hung_up(t->fd)) {
+      finish(t, ParkTicket::State::kTimedOut);
+      parked = true;
+      continue;
+    }
+    if (!pop(t->value)) break;
+    parked |= t->fd >= 0;
+    finish(t, ParkTicket::State::kServed);
+    n++;
+  }
+  if (parked) wake_thread();
+  return n;
+}
+
+bool Parker::park(const std::shared_ptr<ParkTicket>& t, int fd,
+                  std::shared_ptr<Session> session) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (t->state != ParkTicket::State::kWaiting) return false;
+  if (!running_.load()) {
+    finish(t.get(), ParkTicket::State::kTimedOut);
+    return false;
+  }
+  // Only hangups are watched: requests pipelined behind the BLPOP wait in
+  // the socket until the connection resumes.
+  epoll_event ev{};
+  ev.events = EPOLLRDHUP;
+  ev.data.fd = fd;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    // Unwatchable, so it could never be resumed: end the wait now.
+    finish(t.get(), ParkTicket::State::kTimedOut);
+    return false;
+  }
+  t->fd = fd;
+  t->session = std::move(session);
+  by_fd_[fd] = t.get();
+  return true;
+}
+
+bool Parker::park_idle(int fd, std::shared_ptr<Session> session) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (!running_.load()) return false;
+  epoll_event ev{};
+  ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+  ev.data.fd = fd;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) return false;
+  idle_[fd] = std::move(session);
+  return true;
+}
+
+void Parker::cancel(const std::shared_ptr<ParkTicket>& t) {
+  std::lock_guard<std::mutex> lk(mu_);
+  if (t->state == ParkTicket::State::kWaiting)
+    finish(t.get(), ParkTicket::State::kTimedOut);
+}
+
+void Parker::finish(ParkTicket* t, ParkTicket::State state) {
+  t->state = state;
+  if (t->timer != timers_.end()) {
+    timers_.erase(t->timer);
+    t->timer = timers_.end();
+  }
+  if (t->fd >= 0) {
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, t->fd, nullptr);
+    by_fd_.erase(t->fd);
+    ready_.push_back(std::move(t->session));
+  }
+  // Last, since the queue's reference may be the only one left.
+  auto it = by_key_.find(t->key);
+  auto& q = it->second;
+  q.erase(std::find_if(q.begin(), q.end(),
+                       [&](const auto& p) { return p.get() == t; }));
+  if (q.empty()) by_key_.erase(it);
+  waiting_.fetch_sub(1, std::memory_order_release);
+}
+
+void Parker::loop() {
+  epoll_event events[64];
+  while (running_.load()) {
+    int timeout_ms = -1;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (!timers_.empty()) {
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(
+            timers_.begin()->first - ParkTicket::Clock::now());
+        timeout_ms = static_cast<int>(
+            std::clamp<int64_t>(left.count(), 0, INT_MAX));
+      }
+      // Connections the pool had no room for are offered again soon.
+      if (!ready_.empty() && (timeout_ms < 0 || timeout_ms > 1))
+        timeout_ms = 1;
+    }
+    // The fds are closed only after this thread is joined.
+    int n = ::epoll_wait(epoll_fd_, events, 64, timeout_ms);
+    if (n < 0) n = 0;  // EINTR
+
+    std::vector<std::shared_ptr<Session>> ready;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      for (int i = 0; i < n; i++) {
+        const int fd = events[i].data.fd;
+        if (fd == event_fd_) {
+          uint64_t count;
+          ssize_t r = ::read(event_fd_, &count, sizeof(count));
+          (void)r;
+          continue;
+        }
+        auto idle = idle_.find(fd);  // a request (or hangup) arrived
+        if (idle != idle_.end()) {
+          ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+          ready_.push_back(std::move(idle->second));
+          idle_.erase(idle);
+          continue;
+        }
+        auto it = by_fd_.find(fd);  // the peer hung up
+        if (it != by_fd_.end())
+          finish(it->second, ParkTicket::State::kTimedOut);
+      }
+      const auto now = ParkTicket::Clock::now();
+      while (!timers_.empty() && timers_.begin()->first <= now)
+        finish(timers_.begin()->second, ParkTicket::State::kTimedOut);
+      ready.swap(ready_);
+    }
+    resume_all(ready);
+  }
+}
@@ -3,6 +3,7 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 
 LineReader::LineReader(size_t max_line) : max_line_(max_line) {}
@@ -32,6 +33,28 @@ std::optional<std::string> LineReader::read_line(int fd) {
   }
 }
 
+bool LineReader::read_exact(int fd, size_t n, std::string& out) {
+  // The buffer grows with what has arrived (doubling, from 64 KB), so a
+  // header that announces a huge payload commits no memory up front.
+  constexpr size_t kFirstChunk = 64 * 1024;
+  size_t got = std::min(n, buffer_.size());
+  out.resize(std::max(got, std::min(n, kFirstChunk)));
+  buffer_.copy(&out[0], got);
+  buffer_.erase(0, got);
+
+  while (got < n) {
+    if (got == out.size()) out.resize(std::min(n, got * 2));
+    ssize_t r = ::recv(fd, &out[got], out.size() - got, 0);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    if (r == 0) return false;
+    got += static_cast<size_t>(r);
+  }
+  return true;
+}
+
 bool send_all(int fd, const char* data, size_t len) {
   size_t sent = 0;
   while (sent < len) {
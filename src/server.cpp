@@ -2,19 +2,23 @@
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
 #include <atomic>
-#include <cctype>
+#include <chrono>
 #include <cerrno>
 #include <cstring>
 #include <iostream>
-#include <optional>
-#include <sstream>
 #include <string>
+#include <thread>
 
+#include "capture.hpp"
+#include "command.hpp"
+#include "connection.hpp"
 #include "kvstore.hpp"
+#include "parker.hpp"
 #include "protocol.hpp"
 #include "stats.hpp"
 #include "thread_pool.hpp"
@@ -22,6 +26,8 @@
 // ---- Shared service state ----
 static KVStore g_kv;
 static Stats g_stats;
+static CommandEngine g_engine(g_kv, g_stats);
+static Capture g_capture;
 
 // Controls server lifetime
 static std::atomic<bool> g_running{false};
@@ -29,94 +35,39 @@ static std::atomic<bool> g_running{false};
 // Used by stop() to break accept()
 static std::atomic<int> g_listen_fd{-1};
 
-// Thread count used in STATS output
-static int g_threads = 0;
-
 // Strict connection cap
 static std::atomic<int> g_active_strict{0};
 
-// ---- Command handler ----
-std::string handle_command(const std::string& line) {
-  std::istringstream iss(line);
-  std::string cmd;
-  iss >> cmd;
-
-  for (auto& c : cmd)
-    c = static_cast<char>(::toupper(static_cast<unsigned char>(c)));
-
-  if (cmd == "PING") return "PONG\n";
-
-  if (cmd == "GET") {
-    std::string key;
-    if (!(iss >> key)) return "ERR usage: GET key\n";
-    auto v = g_kv.get(key);
-    if (!v) return "NOTFOUND\n";
-    return "VALUE " + *v + "\n";
-  }
-
-  if (cmd == "SET") {
-    std::string key;
-    if (!(iss >> key)) return "ERR usage: SET key value\n";
-    std::string value;
-    std::getline(iss, value);
-    if (!value.empty() && value.front() == ' ') value.erase(0, 1);
-    g_kv.set(key, value);
-    return "OK\n";
-  }
-
-  if (cmd == "DEL") {
-    std::string key;
-    if (!(iss >> key)) return "ERR usage: DEL key\n";
-    bool removed = g_kv.del(key);
-    return removed ? "OK\n" : "NOTFOUND\n";
-  }
-
-  if (cmd == "STATS") {
-    return g_stats.render(g_threads, g_kv.size());
-  }
-
-  if (cmd == "QUIT") return "OK bye\n";
-
-  return "ERR unknown command\n";
-}
-
-// ---- Per-connection serving ----
-static void serve_client(int fd) {
-  LineReader lr(8192);
-
-  // banner
-  send_str(fd, "OK tcp-kv ready\n");
-
-  while (g_running.load()) {
-    auto line_opt = lr.read_line(fd);
-    if (!line_opt.has_value()) return;
-
-    std::string line = *line_opt;
-
-    if (line == "**LINE_TOO_LONG**") {
-      send_str(fd, "ERR line too long\n");
-      return;
-    }
-    if (line.empty()) continue;
-
-    g_stats.inc_requests();
-
-    std::string resp = handle_command(line);
-    if (!send_str(fd, resp)) return;
-
-    if (resp == "OK bye\n") return;
-  }
+// Runs a connection on a pool worker until it closes, or parks in BLPOP;
+// a parked one is resubmitted by the parker when its wait ends.
+static void run_session(const std::shared_ptr<Session>& s) {
+  if (serve_connection(*s, g_engine, g_stats, g_running,
+                       g_capture.active() ? &g_capture : nullptr))
+    return;
+  ::close(s->fd);
+  g_stats.dec_active();
+  g_active_strict.fetch_sub(1);
 }
 
 // ---- Server ----
-Server::Server(uint16_t port, int threads, int max_conns, size_t queue_cap)
+Server::Server(uint16_t port, int threads, int max_conns, size_t queue_cap,
+               int backlog)
     : port_(port),
       threads_(threads),
       max_conns_(max_conns),
-      queue_cap_(queue_cap) {}
+      queue_cap_(queue_cap),
+      backlog_(backlog) {}
 
 bool Server::start() {
-  g_threads = threads_;
+  g_engine.set_threads(threads_);
+  g_engine.set_max_value_bytes(max_value_bytes_);
+  g_kv.set_engine(engine_);
+  if (ordered_index_) g_kv.enable_ordered_index();
+  g_kv.set_compression(compress_min_, compress_dict_);
+  if (!capture_path_.empty() && !g_capture.start(capture_path_)) {
+    perror(capture_path_.c_str());
+    return false;
+  }
   g_stats.on_start();
   g_running.store(true);
 
@@ -148,7 +99,8 @@ bool Server::start() {
     return false;
   }
 
-  if (listen(listen_fd, 256) < 0) {
+  // The kernel caps the backlog at net.core.somaxconn.
+  if (listen(listen_fd, backlog_) < 0) {
     perror("listen");
     ::close(listen_fd);
     g_listen_fd.store(-1);
@@ -158,6 +110,25 @@ bool Server::start() {
   ThreadPool pool(threads_, queue_cap_);
   pool.start();
 
+  // Parked connections hold no worker; when their wait ends they queue
+  // for one like new connections, but without blocking the parker's
+  // thread on a full queue.
+  Parker parker([&pool](const std::shared_ptr<Session>& s) {
+    ThreadPool::Job job = [s]() { run_session(s); };
+    if (pool.try_submit(job)) return true;
+    if (pool.running()) return false;  // full: offered again
+    ::close(s->fd);
+    g_stats.dec_active();
+    g_active_strict.fetch_sub(1);
+    return true;
+  });
+  if (!parker.start()) {
+    ::close(listen_fd);
+    g_listen_fd.store(-1);
+    return false;
+  }
+  g_engine.set_parker(&parker);
+
   std::cerr << "Listening on port " << port_ << " with " << threads_
             << " threads\n";
   std::cerr << "Press Ctrl+C to stop gracefully.\n";
@@ -165,7 +136,8 @@ bool Server::start() {
   while (g_running.load()) {
     sockaddr_in client_addr{};
     socklen_t client_len = sizeof(client_addr);
-    int client_fd = ::accept(listen_fd, (sockaddr*)&client_addr, &client_len);
+    int client_fd = ::accept4(listen_fd, (sockaddr*)&client_addr,
+                              &client_len, SOCK_CLOEXEC);
 
     if (client_fd < 0) {
       // If stop() closed the socket, accept will fail; exit loop cleanly
@@ -173,10 +145,20 @@ bool Server::start() {
       if (errno == EINTR) continue;
       // EBADF / EINVAL happens if listen_fd got closed; treat as shutdown
       if (errno == EBADF || errno == EINVAL) break;
+      // Aborted handshakes are normal under connection churn
+      if (errno == ECONNABORTED) continue;
       perror("accept");
+      // Out of descriptors: back off instead of spinning on accept()
+      if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS ||
+          errno == ENOMEM)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
       continue;
     }
 
+    // Replies are small and latency-bound; don't wait on Nagle
+    int one = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
     // Active tracking + strict cap
     g_stats.inc_active();
 
@@ -189,12 +171,8 @@ bool Server::start() {
       continue;
     }
 
-    bool ok = pool.submit([client_fd]() {
-      serve_client(client_fd);
-      ::close(client_fd);
-      g_stats.dec_active();
-      g_active_strict.fetch_sub(1);
-    });
+    auto session = std::make_shared<Session>(client_fd);
+    bool ok = pool.submit([session]() { run_session(session); });
 
     if (!ok) {
       send_str(client_fd, "ERR server shutting down\n");
@@ -205,8 +183,18 @@ bool Server::start() {
     }
   }
 
-  // Stop accepting new work and wait for worker threads to finish
+  // Wake parked connections so they close through the pool, then stop
+  // accepting new work and wait for worker threads to finish
+  parker.stop();
   pool.stop();
+  g_engine.set_parker(nullptr);
+
+  if (g_capture.active()) {
+    g_capture.stop();
+    std::cerr << "Capture: " << g_capture.records() << " requests written to "
+              << capture_path_ << ", " << g_capture.dropped()
+              << " dropped\n";
+  }
 
   // Close listen socket if still open
   int fd = g_listen_fd.exchange(-1);
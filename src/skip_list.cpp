@@ -0,0 +1,169 @@
+#include "skip_list.hpp"
+
+#include <cstring>
+#include <new>
+
+struct SkipList::Node {
+  Node* retired;  // retire-list link; next[] stays intact for readers
+  uint32_t len;
+  int height;
+  std::atomic<Node*> next[1];  // `height` links, then the key bytes
+
+  char* key_bytes() {
+    return reinterpret_cast<char*>(next) + height * sizeof(next[0]);
+  }
+  std::string_view key() const {
+    return {const_cast<Node*>(this)->key_bytes(), len};
+  }
+};
+
+static size_t node_bytes(size_t len, int height) {
+  return sizeof(SkipList::Node) +
+         (height - 1) * sizeof(std::atomic<SkipList::Node*>) + len;
+}
+
+SkipList::SkipList() { head_ = new_node({}, kMaxHeight); }
+
+SkipList::~SkipList() {
+  for (Node* n = head_; n;) {
+    Node* next = n->next[0].load(std::memory_order_relaxed);
+    free_node(n);
+    n = next;
+  }
+  for (Node* list : {pending_, limbo_}) {
+    while (list) {
+      Node* next = list->retired;
+      free_node(list);
+      list = next;
+    }
+  }
+}
+
+SkipList::Node* SkipList::new_node(std::string_view key, int height) {
+  const size_t bytes = node_bytes(key.size(), height);
+  Node* n = static_cast<Node*>(::operator new(bytes));
+  n->retired = nullptr;
+  n->len = static_cast<uint32_t>(key.size());
+  n->height = height;
+  for (int i = 0; i < height; i++)
+    new (&n->next[i]) std::atomic<Node*>(nullptr);
+  if (!key.empty()) std::memcpy(n->key_bytes(), key.data(), key.size());
+  bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  return n;
+}
+
+void SkipList::free_node(Node* n) {
+  bytes_.fetch_sub(node_bytes(n->len, n->height), std::memory_order_relaxed);
+  ::operator delete(n);
+}
+
+// p = 1/4 per level, as in LevelDB: ~1.33 links per key on average.
+int SkipList::random_height() {
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 7;
+  rng_ ^= rng_ << 17;
+  int h = 1;
+  for (uint64_t r = rng_; h < kMaxHeight && (r & 3) == 0; r >>= 2) h++;
+  return h;
+}
+
+SkipList::Node* SkipList::find_preds(std::string_view key,
+                                     Node** preds) const {
+  Node* x = head_;
+  Node* next = nullptr;
+  for (int level = height_.load(std::memory_order_acquire) - 1; level >= 0;
+       level--) {
+    while ((next = x->next[level].load(std::memory_order_acquire)) &&
+           next->key() < key)
+      x = next;
+    if (preds) preds[level] = x;
+  }
+  return next;
+}
+
+void SkipList::insert(std::string_view key) {
+  Node* preds[kMaxHeight];
+  Node* at = find_preds(key, preds);
+  if (at && at->key() == key) return;
+
+  const int h = random_height();
+  const int cur = height_.load(std::memory_order_relaxed);
+  for (int i = cur; i < h; i++) preds[i] = head_;
+  Node* n = new_node(key, h);
+  for (int i = 0; i < h; i++)
+    n->next[i].store(preds[i]->next[i].load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+  // Bottom-up, so a reader that finds the node on a level can always
+  // continue from it on the levels below.
+  for (int i = 0; i < h; i++)
+    preds[i]->next[i].store(n, std::memory_order_release);
+  if (h > cur) height_.store(h, std::memory_order_release);
+  size_.fetch_add(1, std::memory_order_relaxed);
+  reclaim();
+}
+
+void SkipList::erase(std::string_view key) {
+  Node* preds[kMaxHeight];
+  Node* n = find_preds(key, preds);
+  if (!n || n->key() != key) return;
+
+  for (int i = n->height - 1; i >= 0; i--)
+    preds[i]->next[i].store(n->next[i].load(std::memory_order_relaxed),
+                            std::memory_order_release);
+  size_.fetch_sub(1, std::memory_order_relaxed);
+  n->retired = pending_;
+  pending_ = n;
+  reclaim();
+}
+
+unsigned SkipList::enter() const {
+  for (;;) {
+    uint64_t e = epoch_.load();
+    unsigned slot = static_cast<unsigned>(e & 1);
+    readers_[slot].fetch_add(1);
+    // A flip between the load and the increment may already have checked
+    // this counter; register again under the new epoch.
+    if (epoch_.load() == e) return slot;
+    readers_[slot].fetch_sub(1);
+  }
+}
+
+void SkipList::leave(unsigned slot) const { readers_[slot].fetch_sub(1); }
+
+// Frees the limbo batch once the readers of the epoch it was retired in
+// are gone, then moves the pending batch to limbo and flips the epoch.
+// Readers that entered after a flip can't reach anything retired before it.
+void SkipList::reclaim() {
+  if (limbo_) {
+    unsigned old = static_cast<unsigned>((epoch_.load() - 1) & 1);
+    if (readers_[old].load() != 0) return;
+    while (limbo_) {
+      Node* next = limbo_->retired;
+      free_node(limbo_);
+      limbo_ = next;
+    }
+  }
+  if (!pending_) return;
+  limbo_ = pending_;
+  pending_ = nullptr;
+  epoch_.fetch_add(1);
+}
+
+void SkipList::Cursor::seek(const SkipList& list, std::string_view start) {
+  release();
+  list_ = &list;
+  slot_ = list.enter();
+  node_ = list.find_preds(start, nullptr);
+}
+
+std::string_view SkipList::Cursor::key() const { return node_->key(); }
+
+void SkipList::Cursor::next() {
+  node_ = node_->next[0].load(std::memory_order_acquire);
+}
+
+void SkipList::Cursor::release() {
+  if (list_) list_->leave(slot_);
+  list_ = nullptr;
+  node_ = nullptr;
+}
@@ -1,5 +1,6 @@
 #include "stats.hpp"
 
+#include <iomanip>
 #include <sstream>
 
 void Stats::on_start() { start_ = std::chrono::steady_clock::now(); }
@@ -10,7 +11,7 @@ void Stats::dec_active() { active_.fetch_sub(1); }
 
 void Stats::inc_requests() { total_requests_.fetch_add(1); }
 
-std::string Stats::render(int threads, size_t keys) const {
+std::string Stats::render(int threads, const StoreStats& store) const {
   auto now = std::chrono::steady_clock::now();
   auto up =
       std::chrono::duration_cast<std::chrono::seconds>(now - start_).count();
@@ -19,7 +20,34 @@ std::string Stats::render(int threads, size_t keys) const {
   out << "UPTIME " << up << "s\n";
   out << "ACTIVE_CONNECTIONS " << active_.load() << "\n";
   out << "TOTAL_REQUESTS " << total_requests_.load() << "\n";
-  out << "KEYS " << keys << "\n";
+  out << "KEYS " << store.keys << "\n";
   out << "THREADS " << threads << "\n";
+  out << "WRITE_LOCKS " << store.write_locks << "\n";
+  out << "LAZYFREE_PENDING " << store.lazy_free_pending << "\n";
+  out << "BLOCKED_CLIENTS " << store.blocked_clients << "\n";
+  out << "ENCODING_INT " << store.values_int << "\n";
+  out << "ENCODING_EMBSTR " << store.values_embedded << "\n";
+  out << "ENCODING_RAW " << store.values_raw << "\n";
+  out << "ENCODING_LZ " << store.values_lz << "\n";
+  out << "ENCODING_HASH " << store.values_hash << "\n";
+  out << "ENCODING_ZSET " << store.values_zset << "\n";
+  out << "ENCODING_LIST " << store.values_list << "\n";
+  out << "COMPRESSED_VALUES " << store.compressed_values << "\n";
+  // Costs are per KB of input, so runs with different value sizes compare.
+  out << std::fixed << std::setprecision(2);
+  if (store.compress_bytes_out) {
+    out << "COMPRESS_RATIO "
+        << double(store.compress_bytes_in) / store.compress_bytes_out
+        << "\n";
+  }
+  if (store.compress_bytes_tried) {
+    out << "COMPRESS_NS_PER_KB "
+        << store.compress_ns * 1024.0 / store.compress_bytes_tried << "\n";
+  }
+  if (store.decompressed_bytes) {
+    out << "DECOMPRESS_NS_PER_KB "
+        << store.decompress_ns * 1024.0 / store.decompressed_bytes << "\n";
+  }
+  out << "COMPRESS_DICT_BYTES " << store.dict_bytes << "\n";
   return out.str();
 }
@@ -0,0 +1,58 @@
+#include "tcpkv.hpp"
+
+#include "command.hpp"
+#include "kvstore.hpp"
+#include "stats.hpp"
+
+struct TcpKv::Impl {
+  KVStore kv;
+  Stats stats;
+  CommandEngine engine{kv, stats};
+  Impl() { stats.on_start(); }
+};
+
+TcpKv::TcpKv() : impl_(std::make_unique<Impl>()) {}
+
+TcpKv::~TcpKv() = default;
+
+TcpKv::ValueHandle TcpKv::get(std::string_view key) const {
+  return impl_->kv.get_shared(key);
+}
+
+void TcpKv::set(std::string_view key, std::string_view value) {
+  impl_->kv.set(key, value);
+}
+
+void TcpKv::set(std::string_view key, std::string&& value) {
+  impl_->kv.set(key, std::move(value));
+}
+
+bool TcpKv::del(std::string_view key) { return impl_->kv.del(key); }
+
+bool TcpKv::unlink(std::string_view key) { return impl_->kv.unlink(key); }
+
+void TcpKv::flush(bool async) { impl_->kv.flush(async); }
+
+bool TcpKv::incr(std::string_view key, int64_t delta, int64_t& result) {
+  return impl_->kv.incr(HashedKey(key), delta, result) ==
+         KVStore::IncrResult::kOk;
+}
+
+size_t TcpKv::size() const { return impl_->kv.size(); }
+
+void TcpKv::enable_ordered_index() { impl_->kv.enable_ordered_index(); }
+
+void TcpKv::execute(std::string_view line, std::string& out) {
+  thread_local Command cmd;
+  if (!parse_command(line, cmd)) {
+    format_reply(Reply::error("unknown command"), out);
+    return;
+  }
+  format_reply(impl_->engine.execute(cmd), out);
+}
+
+std::string TcpKv::execute(std::string_view line) {
+  std::string out;
+  execute(line, out);
+  return out;
+}
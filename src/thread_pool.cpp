@@ -32,3 +32,5 @@ void ThreadPool::stop() {
 }
 
 bool ThreadPool::submit(Job job) { return q_.push(std::move(job)); }
+
+bool ThreadPool::try_submit(Job& job) { return q_.try_push(job); }
@@ -0,0 +1,206 @@
+#include "value_codec.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+// Larger values find enough repetition within themselves, and a dictionary
+// is only reachable from the first 64 KB of a block anyway.
+constexpr size_t kDictMaxValue = 64 << 10;
+// Bytes kept from the start of each sampled value.
+constexpr size_t kSampleBytes = 4 << 10;
+// Blocks up to this size are built in a per-thread buffer.
+constexpr size_t kScratchBytes = 256 << 10;
+
+static_assert(sizeof(StoredValue) == 24, "StoredValue grew");
+
+bool parse_canonical_int(std::string_view s, int64_t& out) {
+  if (s.empty() || s.size() > 20) return false;
+  // from_chars takes "007" and "-0"; their formatted forms differ.
+  const size_t digits = s[0] == '-';
+  if (s.size() == digits || (s[digits] == '0' && s.size() > 1)) return false;
+  auto res = std::from_chars(s.data(), s.data() + s.size(), out);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size();
+}
+
+StoredValue StoredValue::of_int(int64_t v) {
+  char buf[20];
+  StoredValue sv;
+  sv.int_ = v;
+  sv.len_ = static_cast<uint32_t>(std::to_chars(buf, buf + 20, v).ptr - buf);
+  sv.enc_ = Enc::kInt;
+  return sv;
+}
+
+StoredValue StoredValue::of_inline(std::string_view v) {
+  int64_t i;
+  if (parse_canonical_int(v, i)) return of_int(i);
+  StoredValue sv;
+  if (v.size() > kEmbedMax) return sv;
+  std::memcpy(sv.embed_, v.data(), v.size());
+  sv.len_ = static_cast<uint32_t>(v.size());
+  sv.enc_ = Enc::kEmbed;
+  return sv;
+}
+
+std::string StoredValue::inline_string() const {
+  char buf[kInlineMax];
+  return std::string(buf, inline_copy(buf));
+}
+
+size_t StoredValue::inline_copy(char* out) const {
+  if (enc_ == Enc::kEmbed) {
+    std::memcpy(out, embed_, len_);
+    return len_;
+  }
+  return static_cast<size_t>(std::to_chars(out, out + kInlineMax, int_).ptr -
+                             out);
+}
+
+static uint64_t ns_since(Clock::time_point t) {
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t)
+          .count());
+}
+
+void ValueCodec::configure(size_t min_bytes, bool train_dict) {
+  min_bytes_.store(min_bytes);
+  train_.store(train_dict && min_bytes != 0);
+}
+
+StoredValue ValueCodec::encode(std::string&& value) {
+  if (StoredValue v = StoredValue::of_inline(value)) return v;
+  const size_t min = min_bytes_.load(std::memory_order_relaxed);
+  if (min != 0 && value.size() >= min) {
+    StoredValue::Enc enc;
+    if (auto packed = compress(value, enc))
+      return {std::move(packed), enc, static_cast<uint32_t>(value.size())};
+  }
+  return {std::make_shared<const std::string>(std::move(value))};
+}
+
+StoredValue ValueCodec::encode(std::shared_ptr<const std::string> value) {
+  if (StoredValue v = StoredValue::of_inline(*value)) return v;
+  const size_t min = min_bytes_.load(std::memory_order_relaxed);
+  if (min != 0 && value->size() >= min) {
+    StoredValue::Enc enc;
+    if (auto packed = compress(*value, enc))
+      return {std::move(packed), enc, static_cast<uint32_t>(value->size())};
+  }
+  return {std::move(value)};
+}
+
+std::shared_ptr<const std::string> ValueCodec::compress(
+    const std::string& v, StoredValue::Enc& enc) {
+  if (v.size() > UINT32_MAX) return nullptr;
+  const auto start = Clock::now();
+  std::shared_ptr<const LzDict> dict;
+  if (v.size() < kDictMaxValue && train_.load(std::memory_order_relaxed)) {
+    dict = std::atomic_load(&dict_);
+    if (!dict) sample(v);
+  }
+
+  thread_local std::string scratch(kScratchBytes, '\0');
+  std::string big;
+  char* out = scratch.data();
+  if (lz_bound(v.size()) > scratch.size()) {
+    big.resize(lz_bound(v.size()));
+    out = big.data();
+  }
+  const size_t n = lz_compress(v.data(), v.size(), out, dict.get());
+  bytes_tried_.fetch_add(v.size(), std::memory_order_relaxed);
+  compress_ns_.fetch_add(ns_since(start), std::memory_order_relaxed);
+  if (n > v.size() - v.size() / 8) return nullptr;
+
+  compressed_.fetch_add(1, std::memory_order_relaxed);
+  bytes_in_.fetch_add(v.size(), std::memory_order_relaxed);
+  bytes_out_.fetch_add(n, std::memory_order_relaxed);
+  enc = dict ? StoredValue::Enc::kLzDict : StoredValue::Enc::kLz;
+  return std::make_shared<const std::string>(out, n);
+}
+
+void ValueCodec::sample(const std::string& v) {
+  std::lock_guard<std::mutex> lk(sample_mu_);
+  if (std::atomic_load(&dict_)) return;  // trained meanwhile
+  samples_.emplace_back(v, 0, std::min(v.size(), kSampleBytes));
+  if (samples_.size() < kSamples) return;
+  auto dict =
+      std::make_shared<const LzDict>(lz_train_dict(samples_, kDictBytes));
+  samples_.clear();
+  samples_.shrink_to_fit();
+  std::atomic_store(&dict_, std::move(dict));
+}
+
+bool ValueCodec::decode_into(const StoredValue& v, char* out) {
+  const auto start = Clock::now();
+  std::shared_ptr<const LzDict> dict;
+  if (v.enc() == StoredValue::Enc::kLzDict) dict = std::atomic_load(&dict_);
+  bool ok = lz_decompress(v.data()->data(), v.data()->size(), out,
+                          v.raw_len(), dict.get());
+  decompress_ns_.fetch_add(ns_since(start), std::memory_order_relaxed);
+  decompressed_.fetch_add(v.raw_len(), std::memory_order_relaxed);
+  return ok;
+}
+
+// A handle to an inline value's bytes. Each thread keeps a few strings
+// (with room for any inline value) and reuses one nobody else holds; a
+// caller keeping every one of them gets a fresh string instead.
+static std::shared_ptr<const std::string> inline_handle(const StoredValue& v) {
+  constexpr size_t kSlots = 8;
+  thread_local std::shared_ptr<std::string> slots[kSlots];
+  thread_local size_t next = 0;
+  char buf[StoredValue::kInlineMax];
+  const size_t n = v.inline_copy(buf);
+  for (size_t i = 0; i < kSlots; i++) {
+    auto& s = slots[(next + i) % kSlots];
+    if (!s) {
+      s = std::make_shared<std::string>();
+      s->reserve(StoredValue::kInlineMax);
+    } else if (s.use_count() != 1) {
+      continue;
+    }
+    // Pairs with the release in the last other owner's decrement, so its
+    // reads are done before the bytes change. (ThreadSanitizer doesn't
+    // model fences and reports handles dropped on another thread.)
+    std::atomic_thread_fence(std::memory_order_acquire);
+    s->assign(buf, n);
+    next = (next + i + 1) % kSlots;
+    return s;
+  }
+  return std::make_shared<const std::string>(buf, n);
+}
+
+// A block that fails to decode can only come from memory corruption; the
+// value then reads as missing.
+std::shared_ptr<const std::string> ValueCodec::decode(const StoredValue& v) {
+  if (v.enc() == StoredValue::Enc::kRaw) return v.data();
+  if (v.is_inline()) return inline_handle(v);
+  if (v.is_object()) return nullptr;
+  std::string out(v.raw_len(), '\0');
+  if (!decode_into(v, out.data())) return nullptr;
+  return std::make_shared<const std::string>(std::move(out));
+}
+
+std::optional<std::string> ValueCodec::decode_string(const StoredValue& v) {
+  if (v.enc() == StoredValue::Enc::kRaw) return *v.data();
+  if (v.is_inline()) return v.inline_string();
+  if (v.is_object()) return std::nullopt;
+  std::string out(v.raw_len(), '\0');
+  if (!decode_into(v, out.data())) return std::nullopt;
+  return out;
+}
+
+ValueCodec::Counters ValueCodec::counters() const {
+  Counters c;
+  c.compressed = compressed_.load(std::memory_order_relaxed);
+  c.bytes_in = bytes_in_.load(std::memory_order_relaxed);
+  c.bytes_out = bytes_out_.load(std::memory_order_relaxed);
+  c.bytes_tried = bytes_tried_.load(std::memory_order_relaxed);
+  c.compress_ns = compress_ns_.load(std::memory_order_relaxed);
+  c.decompressed = decompressed_.load(std::memory_order_relaxed);
+  c.decompress_ns = decompress_ns_.load(std::memory_order_relaxed);
+  if (auto d = std::atomic_load(&dict_)) c.dict_bytes = d->bytes().size();
+  return c;
+}
@@ -0,0 +1,219 @@
+#include "zset_object.hpp"
+
+#include <algorithm>
+#include <new>
+
+#include "key_hash.hpp"
+
+struct ZSetObject::Node {
+  double score;
+  Node* backward;  // null for the first entry
+  uint32_t len;
+  int height;
+  struct Level {
+    Node* next;
+    size_t span;  // entries passed by following `next`
+  } level[1];     // `height` levels, then the member bytes
+
+  char* member_bytes() {
+    return reinterpret_cast<char*>(level) + height * sizeof(level[0]);
+  }
+  std::string_view member() const {
+    return {const_cast<Node*>(this)->member_bytes(), len};
+  }
+};
+
+ZSetObject::Node* ZSetObject::new_node(std::string_view member, double score,
+                                       int height) {
+  const size_t bytes =
+      sizeof(Node) + (height - 1) * sizeof(Node::Level) + member.size();
+  Node* n = static_cast<Node*>(::operator new(bytes));
+  n->score = score;
+  n->backward = nullptr;
+  n->len = static_cast<uint32_t>(member.size());
+  n->height = height;
+  for (int i = 0; i < height; i++) n->level[i] = {nullptr, 0};
+  std::copy(member.begin(), member.end(), n->member_bytes());
+  return n;
+}
+
+bool ZSetObject::before(const Node* n, double score,
+                        std::string_view member) {
+  return n->score < score || (n->score == score && n->member() < member);
+}
+
+ZSetObject::ZSetObject() : head_(new_node({}, 0, kMaxHeight)) {}
+
+ZSetObject::~ZSetObject() {
+  for (Node* n = head_; n;) {
+    Node* next = n->level[0].next;
+    ::operator delete(n);
+    n = next;
+  }
+}
+
+// p = 1/4 per level, as in SkipList.
+int ZSetObject::random_height() {
+  rng_ ^= rng_ << 13;
+  rng_ ^= rng_ >> 7;
+  rng_ ^= rng_ << 17;
+  int h = 1;
+  for (uint64_t r = rng_; h < kMaxHeight && (r & 3) == 0; r >>= 2) h++;
+  return h;
+}
+
+void ZSetObject::find_path(double score, std::string_view member,
+                           Node** update, size_t* rank) const {
+  Node* x = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    rank[i] = i == height_ - 1 ? 0 : rank[i + 1];
+    while (x->level[i].next && before(x->level[i].next, score, member)) {
+      rank[i] += x->level[i].span;
+      x = x->level[i].next;
+    }
+    update[i] = x;
+  }
+}
+
+ZSetObject::Node* ZSetObject::insert(std::string_view member, double score) {
+  Node* update[kMaxHeight];
+  size_t rank[kMaxHeight];
+  find_path(score, member, update, rank);
+  const int h = random_height();
+  if (h > height_) {
+    for (int i = height_; i < h; i++) {
+      rank[i] = 0;
+      update[i] = head_;
+      head_->level[i].span = length_;
+    }
+    height_ = h;
+  }
+
+  Node* x = new_node(member, score, h);
+  for (int i = 0; i < h; i++) {
+    x->level[i].next = update[i]->level[i].next;
+    update[i]->level[i].next = x;
+    // update[i] sits at rank[i] and x at rank[0] + 1.
+    x->level[i].span = update[i]->level[i].span - (rank[0] - rank[i]);
+    update[i]->level[i].span = rank[0] - rank[i] + 1;
+  }
+  for (int i = h; i < height_; i++) update[i]->level[i].span++;
+
+  x->backward = update[0] == head_ ? nullptr : update[0];
+  if (x->level[0].next) x->level[0].next->backward = x;
+  length_++;
+  return x;
+}
+
+void ZSetObject::unlink(Node* x, Node** update) {
+  for (int i = 0; i < height_; i++) {
+    if (update[i]->level[i].next == x) {
+      update[i]->level[i].span += x->level[i].span - 1;
+      update[i]->level[i].next = x->level[i].next;
+    } else {
+      update[i]->level[i].span--;
+    }
+  }
+  if (x->level[0].next) x->level[0].next->backward = x->backward;
+  while (height_ > 1 && !head_->level[height_ - 1].next) height_--;
+  length_--;
+}
+
+bool ZSetObject::add(std::string_view member, double score) {
+  auto slot = members_.try_emplace(member, key_hash(member));
+  if (slot.second) {
+    *slot.first = insert(member, score);
+    return true;
+  }
+  Node* x = *slot.first;
+  if (x->score == score) return false;
+  // Most score changes are small; if the neighbours still bracket the new
+  // score the node stays where it is.
+  Node* next = x->level[0].next;
+  if ((!x->backward || before(x->backward, score, member)) &&
+      (!next || !before(next, score, member))) {
+    x->score = score;
+    return false;
+  }
+  Node* update[kMaxHeight];
+  size_t rank[kMaxHeight];
+  find_path(x->score, member, update, rank);
+  unlink(x, update);
+  ::operator delete(x);
+  *slot.first = insert(member, score);
+  return false;
+}
+
+bool ZSetObject::remove(std::string_view member) {
+  const uint64_t h = key_hash(member);
+  Node* const* slot = members_.find(member, h);
+  if (!slot) return false;
+  Node* x = *slot;
+  Node* update[kMaxHeight];
+  size_t rank[kMaxHeight];
+  find_path(x->score, member, update, rank);
+  unlink(x, update);
+  members_.erase(member, h);
+  ::operator delete(x);
+  return true;
+}
+
+bool ZSetObject::score(std::string_view member, double& out) const {
+  Node* const* slot = members_.find(member, key_hash(member));
+  if (!slot) return false;
+  out = (*slot)->score;
+  return true;
+}
+
+bool ZSetObject::rank(std::string_view member, size_t& out) const {
+  double s;
+  if (!score(member, s)) return false;
+  size_t r = 0;
+  const Node* x = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    while (x->level[i].next && before(x->level[i].next, s, member)) {
+      r += x->level[i].span;
+      x = x->level[i].next;
+    }
+  }
+  out = r;  // entries before it
+  return true;
+}
+
+void ZSetObject::range(size_t start, size_t stop,
+                       std::vector<Entry>& out) const {
+  if (start >= length_ || start > stop) return;
+  stop = std::min(stop, length_ - 1);
+  // Walk down to position start + 1 (the head is position 0).
+  size_t pos = 0;
+  const Node* x = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    while (x->level[i].next && pos + x->level[i].span <= start + 1) {
+      pos += x->level[i].span;
+      x = x->level[i].next;
+    }
+  }
+  for (size_t n = stop - start + 1; n > 0 && x; n--, x = x->level[0].next)
+    out.emplace_back(x->member(), x->score);
+}
+
+void ZSetObject::range_by_score(double min, bool min_excl, double max,
+                                bool max_excl, size_t offset, size_t limit,
+                                std::vector<Entry>& out) const {
+  const Node* x = head_;
+  for (int i = height_ - 1; i >= 0; i--) {
+    while (x->level[i].next && (min_excl ? x->level[i].next->score <= min
+                                         : x->level[i].next->score < min))
+      x = x->level[i].next;
+  }
+  size_t taken = 0;
+  for (x = x->level[0].next; x && taken < limit; x = x->level[0].next) {
+    if (max_excl ? x->score >= max : x->score > max) break;
+    if (offset > 0) {
+      offset--;
+      continue;
+    }
+    out.emplace_back(x->member(), x->score);
+    taken++;
+  }
+}
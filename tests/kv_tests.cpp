@@ -0,0 +1,138 @@
+// Correctness checks on the core components, run by ctest (one test per
+// check). They live here rather than in microbench so it stays timing-only.
+//
+//   kv_tests [NAME]...
+//
+// Runs the named checks, or all of them; exits 1 if any fails.
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "command.hpp"
+#include "connection.hpp"
+#include "hash_table.hpp"
+#include "key_hash.hpp"
+#include "kvstore.hpp"
+#include "parker.hpp"
+#include "protocol.hpp"
+#include "stats.hpp"
+
+namespace {
+
+// A cursor walk over a table that doubles many times along the way returns
+// every key present throughout exactly once.
+bool scan_growth() {
+  HashTable<uint32_t> t;
+  const uint32_t n = 1000;
+  for (uint32_t i = 0; i < n; i++) {
+    const std::string k = "key:" + std::to_string(i);
+    *t.try_emplace(k, key_hash(k)).first = i;
+  }
+  std::vector<int> seen(n);
+  uint64_t cursor = 0;
+  size_t steps = 0, added = 0;
+  do {
+    cursor = t.scan(cursor, [&](const std::string&, uint32_t v) {
+      if (v < seen.size()) seen[v]++;
+    });
+    if (++steps % 7 == 0 && added < 50000) {
+      for (int j = 0; j < 50; j++, added++) {
+        const std::string k = "grown:" + std::to_string(added);
+        *t.try_emplace(k, key_hash(k)).first = UINT32_MAX;
+      }
+    }
+  } while (cursor != 0);
+  for (int c : seen) {
+    if (c != 1) {
+      std::cerr << "HashTable::scan: a key was seen " << c
+                << " times while the table grew\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// An element pushed for a BLPOP that can't be answered stays in the list:
+// one client parks in BLPOP and hangs up before the push, another BLPOP
+// comes through CommandEngine::handle, which can't park at all.
+bool blpop_lost_waiters() {
+  KVStore kv;
+  Stats stats;
+  CommandEngine engine(kv, stats);
+  Parker parker([](const std::shared_ptr<Session>&) { return true; });
+  int sv[2];
+  if (!parker.start() || ::socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+    std::cerr << "BLPOP check: setup failed\n";
+    return false;
+  }
+  engine.set_parker(&parker);
+  bool ok = true;
+  auto expect = [&](const std::string& line, const std::string& want) {
+    const std::string got = engine.handle(line);
+    if (got == want) return;
+    std::cerr << "BLPOP check: " << line << " replied " << got;
+    ok = false;
+  };
+
+  auto session = std::make_shared<Session>(sv[1]);
+  const std::atomic<bool> running{true};
+  send_str(sv[0], "BLPOP gone 0\n");
+  if (serve_connection(*session, engine, stats, running)) {
+    ::close(sv[0]);
+    expect("RPUSH gone job-1", "VALUE 1\n");
+    expect("LRANGE gone 0 -1", "ARRAY 1\njob-1\n");
+  } else {
+    std::cerr << "BLPOP check: the client wasn't parked\n";
+    ::close(sv[0]);
+    ok = false;
+  }
+
+  expect("BLPOP inline 0", "NOTFOUND\n");
+  expect("RPUSH inline job-2", "VALUE 1\n");
+  expect("LRANGE inline 0 -1", "ARRAY 1\njob-2\n");
+
+  parker.stop();
+  engine.set_parker(nullptr);
+  ::close(sv[1]);
+  return ok;
+}
+
+struct Check {
+  const char* name;
+  bool (*run)();
+};
+
+const Check kChecks[] = {
+    {"scan_growth", scan_growth},
+    {"blpop_lost_waiters", blpop_lost_waiters},
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> names(argv + 1, argv + argc);
+  if (names.empty())
+    for (const Check& c : kChecks) names.push_back(c.name);
+
+  int failed = 0;
+  for (const std::string& name : names) {
+    const Check* check = nullptr;
+    for (const Check& c : kChecks)
+      if (name == c.name) check = &c;
+    if (!check) {
+      std::cerr << "unknown check: " << name << "\n";
+      return 1;
+    }
+    const bool ok = check->run();
+    std::cout << (ok ? "ok   " : "FAIL ") << name << "\n";
+    failed += !ok;
+  }
+  return failed ? 1 : 0;
+}